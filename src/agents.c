@@ -0,0 +1,231 @@
+#include "agents.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                           \
+    (defined(__GNUC__) || defined(__clang__))
+#define AGENTS_HAVE_X86 1
+#include <immintrin.h>
+#else
+#define AGENTS_HAVE_X86 0
+#endif
+
+/* is_walkable() against an explicit map. */
+static bool walkable(const Map *map, double x, double y)
+{
+  int mx = (int)x;
+  int my = (int)y;
+  if (mx < 0 || mx >= map->width || my < 0 || my >= map->height)
+    return false;
+  return !map_blocked(map, mx, my);
+}
+
+/* Rotation by an angle given as its cosine and sine. */
+static void rotate(Camera *cam, double c, double s)
+{
+  double oldDirX = cam->dirX;
+  cam->dirX = cam->dirX * c - cam->dirY * s;
+  cam->dirY = oldDirX * s + cam->dirY * c;
+  double oldPlaneX = cam->planeX;
+  cam->planeX = cam->planeX * c - cam->planeY * s;
+  cam->planeY = oldPlaneX * s + cam->planeY * c;
+}
+
+/* `turns` holds cos and sin of `turn` and of -turn. */
+static void step_one(Camera *cam, unsigned actions, double move,
+                     const double turns[4], const Map *map)
+{
+  if (actions & AGENT_FORWARD)
+  {
+    double newX = cam->posX + cam->dirX * move;
+    double newY = cam->posY + cam->dirY * move;
+    if (walkable(map, newX, cam->posY))
+      cam->posX = newX;
+    if (walkable(map, cam->posX, newY))
+      cam->posY = newY;
+  }
+  if (actions & AGENT_BACK)
+  {
+    double newX = cam->posX - cam->dirX * move;
+    double newY = cam->posY - cam->dirY * move;
+    if (walkable(map, newX, cam->posY))
+      cam->posX = newX;
+    if (walkable(map, cam->posX, newY))
+      cam->posY = newY;
+  }
+  if (actions & AGENT_RIGHT)
+    rotate(cam, turns[0], turns[1]);
+  if (actions & AGENT_LEFT)
+    rotate(cam, turns[2], turns[3]);
+}
+
+static void turn_table(double turn, double turns[4])
+{
+  turns[0] = cos(turn);
+  turns[1] = sin(turn);
+  turns[2] = cos(-turn);
+  turns[3] = sin(-turn);
+}
+
+void agent_step(Camera *cam, unsigned actions, double move, double turn,
+                const Map *map)
+{
+  double turns[4];
+  turn_table(turn, turns);
+  step_one(cam, actions, move, turns, map);
+}
+
+static void step_range(CameraBatch *agents, const uint8_t *actions,
+                       double move, const double turns[4], const Map *map,
+                       int begin, int end)
+{
+  for (int i = begin; i < end; ++i)
+  {
+    Camera cam;
+    camera_batch_get(agents, i, &cam);
+    step_one(&cam, actions[i], move, turns, map);
+    camera_batch_set(agents, i, &cam);
+  }
+}
+
+void agents_step_scalar(CameraBatch *agents, const uint8_t *actions,
+                        double move, double turn, const Map *map)
+{
+  double turns[4];
+  turn_table(turn, turns);
+  step_range(agents, actions, move, turns, map, 0, agents->count);
+}
+
+#if AGENTS_HAVE_X86
+
+#define AGENTS_AVX2 __attribute__((target("avx2"), always_inline)) static inline
+
+/* Lanes whose cell is inside the map and clear in the occupancy bitset;
+   truncation and bounds follow walkable(). Lanes outside the map gather
+   word 0 and are masked off. */
+AGENTS_AVX2 __m256d avx2_walkable(const Map *map, __m256d x, __m256d y)
+{
+  const __m128i mx = _mm256_cvttpd_epi32(x);
+  const __m128i my = _mm256_cvttpd_epi32(y);
+  const __m128i minusOne = _mm_set1_epi32(-1);
+  __m128i inside = _mm_and_si128(
+      _mm_and_si128(_mm_cmpgt_epi32(mx, minusOne),
+                    _mm_cmpgt_epi32(_mm_set1_epi32(map->width), mx)),
+      _mm_and_si128(_mm_cmpgt_epi32(my, minusOne),
+                    _mm_cmpgt_epi32(_mm_set1_epi32(map->height), my)));
+  __m128i word =
+      _mm_add_epi32(_mm_mullo_epi32(my, _mm_set1_epi32(map->row_words)),
+                    _mm_srai_epi32(mx, 5));
+  word = _mm_and_si128(word, inside);
+  __m128i bits = _mm_i32gather_epi32((const int *)map->occupancy, word, 4);
+  bits = _mm_srlv_epi32(bits, _mm_and_si128(mx, _mm_set1_epi32(31)));
+  __m128i clear = _mm_cmpeq_epi32(_mm_and_si128(bits, _mm_set1_epi32(1)),
+                                  _mm_setzero_si128());
+  return _mm256_castsi256_pd(
+      _mm256_cvtepi32_epi64(_mm_and_si128(inside, clear)));
+}
+
+/* Lanes whose action byte has `flag` set. */
+AGENTS_AVX2 __m256d avx2_action(__m128i actions, unsigned flag)
+{
+  const __m128i f = _mm_set1_epi32((int)flag);
+  __m128i set = _mm_cmpeq_epi32(_mm_and_si128(actions, f), f);
+  return _mm256_castsi256_pd(_mm256_cvtepi32_epi64(set));
+}
+
+/* A step of `move` (negated for back steps) in the lanes of `active`,
+   with the operation order of step_one(). */
+AGENTS_AVX2 void avx2_move(const Map *map, __m256d active, bool back,
+                           __m256d move, __m256d dirX, __m256d dirY,
+                           __m256d *posX, __m256d *posY)
+{
+  __m256d dx = _mm256_mul_pd(dirX, move);
+  __m256d dy = _mm256_mul_pd(dirY, move);
+  __m256d newX = back ? _mm256_sub_pd(*posX, dx) : _mm256_add_pd(*posX, dx);
+  __m256d newY = back ? _mm256_sub_pd(*posY, dy) : _mm256_add_pd(*posY, dy);
+  __m256d okX = _mm256_and_pd(active, avx2_walkable(map, newX, *posY));
+  *posX = _mm256_blendv_pd(*posX, newX, okX);
+  __m256d okY = _mm256_and_pd(active, avx2_walkable(map, *posX, newY));
+  *posY = _mm256_blendv_pd(*posY, newY, okY);
+}
+
+AGENTS_AVX2 void avx2_rotate(__m256d active, double c, double s,
+                             __m256d *x, __m256d *y)
+{
+  const __m256d vc = _mm256_set1_pd(c);
+  const __m256d vs = _mm256_set1_pd(s);
+  __m256d newX = _mm256_sub_pd(_mm256_mul_pd(*x, vc), _mm256_mul_pd(*y, vs));
+  __m256d newY = _mm256_add_pd(_mm256_mul_pd(*x, vs), _mm256_mul_pd(*y, vc));
+  *x = _mm256_blendv_pd(*x, newX, active);
+  *y = _mm256_blendv_pd(*y, newY, active);
+}
+
+__attribute__((target("avx2"))) static int
+step_avx2(CameraBatch *agents, const uint8_t *actions, double move,
+          const double turns[4], const Map *map)
+{
+  const __m256d vmove = _mm256_set1_pd(move);
+  int i = 0;
+  for (; i + 4 <= agents->count; i += 4)
+  {
+    int32_t packed;
+    memcpy(&packed, actions + i, sizeof(packed));
+    const __m128i act = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+    if (_mm_testz_si128(act, act))
+      continue;
+    __m256d posX = _mm256_loadu_pd(agents->posX + i);
+    __m256d posY = _mm256_loadu_pd(agents->posY + i);
+    __m256d dirX = _mm256_loadu_pd(agents->dirX + i);
+    __m256d dirY = _mm256_loadu_pd(agents->dirY + i);
+    __m256d planeX = _mm256_loadu_pd(agents->planeX + i);
+    __m256d planeY = _mm256_loadu_pd(agents->planeY + i);
+
+    __m256d active = avx2_action(act, AGENT_FORWARD);
+    if (_mm256_movemask_pd(active))
+      avx2_move(map, active, false, vmove, dirX, dirY, &posX, &posY);
+    active = avx2_action(act, AGENT_BACK);
+    if (_mm256_movemask_pd(active))
+      avx2_move(map, active, true, vmove, dirX, dirY, &posX, &posY);
+    for (int t = 0; t < 2; ++t)
+    {
+      active = avx2_action(act, t == 0 ? AGENT_RIGHT : AGENT_LEFT);
+      if (_mm256_movemask_pd(active))
+      {
+        avx2_rotate(active, turns[2 * t], turns[2 * t + 1], &dirX, &dirY);
+        avx2_rotate(active, turns[2 * t], turns[2 * t + 1], &planeX,
+                    &planeY);
+      }
+    }
+
+    _mm256_storeu_pd(agents->posX + i, posX);
+    _mm256_storeu_pd(agents->posY + i, posY);
+    _mm256_storeu_pd(agents->dirX + i, dirX);
+    _mm256_storeu_pd(agents->dirY + i, dirY);
+    _mm256_storeu_pd(agents->planeX + i, planeX);
+    _mm256_storeu_pd(agents->planeY + i, planeY);
+  }
+  return i;
+}
+
+static bool has_avx2(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+void agents_step(CameraBatch *agents, const uint8_t *actions, double move,
+                 double turn, const Map *map)
+{
+  double turns[4];
+  turn_table(turn, turns);
+  int done = 0;
+#if AGENTS_HAVE_X86
+  if (has_avx2())
+    done = step_avx2(agents, actions, move, turns, map);
+#endif
+  step_range(agents, actions, move, turns, map, done, agents->count);
+}
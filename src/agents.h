@@ -0,0 +1,33 @@
+#ifndef RAYCAST_AGENTS_H
+#define RAYCAST_AGENTS_H
+
+#include <stdint.h>
+
+#include "map.h"
+#include "render.h"
+
+/* Actions of one tick, applied in this order: step forward, step back,
+   turn right, turn left. */
+#define AGENT_FORWARD 1u
+#define AGENT_BACK 2u
+#define AGENT_RIGHT 4u
+#define AGENT_LEFT 8u
+
+/* One tick of one agent, the demos' arrow-key movement: a step of `move`
+   map units along dir commits each axis separately, x first, and only
+   into an empty cell of `map`, so agents slide along walls; a turn
+   rotates dir and plane by `turn` radians. */
+void agent_step(Camera *cam, unsigned actions, double move, double turn,
+                const Map *map);
+
+/* agent_step() for camera i of `agents` with actions[i]. With AVX2 the
+   agents go four at a time, collisions testing the occupancy bitset with
+   one gather per axis, and every result matches agent_step() bit for bit;
+   nothing outside the arguments is read, so a run replays exactly. */
+void agents_step(CameraBatch *agents, const uint8_t *actions, double move,
+                 double turn, const Map *map);
+/* agents_step() one agent at a time on any CPU. */
+void agents_step_scalar(CameraBatch *agents, const uint8_t *actions,
+                        double move, double turn, const Map *map);
+
+#endif
@@ -0,0 +1,1706 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "agents.h"
+#include "dda.h"
+#include "governor.h"
+#include "interlace.h"
+#include "light.h"
+#include "profile.h"
+#include "render.h"
+#include "sprite.h"
+#include "texcache.h"
+#include "yuv.h"
+
+#define BENCH_TEX_SIZE 64
+#define BENCH_NUM_TEXTURES 3
+#define BENCH_MAX_SIZES 8
+#define BENCH_MAX_VARIANTS 16
+#define BENCH_CHECK_FRAMES 8
+#define BENCH_SPRITES 10000
+#define BENCH_BATCH_ROUNDS 10
+#define BENCH_AGENT_TICKS 1000
+/* Radians per frame of the reprojection turn: the demos' turn rate at
+   60 fps. */
+#define BENCH_TURN_STEP 0.025
+/* Fraction of its travel a door slides per frame of the door run, and one
+   in how many doors is toggled each frame. */
+#define BENCH_DOOR_STEP 0.125
+#define BENCH_DOOR_TOGGLE 4
+/* Lowest PSNR, in dB, against the full frames of the worst interlaced
+   frame and of the whole run along the bench path, and turning in place,
+   at a 4:3 size BENCH_INTERLACE_WIDTH columns wide. Missing columns are
+   mostly the mean of their neighbours there, which is off by less as
+   texels span more pixels: the bounds rise BENCH_INTERLACE_SLOPE dB per
+   doubling of the largest 4:3 size within the target, about 0.3 dB less
+   than the error does. Under BENCH_INTERLACE_MIN_WIDTH columns of it, a
+   texel is about a pixel and neighbours say little about the columns
+   between them, so only still frames are held to the full ones. */
+#define BENCH_INTERLACE_WIDTH 320
+#define BENCH_INTERLACE_MIN_WIDTH 64
+#define BENCH_INTERLACE_SLOPE 2.5
+#define BENCH_INTERLACE_PSNR 23.0
+#define BENCH_INTERLACE_RUN_PSNR 25.5
+#define BENCH_INTERLACE_TURN_PSNR 22.5
+#define BENCH_INTERLACE_TURN_RUN_PSNR 25.0
+/* Lighting of the -lit variants: one light per this many cells over a dim
+   ambient level, fading a level every BENCH_FOG_DISTANCE. */
+#define BENCH_LIGHT_CELLS 64
+#define BENCH_LIGHT_AMBIENT 6
+#define BENCH_FOG_DISTANCE 0.5
+#define BENCH_SIDE_DROP 4
+/* Most a -lit variant's frames may take over its unlit one's at the
+   median in the lighting run, in percent: lit floors read a copy of their
+   texture per light level, which costs the scanline floors most. */
+#define BENCH_LIGHT_BUDGET 20.0
+
+typedef struct BenchSize
+{
+  int width;
+  int height;
+} BenchSize;
+
+/* Sprites drawn by the textured-sprites variant over a wall depth buffer
+   as wide as the widest size. The totals cover the timed frames. */
+typedef struct BenchSprites
+{
+  Sprite *sprites;
+  int count;
+  SpriteGrid grid;
+  Texture texture;
+  double *depth;
+  int frames;
+  double ms;
+  long candidates;
+  long visible;
+} BenchSprites;
+
+/* `columns` is a column-major scratch target sized like the frame being
+   timed; `column_textures` share texels with `textures` but also carry the
+   column-major copies. `indexed_textures` share level 0 with `textures`
+   and carry its palette quantization and lit palettes;
+   `quantized_textures` are the same palette colours stored as ARGB.
+   `skip_map` is the map being drawn plus its empty-space skipping levels,
+   `lit_map` the same tiles with baked light that the -lit variants draw
+   under `lighting`. `over_bound` counts runs that differed from their
+   reference by more than the variant allows. With `budget_ms` set
+   the timed frames are drawn at the size a ResolutionGovernor picks.
+   `cache` streams copies of `textures`, warmed up before the runs. */
+typedef struct BenchContext
+{
+  const Texture *textures;
+  const Texture *column_textures;
+  const Texture *indexed_textures;
+  const Texture *quantized_textures;
+  int texture_count;
+  WorkerPool *pool;
+  RayKernel kernel;
+  Framebuffer columns;
+  const Map *skip_map;
+  const Map *lit_map;
+  const Lighting *lighting;
+  int over_bound;
+  double budget_ms;
+  TextureCache *cache;
+  BenchSprites *sprites;
+} BenchContext;
+
+typedef void (*BenchRenderFn)(const Framebuffer *fb, const Camera *cam,
+                              const BenchContext *ctx);
+
+/* `reference` names the variant whose output this one must reproduce; the
+   bench reports the fraction of pixels that differ from it and fails when
+   that exceeds `max_diff`. Variants with RAY_KERNEL_AUTO use the kernel
+   picked with -k. */
+typedef struct BenchVariant
+{
+  const char *name;
+  BenchRenderFn render;
+  const char *reference;
+  double max_diff;
+  RayKernel kernel;
+  RenderNumeric numeric;
+} BenchVariant;
+
+static double now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1.0e6;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+  double da = *(const double *)a;
+  double db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+/* Procedural stand-ins for the PNGs in assets/sides/ so the bench runs
+   without SDL_image; sampling cost only depends on the texture size. */
+static bool make_textures(Texture *textures, int size)
+{
+  for (int i = 0; i < BENCH_NUM_TEXTURES; ++i)
+  {
+    Texture *tex = &textures[i];
+    tex->width = size;
+    tex->height = size;
+    tex->pixels = malloc(sizeof(uint32_t) * (size_t)size * size);
+    if (!tex->pixels)
+    {
+      return false;
+    }
+    for (int y = 0; y < size; ++y)
+    {
+      for (int x = 0; x < size; ++x)
+      {
+        uint32_t u = (uint32_t)(x * 256 / size);
+        uint32_t v = (uint32_t)(y * 256 / size);
+        uint32_t c;
+        if (i == 0)
+          c = (u ^ v) * 0x010101u; /* xor pattern */
+        else if (i == 1)
+          c = u << 16 | v; /* gradient */
+        else
+          c = (x % (size / 4) && y % (size / 4)) ? 0xA0A0A0u
+                                                 : 0x404040u; /* tiles */
+        tex->pixels[(size_t)y * size + x] = c | 0xFF000000u;
+      }
+    }
+    if (!texture_build_mips(tex))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Builds `indexed` from `textures`, sharing their texels, with lit
+   palettes, and `quantized` from the palette colours; prints the level-0
+   texture memory and the texels the palettes changed. */
+static bool make_indexed(const Texture *textures, Texture *indexed,
+                         Texture *quantized)
+{
+  size_t argb = 0;
+  size_t bytes = 0;
+  long changed = 0;
+  size_t total = 0;
+  for (int i = 0; i < BENCH_NUM_TEXTURES; ++i)
+  {
+    size_t texels = (size_t)textures[i].width * textures[i].height;
+    indexed[i] = textures[i];
+    indexed[i].borrowed = TEXTURE_BORROWED_PIXELS | TEXTURE_BORROWED_MIPS;
+    long count = texture_build_palette(&indexed[i]);
+    quantized[i].pixels = malloc(sizeof(uint32_t) * texels);
+    if (count < 0 || !light_build_palette(&indexed[i]) ||
+        !quantized[i].pixels)
+      return false;
+    quantized[i].width = textures[i].width;
+    quantized[i].height = textures[i].height;
+    /* Indices are column-major. */
+    const uint8_t *indices = indexed[i].indices;
+    for (int x = 0; x < quantized[i].width; ++x)
+    {
+      for (int y = 0; y < quantized[i].height; ++y)
+        quantized[i].pixels[(size_t)y * quantized[i].width + x] =
+            indexed[i].palette[*indices++];
+    }
+    argb += sizeof(uint32_t) * texels;
+    bytes += texels + sizeof(uint32_t) * 2 * TEXTURE_PALETTE_SIZE;
+    changed += count;
+    total += texels;
+  }
+  printf("level-0 textures: %.1f KiB ARGB, %.1f KiB indexed, %.2f%% of "
+         "texels quantized\n",
+         argb / 1024.0, bytes / 1024.0, 100.0 * changed / total);
+  return true;
+}
+
+/* Streams a copy of procedural texture `id`. */
+static bool load_copy(void *arg, int id, Texture *out)
+{
+  const Texture *src = (const Texture *)arg + id;
+  size_t bytes = sizeof(uint32_t) * (size_t)src->width * src->height;
+  memset(out, 0, sizeof(*out));
+  out->pixels = malloc(bytes);
+  if (!out->pixels)
+  {
+    fprintf(stderr, "Out of memory while streaming texture %d\n", id);
+    return false;
+  }
+  memcpy(out->pixels, src->pixels, bytes);
+  out->width = src->width;
+  out->height = src->height;
+  return true;
+}
+
+/* Walks a loop around the open ring of the built-in map while sweeping
+   the view left and right, so every frame sees a mix of near and far
+   walls. The loop is anchored at the spawn cell, so a loaded map (-m) gets
+   the same walk around its own spawn. */
+static void bench_camera(int frame, int frames, Camera *cam)
+{
+  static const double waypoints[][2] = {
+      {-1.0, -1.0}, {6.0, -1.0}, {6.0, 6.0}, {-1.0, 6.0}};
+  const int count = (int)(sizeof(waypoints) / sizeof(waypoints[0]));
+  const Map *map = render_map();
+  const double originX = map->spawn_x + 0.5;
+  const double originY = map->spawn_y + 0.5;
+
+  double t = (double)frame / frames * count;
+  int seg = (int)t % count;
+  double f = t - floor(t);
+  const double a[2] = {originX + waypoints[seg][0],
+                       originY + waypoints[seg][1]};
+  const double b[2] = {originX + waypoints[(seg + 1) % count][0],
+                       originY + waypoints[(seg + 1) % count][1]};
+
+  double heading = atan2(b[1] - a[1], b[0] - a[0]);
+  double angle = heading + 0.8 * sin(t * 6.2831853);
+
+  cam->posX = a[0] + (b[0] - a[0]) * f;
+  cam->posY = a[1] + (b[1] - a[1]) * f;
+  cam->dirX = cos(angle);
+  cam->dirY = sin(angle);
+  cam->planeX = -cam->dirY * 0.66;
+  cam->planeY = cam->dirX * 0.66;
+}
+
+static void bench_flat(const Framebuffer *fb, const Camera *cam,
+                       const BenchContext *ctx)
+{
+  (void)ctx;
+  render_frame_flat(fb, cam, NULL);
+}
+
+static void bench_textured(const Framebuffer *fb, const Camera *cam,
+                           const BenchContext *ctx)
+{
+  render_frame_textured(fb, cam, ctx->textures, ctx->texture_count, NULL,
+                        NULL);
+}
+
+static void bench_textured_palette(const Framebuffer *fb,
+                                     const Camera *cam,
+                                     const BenchContext *ctx)
+{
+  render_frame_textured(fb, cam, ctx->quantized_textures,
+                        ctx->texture_count, NULL, NULL);
+}
+
+static void bench_textured_indexed(const Framebuffer *fb, const Camera *cam,
+                                   const BenchContext *ctx)
+{
+  render_frame_textured(fb, cam, ctx->indexed_textures, ctx->texture_count,
+                        NULL, NULL);
+}
+
+static void bench_flat_mt(const Framebuffer *fb, const Camera *cam,
+                          const BenchContext *ctx)
+{
+  render_frame_flat(fb, cam, ctx->pool);
+}
+
+static void bench_textured_mt(const Framebuffer *fb, const Camera *cam,
+                              const BenchContext *ctx)
+{
+  render_frame_textured(fb, cam, ctx->textures, ctx->texture_count, NULL,
+                        ctx->pool);
+}
+
+static void bench_flat_cm(const Framebuffer *fb, const Camera *cam,
+                          const BenchContext *ctx)
+{
+  render_frame_flat(&ctx->columns, cam, NULL);
+  framebuffer_resolve(fb, &ctx->columns, NULL);
+}
+
+static void bench_textured_cm(const Framebuffer *fb, const Camera *cam,
+                              const BenchContext *ctx)
+{
+  render_frame_textured(&ctx->columns, cam, ctx->column_textures,
+                        ctx->texture_count, NULL, NULL);
+  framebuffer_resolve(fb, &ctx->columns, NULL);
+}
+
+static void bench_textured_scanline(const Framebuffer *fb, const Camera *cam,
+                                    const BenchContext *ctx)
+{
+  const RenderOptions options = {FLOOR_SCANLINE, false, NULL, 1, 0};
+  render_frame_textured(fb, cam, ctx->textures, ctx->texture_count, &options,
+                        NULL);
+}
+
+static void bench_textured_mip(const Framebuffer *fb, const Camera *cam,
+                               const BenchContext *ctx)
+{
+  const RenderOptions options = {FLOOR_COLUMNS, true, NULL, 1, 0};
+  render_frame_textured(fb, cam, ctx->textures, ctx->texture_count, &options,
+                        NULL);
+}
+
+static void bench_textured_scanline_mip(const Framebuffer *fb,
+                                        const Camera *cam,
+                                        const BenchContext *ctx)
+{
+  const RenderOptions options = {FLOOR_SCANLINE, true, NULL, 1, 0};
+  render_frame_textured(fb, cam, ctx->textures, ctx->texture_count, &options,
+                        NULL);
+}
+
+static void bench_textured_stream(const Framebuffer *fb, const Camera *cam,
+                                  const BenchContext *ctx)
+{
+  /* Without a cache this times the plain textures instead. */
+  const Texture *textures =
+      ctx->cache ? texture_cache_frame(ctx->cache) : ctx->textures;
+  render_frame_textured(fb, cam, textures, ctx->texture_count, NULL, NULL);
+}
+
+static void bench_flat_skip(const Framebuffer *fb, const Camera *cam,
+                            const BenchContext *ctx)
+{
+  const Map *map = render_map();
+  render_set_map(ctx->skip_map);
+  render_frame_flat(fb, cam, NULL);
+  render_set_map(map);
+}
+
+static void bench_textured_skip(const Framebuffer *fb, const Camera *cam,
+                                const BenchContext *ctx)
+{
+  const Map *map = render_map();
+  render_set_map(ctx->skip_map);
+  render_frame_textured(fb, cam, ctx->textures, ctx->texture_count, NULL,
+                        NULL);
+  render_set_map(map);
+}
+
+/* Draws ctx->lit_map under the bench lighting, or unlit when the light
+   could not be baked. */
+static void bench_lit(const Framebuffer *fb, const Camera *cam,
+                      const BenchContext *ctx, const Texture *textures,
+                      const RenderOptions *options, WorkerPool *pool)
+{
+  const Map *map = render_map();
+  render_set_map(ctx->lit_map);
+  render_set_lighting(ctx->lighting);
+  if (textures)
+    render_frame_textured(fb, cam, textures, ctx->texture_count, options,
+                          pool);
+  else
+    render_frame_flat(fb, cam, pool);
+  render_set_lighting(NULL);
+  render_set_map(map);
+}
+
+static void bench_flat_lit(const Framebuffer *fb, const Camera *cam,
+                           const BenchContext *ctx)
+{
+  bench_lit(fb, cam, ctx, NULL, NULL, NULL);
+}
+
+static void bench_textured_lit(const Framebuffer *fb, const Camera *cam,
+                               const BenchContext *ctx)
+{
+  bench_lit(fb, cam, ctx, ctx->textures, NULL, NULL);
+}
+
+static void bench_textured_scanline_lit(const Framebuffer *fb,
+                                        const Camera *cam,
+                                        const BenchContext *ctx)
+{
+  const RenderOptions options = {FLOOR_SCANLINE, false, NULL, 1, 0};
+  bench_lit(fb, cam, ctx, ctx->textures, &options, NULL);
+}
+
+static void bench_textured_indexed_lit(const Framebuffer *fb,
+                                       const Camera *cam,
+                                       const BenchContext *ctx)
+{
+  bench_lit(fb, cam, ctx, ctx->indexed_textures, NULL, NULL);
+}
+
+static void bench_textured_mt_lit(const Framebuffer *fb, const Camera *cam,
+                                  const BenchContext *ctx)
+{
+  bench_lit(fb, cam, ctx, ctx->textures, NULL, ctx->pool);
+}
+
+static void bench_flat_coalesce(const Framebuffer *fb, const Camera *cam,
+                                const BenchContext *ctx)
+{
+  render_coalesce_select(true);
+  render_frame_flat(fb, cam, ctx->pool);
+  render_coalesce_select(false);
+}
+
+static void bench_textured_coalesce(const Framebuffer *fb, const Camera *cam,
+                                    const BenchContext *ctx)
+{
+  render_coalesce_select(true);
+  render_frame_textured(fb, cam, ctx->textures, ctx->texture_count, NULL,
+                        ctx->pool);
+  render_coalesce_select(false);
+}
+
+static void bench_textured_sprites(const Framebuffer *fb, const Camera *cam,
+                                   const BenchContext *ctx)
+{
+  BenchSprites *sprites = ctx->sprites;
+  const RenderOptions options = {FLOOR_COLUMNS, false, sprites->depth, 1,
+                                 0};
+  render_frame_textured(fb, cam, ctx->textures, ctx->texture_count, &options,
+                        ctx->pool);
+  SpriteStats stats;
+  double start = now_ms();
+  render_sprites(fb, cam, sprites->sprites, &sprites->grid,
+                 &sprites->texture, 1, sprites->depth, ctx->pool, &stats);
+  sprites->ms += now_ms() - start;
+  sprites->candidates += stats.candidates;
+  sprites->visible += stats.visible;
+  ++sprites->frames;
+}
+
+/* Bounds: exact for the kernel, threading, layout, skipping, streaming,
+   coalescing and indexed variants; the scanline floors, with or without
+   mipmaps, differ from the column floor only where a texel edge falls
+   within their 32.32 stepping error, a few millionths of a texel, and the
+   palette variants only report how many pixels the palettes change. */
+static const BenchVariant g_variants[] = {
+    {"flat", bench_flat, NULL, 0.0, RAY_KERNEL_SCALAR, RENDER_NUMERIC_DOUBLE},
+    {"textured", bench_textured, NULL, 0.0, RAY_KERNEL_SCALAR,
+     RENDER_NUMERIC_DOUBLE},
+    {"flat-simd", bench_flat, "flat", 0.0, RAY_KERNEL_AUTO,
+     RENDER_NUMERIC_DOUBLE},
+    {"textured-simd", bench_textured, "textured", 0.0, RAY_KERNEL_AUTO,
+     RENDER_NUMERIC_DOUBLE},
+    {"flat-mt", bench_flat_mt, "flat", 0.0, RAY_KERNEL_AUTO,
+     RENDER_NUMERIC_DOUBLE},
+    {"textured-mt", bench_textured_mt, "textured", 0.0, RAY_KERNEL_AUTO,
+     RENDER_NUMERIC_DOUBLE},
+    {"flat-cm", bench_flat_cm, "flat", 0.0, RAY_KERNEL_SCALAR,
+     RENDER_NUMERIC_DOUBLE},
+    {"textured-cm", bench_textured_cm, "textured", 0.0, RAY_KERNEL_SCALAR,
+     RENDER_NUMERIC_DOUBLE},
+    {"textured-scanline", bench_textured_scanline, "textured", 0.001,
+     RAY_KERNEL_SCALAR, RENDER_NUMERIC_DOUBLE},
+    {"textured-mip", bench_textured_mip, NULL, 0.0, RAY_KERNEL_SCALAR,
+     RENDER_NUMERIC_DOUBLE},
+    {"textured-scanline-mip", bench_textured_scanline_mip, "textured-mip",
+     0.001, RAY_KERNEL_SCALAR, RENDER_NUMERIC_DOUBLE},
+    {"flat-skip", bench_flat_skip, "flat", 0.0, RAY_KERNEL_SCALAR,
+     RENDER_NUMERIC_DOUBLE},
+    {"textured-skip", bench_textured_skip, "textured", 0.0,
+     RAY_KERNEL_SCALAR, RENDER_NUMERIC_DOUBLE},
+    {"textured-stream", bench_textured_stream, "textured", 0.0,
+     RAY_KERNEL_SCALAR, RENDER_NUMERIC_DOUBLE},
+    {"flat-coalesce", bench_flat_coalesce, "flat", 0.0, RAY_KERNEL_AUTO,
+     RENDER_NUMERIC_DOUBLE},
+    {"textured-coalesce", bench_textured_coalesce, "textured", 0.0,
+     RAY_KERNEL_AUTO, RENDER_NUMERIC_DOUBLE},
+    {"flat-float", bench_flat, "flat", 0.01, RAY_KERNEL_SCALAR,
+     RENDER_NUMERIC_FLOAT},
+    {"flat-fixed", bench_flat, "flat", 0.01, RAY_KERNEL_SCALAR,
+     RENDER_NUMERIC_FIXED},
+    {"textured-float", bench_textured, "textured", 0.05, RAY_KERNEL_SCALAR,
+     RENDER_NUMERIC_FLOAT},
+    {"textured-fixed", bench_textured, "textured", 0.05, RAY_KERNEL_SCALAR,
+     RENDER_NUMERIC_FIXED},
+    {"textured-scan-fixed", bench_textured_scanline, "textured-scanline",
+     0.05, RAY_KERNEL_SCALAR, RENDER_NUMERIC_FIXED},
+    {"textured-palette", bench_textured_palette, "textured", 1.0,
+     RAY_KERNEL_SCALAR, RENDER_NUMERIC_DOUBLE},
+    {"textured-indexed", bench_textured_indexed, "textured-palette", 0.0,
+     RAY_KERNEL_SCALAR, RENDER_NUMERIC_DOUBLE},
+    {"textured-palette-fixed", bench_textured_palette, "textured-fixed",
+     1.0, RAY_KERNEL_SCALAR, RENDER_NUMERIC_FIXED},
+    {"textured-indexed-fixed", bench_textured_indexed,
+     "textured-palette-fixed", 0.0, RAY_KERNEL_SCALAR,
+     RENDER_NUMERIC_FIXED},
+    {"flat-lit", bench_flat_lit, NULL, 0.0, RAY_KERNEL_SCALAR,
+     RENDER_NUMERIC_DOUBLE},
+    {"textured-lit", bench_textured_lit, NULL, 0.0, RAY_KERNEL_SCALAR,
+     RENDER_NUMERIC_DOUBLE},
+    {"textured-scanline-lit", bench_textured_scanline_lit, NULL, 0.0,
+     RAY_KERNEL_SCALAR, RENDER_NUMERIC_DOUBLE},
+    {"textured-indexed-lit", bench_textured_indexed_lit, NULL, 0.0,
+     RAY_KERNEL_SCALAR, RENDER_NUMERIC_DOUBLE},
+    {"textured-mt-lit", bench_textured_mt_lit, NULL, 0.0, RAY_KERNEL_AUTO,
+     RENDER_NUMERIC_DOUBLE},
+    {"textured-sprites", bench_textured_sprites, NULL, 0.0, RAY_KERNEL_AUTO,
+     RENDER_NUMERIC_DOUBLE},
+};
+
+static void bench_render(const BenchVariant *variant, const Framebuffer *fb,
+                         const Camera *cam, const BenchContext *ctx)
+{
+  ray_kernel_select(variant->kernel == RAY_KERNEL_AUTO ? ctx->kernel
+                                                       : variant->kernel);
+  render_numeric_select(variant->numeric);
+  variant->render(fb, cam, ctx);
+}
+
+static const BenchVariant *find_variant(const char *name)
+{
+  const int count = (int)(sizeof(g_variants) / sizeof(g_variants[0]));
+  for (int i = 0; i < count; ++i)
+  {
+    if (strcmp(g_variants[i].name, name) == 0)
+      return &g_variants[i];
+  }
+  return NULL;
+}
+
+/* Fraction of pixels that differ from the reference variant over
+   BENCH_CHECK_FRAMES cameras spread around the path, or a negative value
+   if there is nothing to compare. The cameras sit between the path's
+   axis-aligned poses, whose floor rows can fall exactly on texel edges,
+   and do not depend on -f. */
+static double diff_against_reference(const BenchVariant *variant,
+                                     const Framebuffer *fb,
+                                     const BenchContext *ctx)
+{
+  const BenchVariant *reference =
+      variant->reference ? find_variant(variant->reference) : NULL;
+  if (!reference)
+    return -1.0;
+
+  size_t count = (size_t)fb->width * fb->height;
+  Framebuffer ref = *fb;
+  ref.pixels = malloc(sizeof(uint32_t) * count);
+  if (!ref.pixels)
+    return -1.0;
+
+  size_t differing = 0;
+  for (int i = 0; i < BENCH_CHECK_FRAMES; ++i)
+  {
+    Camera cam;
+    bench_camera(2 * i + 1, 2 * BENCH_CHECK_FRAMES, &cam);
+    bench_render(reference, &ref, &cam, ctx);
+    bench_render(variant, fb, &cam, ctx);
+    for (size_t p = 0; p < count; ++p)
+    {
+      differing += fb->pixels[p] != ref.pixels[p];
+    }
+  }
+  free(ref.pixels);
+  return (double)differing / ((double)count * BENCH_CHECK_FRAMES);
+}
+
+/* Average cells (or skipped blocks) each ray steps through over the first
+   few path frames. */
+static double cells_per_ray(const Map *map, BenchSize size, int frames)
+{
+  double visited = 0.0;
+  for (int i = 0; i < BENCH_CHECK_FRAMES; ++i)
+  {
+    Camera cam;
+    bench_camera(i * frames / BENCH_CHECK_FRAMES, frames, &cam);
+    for (int x = 0; x < size.width; ++x)
+    {
+      RayHit hit;
+      visited += cast_ray_counted(map, &cam, x, size.width, &hit);
+    }
+  }
+  return visited / ((double)size.width * BENCH_CHECK_FRAMES);
+}
+
+/* Rays traced per column with span coalescing over the same frames. */
+static double rays_per_column(const Map *map, BenchSize size, int frames)
+{
+  RayHit hits[RENDER_SPAN_COLUMNS];
+  double traced = 0.0;
+  for (int i = 0; i < BENCH_CHECK_FRAMES; ++i)
+  {
+    Camera cam;
+    bench_camera(i * frames / BENCH_CHECK_FRAMES, frames, &cam);
+    for (int x = 0; x < size.width; x += RENDER_SPAN_COLUMNS)
+    {
+      int count = size.width - x < RENDER_SPAN_COLUMNS ? size.width - x
+                                                        : RENDER_SPAN_COLUMNS;
+      traced += cast_rays_coherent(map, &cam, x, 1, count, size.width,
+                                   hits);
+    }
+  }
+  return traced / ((double)size.width * BENCH_CHECK_FRAMES);
+}
+
+static bool run_variant(const BenchVariant *variant, BenchSize size,
+                        int frames, BenchContext *ctx)
+{
+  Framebuffer fb = {NULL, size.width, size.height, size.width, false};
+  fb.pixels = malloc(sizeof(uint32_t) * (size_t)size.width * size.height);
+  ctx->columns = (Framebuffer){NULL, size.width, size.height, size.height,
+                               true};
+  ctx->columns.pixels =
+      malloc(sizeof(uint32_t) * (size_t)size.width * size.height);
+  double *times = malloc(sizeof(double) * (size_t)frames);
+  if (!fb.pixels || !ctx->columns.pixels || !times)
+  {
+    fprintf(stderr, "Out of memory for %dx%d\n", size.width, size.height);
+    free(fb.pixels);
+    free(ctx->columns.pixels);
+    free(times);
+    return false;
+  }
+
+  double diff = diff_against_reference(variant, &fb, ctx);
+
+  Camera cam;
+  for (int i = 0; i < 3; ++i)
+  {
+    bench_camera(i, frames, &cam);
+    bench_render(variant, &fb, &cam, ctx);
+  }
+
+  TexelStats texels;
+  render_texel_stats(&texels);
+  ProfileSummary profile;
+  profile_summary(&profile);
+  ResolutionGovernor governor;
+  governor_init(&governor, size.width, size.height, ctx->budget_ms);
+  int resizes = 0;
+  BenchSprites *sprites = ctx->sprites;
+  if (sprites)
+  {
+    sprites->frames = 0;
+    sprites->ms = 0.0;
+    sprites->candidates = 0;
+    sprites->visible = 0;
+  }
+
+  double total = 0.0;
+  for (int i = 0; i < frames; ++i)
+  {
+    bench_camera(i, frames, &cam);
+    ray_kernel_select(variant->kernel == RAY_KERNEL_AUTO ? ctx->kernel
+                                                         : variant->kernel);
+    render_numeric_select(variant->numeric);
+    fb.width = ctx->columns.width = governor.width;
+    fb.height = ctx->columns.height = ctx->columns.pitch = governor.height;
+    double start = now_ms();
+    variant->render(&fb, &cam, ctx);
+    times[i] = now_ms() - start;
+    total += times[i];
+    if (ctx->budget_ms > 0.0 && governor_update(&governor, times[i]))
+      ++resizes;
+  }
+
+  qsort(times, (size_t)frames, sizeof(double), compare_double);
+  int p99 = (int)ceil(frames * 0.99) - 1;
+  printf("%-22s %5dx%-5d %8.3f %8.3f %8.3f %9.1f", variant->name,
+         size.width, size.height, times[0], times[frames / 2], times[p99],
+         frames / (total / 1000.0));
+  bool counted = render_texel_stats(&texels);
+  if (diff >= 0.0)
+    printf(" %7.3f%%", diff * 100.0);
+  else if (counted)
+    printf(" %8s", "");
+  if (diff > variant->max_diff)
+    ++ctx->over_bound;
+  if (counted)
+    printf(" %10.0f %7.2f%%", (double)texels.misses / frames,
+           texels.fetches ? 100.0 * texels.misses / texels.fetches : 0.0);
+  if (ctx->budget_ms > 0.0)
+    printf("  -> %dx%d after %d resize(s)", governor.width, governor.height,
+           resizes);
+  printf("\n");
+  if (profile_summary(&profile) && profile.frames > 0)
+  {
+    char line[256];
+    profile_format(&profile, line, sizeof(line));
+    printf("  %s\n", line);
+  }
+  if (sprites && sprites->frames > 0)
+  {
+    double visible = (double)sprites->visible / sprites->frames;
+    printf("  %d sprites: %.0f from the grid, %.0f visible per frame, "
+           "%.3f ms sprite pass, %.0f ns per visible sprite\n",
+           sprites->count, (double)sprites->candidates / sprites->frames,
+           visible, sprites->ms / sprites->frames,
+           visible > 0.0 ? sprites->ms * 1.0e6 / sprites->visible : 0.0);
+  }
+
+  free(fb.pixels);
+  free(ctx->columns.pixels);
+  ctx->columns.pixels = NULL;
+  free(times);
+  return true;
+}
+
+/* Frames per second over BENCH_BATCH_ROUNDS rounds of `count` cameras
+   spread along the bench path, drawn at `size` once per round with one
+   render_batch_textured() call and once with a render_frame_textured()
+   call per camera, both across the pool. A batch frame that differs from
+   its single-call frame counts as over bound. */
+static bool run_batch(int count, BenchSize size, BenchContext *ctx)
+{
+  const size_t pixels = (size_t)size.width * size.height;
+  CameraBatch cams;
+  if (!camera_batch_init(&cams, count))
+    return false;
+  Framebuffer *targets = calloc((size_t)count, sizeof(Framebuffer));
+  uint32_t *batchPixels = malloc(sizeof(uint32_t) * pixels * count);
+  uint32_t *singlePixels = malloc(sizeof(uint32_t) * pixels * count);
+  if (!targets || !batchPixels || !singlePixels)
+  {
+    fprintf(stderr, "Out of memory for %d frames of %dx%d\n", count,
+            size.width, size.height);
+    camera_batch_release(&cams);
+    free(targets);
+    free(batchPixels);
+    free(singlePixels);
+    return false;
+  }
+  for (int i = 0; i < count; ++i)
+  {
+    Camera cam;
+    bench_camera(i, count, &cam);
+    camera_batch_set(&cams, i, &cam);
+    targets[i] = (Framebuffer){batchPixels + pixels * i, size.width,
+                               size.height, size.width, false};
+  }
+  ray_kernel_select(ctx->kernel);
+  render_numeric_select(RENDER_NUMERIC_DOUBLE);
+
+  double batchMs = 0.0;
+  double singleMs = 0.0;
+  for (int round = 0; round < BENCH_BATCH_ROUNDS; ++round)
+  {
+    double start = now_ms();
+    render_batch_textured(targets, &cams, ctx->textures, ctx->texture_count,
+                          NULL, ctx->pool);
+    batchMs += now_ms() - start;
+
+    start = now_ms();
+    for (int i = 0; i < count; ++i)
+    {
+      Camera cam;
+      camera_batch_get(&cams, i, &cam);
+      Framebuffer fb = targets[i];
+      fb.pixels = singlePixels + pixels * i;
+      render_frame_textured(&fb, &cam, ctx->textures, ctx->texture_count,
+                            NULL, ctx->pool);
+    }
+    singleMs += now_ms() - start;
+  }
+
+  size_t differing = 0;
+  for (size_t p = 0; p < pixels * count; ++p)
+    differing += batchPixels[p] != singlePixels[p];
+  if (differing > 0)
+    ++ctx->over_bound;
+  double frames = (double)count * BENCH_BATCH_ROUNDS;
+  printf("batch of %d cameras at %dx%d: %.0f frames/s batched, %.0f "
+         "frames/s one call each, %zu differing pixels\n",
+         count, size.width, size.height, frames * 1000.0 / batchMs,
+         frames * 1000.0 / singleMs, differing);
+
+  camera_batch_release(&cams);
+  free(targets);
+  free(batchPixels);
+  free(singlePixels);
+  return true;
+}
+
+/* Agent-steps per second over BENCH_AGENT_TICKS ticks of `count` agents
+   started along the bench path with random actions at 60 ticks a second,
+   stepped by agents_step() and by agents_step_scalar() from the same
+   start. Any difference between the two counts as over bound. */
+static bool run_agents(int count, BenchContext *ctx)
+{
+  const size_t actionCount = (size_t)count * BENCH_AGENT_TICKS;
+  CameraBatch simd;
+  CameraBatch scalar;
+  uint8_t *actions = malloc(actionCount);
+  bool ok = camera_batch_init(&simd, count);
+  if (ok && !camera_batch_init(&scalar, count))
+  {
+    camera_batch_release(&simd);
+    ok = false;
+  }
+  if (!ok || !actions)
+  {
+    fprintf(stderr, "Out of memory for %d agents\n", count);
+    if (ok)
+    {
+      camera_batch_release(&simd);
+      camera_batch_release(&scalar);
+    }
+    free(actions);
+    return false;
+  }
+  for (int i = 0; i < count; ++i)
+  {
+    Camera cam;
+    bench_camera(i, count, &cam);
+    camera_batch_set(&simd, i, &cam);
+    camera_batch_set(&scalar, i, &cam);
+  }
+  uint32_t state = 2463534242u;
+  for (size_t i = 0; i < actionCount; ++i)
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    actions[i] = (uint8_t)(state >> 24) & 0x0F;
+  }
+
+  const Map *map = render_map();
+  const double move = 2.5 / 60.0;
+  const double turn = 1.5 / 60.0;
+  double start = now_ms();
+  for (int t = 0; t < BENCH_AGENT_TICKS; ++t)
+    agents_step(&simd, actions + (size_t)t * count, move, turn, map);
+  double simdMs = now_ms() - start;
+  start = now_ms();
+  for (int t = 0; t < BENCH_AGENT_TICKS; ++t)
+    agents_step_scalar(&scalar, actions + (size_t)t * count, move, turn,
+                       map);
+  double scalarMs = now_ms() - start;
+
+  int differing = 0;
+  for (int i = 0; i < count; ++i)
+  {
+    Camera a;
+    Camera b;
+    camera_batch_get(&simd, i, &a);
+    camera_batch_get(&scalar, i, &b);
+    differing += memcmp(&a, &b, sizeof(a)) != 0;
+  }
+  if (differing > 0)
+    ++ctx->over_bound;
+  double steps = (double)actionCount;
+  printf("%d agents x %d ticks: %.1fM agent-steps/s, %.1fM scalar, %d "
+         "differing agents\n",
+         count, BENCH_AGENT_TICKS, steps / simdMs / 1000.0,
+         steps / scalarMs / 1000.0, differing);
+
+  camera_batch_release(&simd);
+  camera_batch_release(&scalar);
+  free(actions);
+  return true;
+}
+
+/* Turns in place from the start of the bench path for `frames` frames at
+   `size`, drawing each textured frame with render_frame_history() and
+   with render_frame_map() across the pool. Reports rays traced per column
+   and the time of both; any differing frame counts as over bound. */
+static bool run_turn(BenchSize size, int frames, BenchContext *ctx)
+{
+  const size_t pixels = (size_t)size.width * size.height;
+  Framebuffer reused = {NULL, size.width, size.height, size.width, false};
+  Framebuffer cast = reused;
+  reused.pixels = malloc(sizeof(uint32_t) * pixels);
+  cast.pixels = malloc(sizeof(uint32_t) * pixels);
+  RenderHistory *history = render_history_create();
+  if (!reused.pixels || !cast.pixels || !history)
+  {
+    fprintf(stderr, "Out of memory for the reprojection turn\n");
+    free(reused.pixels);
+    free(cast.pixels);
+    render_history_destroy(history);
+    return false;
+  }
+
+  ray_kernel_select(ctx->kernel);
+  render_numeric_select(RENDER_NUMERIC_DOUBLE);
+  Camera start;
+  bench_camera(0, frames, &start);
+  const Map *map = render_map();
+  double reusedMs = 0.0;
+  double castMs = 0.0;
+  long traced = 0;
+  int differing = 0;
+  for (int i = 0; i <= frames; ++i)
+  {
+    double c = cos(i * BENCH_TURN_STEP);
+    double sn = sin(i * BENCH_TURN_STEP);
+    Camera cam = start;
+    cam.dirX = start.dirX * c - start.dirY * sn;
+    cam.dirY = start.dirX * sn + start.dirY * c;
+    cam.planeX = start.planeX * c - start.planeY * sn;
+    cam.planeY = start.planeX * sn + start.planeY * c;
+
+    double t = now_ms();
+    int rays = render_frame_history(map, &reused, &cam, ctx->textures,
+                                    ctx->texture_count, NULL, ctx->pool,
+                                    history);
+    double reusedFrame = now_ms() - t;
+    t = now_ms();
+    render_frame_map(map, &cast, &cam, ctx->textures, ctx->texture_count,
+                     NULL, ctx->pool);
+    double castFrame = now_ms() - t;
+    differing += memcmp(reused.pixels, cast.pixels,
+                        sizeof(uint32_t) * pixels) != 0;
+    /* The first frame has nothing to reuse. */
+    if (i > 0)
+    {
+      traced += rays;
+      reusedMs += reusedFrame;
+      castMs += castFrame;
+    }
+  }
+  if (differing > 0)
+    ++ctx->over_bound;
+  printf("turning in place at %dx%d: %.3f rays traced per column, %.3f ms "
+         "per frame reprojected, %.3f ms cast, %d differing frames\n",
+         size.width, size.height, (double)traced / frames / size.width,
+         reusedMs / frames, castMs / frames, differing);
+
+  render_history_destroy(history);
+  free(reused.pixels);
+  free(cast.pixels);
+  return true;
+}
+
+/* Draws the bench path at `size` with each -lit variant and its unlit
+   counterpart in turn, frame by frame, so both see the same load, and
+   reports their median frame times and the median of each frame's lit
+   time over its unlit one, which a noisy moment slows on both sides.
+   Fails when that median is more than BENCH_LIGHT_BUDGET percent over. */
+static bool run_lighting(BenchSize size, int frames, BenchContext *ctx)
+{
+  static const char *const pairs[][2] = {
+      {"flat", "flat-lit"},
+      {"textured", "textured-lit"},
+      {"textured-scanline", "textured-scanline-lit"},
+      {"textured-indexed", "textured-indexed-lit"},
+  };
+  if (!ctx->lighting)
+  {
+    fprintf(stderr, "The bench map could not be lit\n");
+    return false;
+  }
+  Framebuffer fb = {NULL, size.width, size.height, size.width, false};
+  fb.pixels = malloc(sizeof(uint32_t) * (size_t)size.width * size.height);
+  double *times = malloc(sizeof(double) * 3 * (size_t)frames);
+  if (!fb.pixels || !times)
+  {
+    fprintf(stderr, "Out of memory for the lighting run\n");
+    free(fb.pixels);
+    free(times);
+    return false;
+  }
+
+  bool within = true;
+  const int pairCount = (int)(sizeof(pairs) / sizeof(pairs[0]));
+  for (int p = 0; p < pairCount; ++p)
+  {
+    const BenchVariant *variants[2] = {find_variant(pairs[p][0]),
+                                       find_variant(pairs[p][1])};
+    Camera cam;
+    for (int i = 0; i < 3; ++i)
+    {
+      bench_camera(i, frames, &cam);
+      bench_render(variants[0], &fb, &cam, ctx);
+      bench_render(variants[1], &fb, &cam, ctx);
+    }
+    for (int i = 0; i < frames; ++i)
+    {
+      bench_camera(i, frames, &cam);
+      /* Alternate which goes first so neither always finds the caches
+         warmed by the other. */
+      for (int k = 0; k < 2; ++k)
+      {
+        const int which = (i + k) % 2;
+        double start = now_ms();
+        bench_render(variants[which], &fb, &cam, ctx);
+        times[which * frames + i] = now_ms() - start;
+      }
+    }
+    double *ratios = times + 2 * frames;
+    for (int i = 0; i < frames; ++i)
+      ratios[i] = times[frames + i] / times[i];
+    for (int k = 0; k < 3; ++k)
+      qsort(times + k * frames, (size_t)frames, sizeof(double),
+            compare_double);
+    const double unlit = times[frames / 2];
+    const double lit = times[frames + frames / 2];
+    const double cost = 100.0 * (ratios[frames / 2] - 1.0);
+    printf("lighting at %dx%d: %s %.3f ms median against %.3f ms for %s "
+           "(%+.1f%% per frame)\n",
+           size.width, size.height, pairs[p][1], lit, unlit, pairs[p][0],
+           cost);
+    if (cost > BENCH_LIGHT_BUDGET)
+    {
+      fprintf(stderr, "%s costs %.1f%% over %s, above the %.0f%% budget\n",
+              pairs[p][1], cost, pairs[p][0], BENCH_LIGHT_BUDGET);
+      within = false;
+    }
+  }
+
+  free(fb.pixels);
+  free(times);
+  return within;
+}
+
+/* Camera of frame i of the interlace run: along the bench path, turning
+   in place from its start, or standing there. */
+static void interlace_camera(int segment, int i, int frames, Camera *cam)
+{
+  if (segment == 0)
+  {
+    bench_camera(i, frames, cam);
+    return;
+  }
+  Camera start;
+  bench_camera(0, frames, &start);
+  double angle = segment == 1 ? i * BENCH_TURN_STEP : 0.0;
+  double c = cos(angle);
+  double sn = sin(angle);
+  *cam = start;
+  cam->dirX = start.dirX * c - start.dirY * sn;
+  cam->dirY = start.dirX * sn + start.dirY * c;
+  cam->planeX = start.planeX * c - start.planeY * sn;
+  cam->planeY = start.planeX * sn + start.planeY * c;
+}
+
+/* Draws `frames` textured frames at `size` across the pool along the
+   bench path, as many turning in place and as many standing still, each
+   with interlace_frame() and with render_frame_map(). Reports the time of
+   both, the columns filled from their neighbours and the worst PSNR of
+   the interlaced frames against the full ones, worst and over the run.
+   Moving runs under the bounds for their width, or a still frame after
+   the first that differs at all, count as over bound. */
+static bool run_interlace(BenchSize size, int frames, BenchContext *ctx)
+{
+  const size_t pixels = (size_t)size.width * size.height;
+  Framebuffer interlaced = {NULL, size.width, size.height, size.width,
+                            false};
+  Framebuffer full = interlaced;
+  interlaced.pixels = malloc(sizeof(uint32_t) * pixels);
+  full.pixels = malloc(sizeof(uint32_t) * pixels);
+  Interlace *interlace = interlace_create();
+  if (!interlaced.pixels || !full.pixels || !interlace)
+  {
+    fprintf(stderr, "Out of memory for the interlaced frames\n");
+    free(interlaced.pixels);
+    free(full.pixels);
+    interlace_destroy(interlace);
+    return false;
+  }
+
+  ray_kernel_select(ctx->kernel);
+  render_numeric_select(RENDER_NUMERIC_DOUBLE);
+  const Map *map = render_map();
+  static const char *const names[] = {"along the path", "turning in place",
+                                      "standing still"};
+  const double width = fmin(size.width, size.height * 4.0 / 3.0);
+  const double rise =
+      BENCH_INTERLACE_SLOPE * log2(width / BENCH_INTERLACE_WIDTH);
+  for (int segment = 0; segment < 3; ++segment)
+  {
+    interlace_reset(interlace);
+    double interlacedMs = 0.0;
+    double fullMs = 0.0;
+    long spatial = 0;
+    double worst = INFINITY;
+    double settled = INFINITY;
+    double error = 0.0;
+    for (int i = 0; i < frames; ++i)
+    {
+      Camera cam;
+      interlace_camera(segment, i, frames, &cam);
+      double t = now_ms();
+      spatial += interlace_frame(interlace, map, &interlaced, &cam,
+                                 ctx->textures, ctx->texture_count, NULL,
+                                 ctx->pool);
+      interlacedMs += now_ms() - t;
+      t = now_ms();
+      render_frame_map(map, &full, &cam, ctx->textures, ctx->texture_count,
+                       NULL, ctx->pool);
+      fullMs += now_ms() - t;
+      double psnr = framebuffer_psnr(&full, &interlaced);
+      worst = psnr < worst ? psnr : worst;
+      error += isinf(psnr) ? 0.0 : pow(10.0, -psnr / 10.0);
+      if (i > 0)
+        settled = psnr < settled ? psnr : settled;
+    }
+    const double mean = error > 0.0 ? -10.0 * log10(error / frames)
+                                    : INFINITY;
+    const bool bounded = width >= BENCH_INTERLACE_MIN_WIDTH;
+    if ((bounded && segment == 0 &&
+         (worst < BENCH_INTERLACE_PSNR + rise ||
+          mean < BENCH_INTERLACE_RUN_PSNR + rise)) ||
+        (bounded && segment == 1 &&
+         (worst < BENCH_INTERLACE_TURN_PSNR + rise ||
+          mean < BENCH_INTERLACE_TURN_RUN_PSNR + rise)) ||
+        (segment == 2 && !isinf(settled)))
+      ++ctx->over_bound;
+    printf("interlaced %s at %dx%d: %.3f ms per frame, %.3f ms full, "
+           "%.1f%% of columns from neighbours, PSNR %.1f dB worst, "
+           "%.1f dB overall\n",
+           names[segment], size.width, size.height, interlacedMs / frames,
+           fullMs / frames, 100.0 * spatial / ((double)frames * size.width),
+           worst, mean);
+  }
+
+  interlace_destroy(interlace);
+  free(interlaced.pixels);
+  free(full.pixels);
+  return true;
+}
+
+/* Makes up to `count` wall cells nearest the spawn of a copy of the drawn
+   map into doors and draws `frames` textured frames along the bench path
+   at `size` across the pool, toggling one door in BENCH_DOOR_TOGGLE before
+   each and sliding every moving one. Reports the time of the door updates
+   and the median, p99 and worst frame. The incrementally updated
+   occupancy and skip levels must match ones rebuilt from scratch at the
+   end, or the run counts as over bound. */
+static bool run_doors(int count, BenchSize size, int frames,
+                      BenchContext *ctx)
+{
+  const Map *drawn = render_map();
+  const size_t cells = (size_t)drawn->width * drawn->height;
+  const size_t words = (size_t)drawn->row_words * drawn->height;
+  Framebuffer fb = {NULL, size.width, size.height, size.width, false};
+  fb.pixels = malloc(sizeof(uint32_t) * (size_t)size.width * size.height);
+  uint8_t *tiles = malloc(cells);
+  uint32_t *occupancy = malloc(sizeof(uint32_t) * words);
+  uint32_t *rebuilt = malloc(sizeof(uint32_t) * words);
+  double *times = malloc(sizeof(double) * (size_t)frames);
+  Map map;
+  memset(&map, 0, sizeof(map));
+  bool ok = fb.pixels && tiles && occupancy && rebuilt && times;
+  if (ok)
+  {
+    memcpy(tiles, drawn->tiles, cells);
+    map_wrap(&map, tiles, occupancy, drawn->width, drawn->height);
+    map.spawn_x = drawn->spawn_x;
+    map.spawn_y = drawn->spawn_y;
+    ok = map_build_skip(&map);
+  }
+  const int sx = map.spawn_x;
+  const int sy = map.spawn_y;
+  const int reach = drawn->width > drawn->height ? drawn->width
+                                                 : drawn->height;
+  for (int r = 1; ok && map.door_count < count && r < reach; ++r)
+  {
+    for (int i = -r; ok && i <= r && map.door_count < count; ++i)
+    {
+      const int ring[4][2] = {{sx + i, sy - r},
+                              {sx + i, sy + r},
+                              {sx - r, sy + i},
+                              {sx + r, sy + i}};
+      for (int k = 0; k < 4 && map.door_count < count; ++k)
+      {
+        if (map_tile(&map, ring[k][0], ring[k][1]) != 0 &&
+            !map_door(&map, ring[k][0], ring[k][1]))
+          ok = map_add_door(&map, ring[k][0], ring[k][1]);
+      }
+    }
+  }
+  if (!ok)
+  {
+    fprintf(stderr, "Unable to set up %d doors\n", count);
+    map_release(&map);
+    free(fb.pixels);
+    free(tiles);
+    free(occupancy);
+    free(rebuilt);
+    free(times);
+    return false;
+  }
+
+  ray_kernel_select(ctx->kernel);
+  render_numeric_select(RENDER_NUMERIC_DOUBLE);
+  render_set_map(&map);
+  double updateMs = 0.0;
+  long toggled = 0;
+  for (int f = 0; f < frames; ++f)
+  {
+    Camera cam;
+    bench_camera(f, frames, &cam);
+    double start = now_ms();
+    for (int i = f % BENCH_DOOR_TOGGLE; i < map.door_count;
+         i += BENCH_DOOR_TOGGLE)
+    {
+      const MapDoor *door = &map.doors[i];
+      map_move_door(&map, door->x, door->y, door->target > 0.5 ? 0.0 : 1.0);
+      ++toggled;
+    }
+    map_update_doors(&map, BENCH_DOOR_STEP);
+    updateMs += now_ms() - start;
+    render_frame_textured(&fb, &cam, ctx->textures, ctx->texture_count,
+                          NULL, ctx->pool);
+    times[f] = now_ms() - start;
+  }
+  render_set_map(NULL);
+
+  /* The occupancy and skip levels a fresh map with these doors gets. */
+  Map fresh;
+  map_wrap(&fresh, tiles, rebuilt, map.width, map.height);
+  for (int i = 0; i < map.door_count; ++i)
+  {
+    const MapDoor *door = &map.doors[i];
+    if (door->open >= 1.0)
+      rebuilt[door->y * fresh.row_words + door->x / 32] &=
+          ~(1u << (door->x % 32));
+  }
+  size_t mismatched = 0;
+  for (size_t w = 0; w < words; ++w)
+    mismatched += occupancy[w] != rebuilt[w];
+  if (map_build_skip(&fresh))
+  {
+    for (int level = 0; level < fresh.skip_levels; ++level)
+    {
+      int shift = MAP_SKIP_SHIFT * (level + 1);
+      size_t levelWords = (size_t)fresh.skip_row_words[level] *
+                          ((map.height + (1 << shift) - 1) >> shift);
+      for (size_t w = 0; w < levelWords; ++w)
+        mismatched += map.skip[level][w] != fresh.skip[level][w];
+    }
+  }
+  else
+  {
+    mismatched = words;
+  }
+  if (mismatched > 0)
+    ++ctx->over_bound;
+
+  qsort(times, (size_t)frames, sizeof(double), compare_double);
+  printf("%d doors, %.0f toggled per frame at %dx%d: %.3f ms updating, "
+         "%.3f ms med, %.3f ms p99, %.3f ms max per frame, %zu "
+         "mismatched words\n",
+         map.door_count, (double)toggled / frames, size.width, size.height,
+         updateMs / frames, times[frames / 2], times[frames * 99 / 100],
+         times[frames - 1], mismatched);
+
+  map_release(&fresh);
+  map_release(&map);
+  free(fb.pixels);
+  free(tiles);
+  free(occupancy);
+  free(rebuilt);
+  free(times);
+  return true;
+}
+
+/* Converts `frames` textured frames of the bench path at `size` to I420
+   with yuv_from_argb() across the pool and with yuv_from_argb_scalar(),
+   and reports the time of each; any differing byte counts as over
+   bound. */
+static bool run_yuv(BenchSize size, int frames, BenchContext *ctx)
+{
+  const size_t bytes = yuv_frame_size(size.width, size.height);
+  Framebuffer fb = {NULL, size.width, size.height, size.width, false};
+  fb.pixels = malloc(sizeof(uint32_t) * (size_t)size.width * size.height);
+  uint8_t *fast = malloc(bytes);
+  uint8_t *scalar = malloc(bytes);
+  if (!fb.pixels || !fast || !scalar)
+  {
+    fprintf(stderr, "Out of memory for I420 frames of %dx%d\n", size.width,
+            size.height);
+    free(fb.pixels);
+    free(fast);
+    free(scalar);
+    return false;
+  }
+  YuvFrame fastFrame;
+  YuvFrame scalarFrame;
+  yuv_frame_wrap(&fastFrame, fast, size.width, size.height);
+  yuv_frame_wrap(&scalarFrame, scalar, size.width, size.height);
+
+  ray_kernel_select(ctx->kernel);
+  render_numeric_select(RENDER_NUMERIC_DOUBLE);
+  double fastMs = 0.0;
+  double scalarMs = 0.0;
+  size_t differing = 0;
+  for (int f = 0; f < frames; ++f)
+  {
+    Camera cam;
+    bench_camera(f, frames, &cam);
+    render_frame_textured(&fb, &cam, ctx->textures, ctx->texture_count,
+                          NULL, ctx->pool);
+    double start = now_ms();
+    yuv_from_argb(&fastFrame, &fb, ctx->pool);
+    fastMs += now_ms() - start;
+    start = now_ms();
+    yuv_from_argb_scalar(&scalarFrame, &fb);
+    scalarMs += now_ms() - start;
+    for (size_t i = 0; i < bytes; ++i)
+      differing += fast[i] != scalar[i];
+  }
+  if (differing > 0)
+    ++ctx->over_bound;
+  printf("ARGB to I420 at %dx%d: %.3f ms per frame, %.3f ms scalar, %zu "
+         "differing bytes\n",
+         size.width, size.height, fastMs / frames, scalarMs / frames,
+         differing);
+
+  free(fb.pixels);
+  free(fast);
+  free(scalar);
+  return true;
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [-f frames] [-t threads] [-k auto|scalar|sse2|avx2] "
+          "[-s WIDTHxHEIGHT]... [-T texture-size] [-m map.rcm] "
+          "[-v variant]... [-P trace.json] [-B budget-ms] "
+          "[-A cameras[:WIDTHxHEIGHT]] [-G agents] [-R] [-D doors] [-Y] "
+          "[-I] [-L]\n",
+          argv0);
+}
+
+int main(int argc, char *argv[])
+{
+  BenchSize sizes[BENCH_MAX_SIZES];
+  int size_count = 0;
+  const char *only[BENCH_MAX_VARIANTS];
+  int only_count = 0;
+  int frames = 200;
+  int threads = 0;
+  int texture_size = BENCH_TEX_SIZE;
+  const char *map_path = NULL;
+  const char *trace_path = NULL;
+  double budget_ms = 0.0;
+  int batch_count = 0;
+  int agent_count = 0;
+  int door_count = 0;
+  bool turn = false;
+  bool interlace = false;
+  bool light_cost = false;
+  bool yuv = false;
+  BenchSize batch_size = {84, 84};
+  RayKernel kernel = RAY_KERNEL_AUTO;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+    {
+      frames = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+    {
+      threads = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+    {
+      const char *name = argv[++i];
+      bool known = false;
+      for (int k = RAY_KERNEL_AUTO; k <= RAY_KERNEL_AVX2; ++k)
+      {
+        if (strcmp(name, ray_kernel_name((RayKernel)k)) == 0)
+        {
+          kernel = (RayKernel)k;
+          known = true;
+        }
+      }
+      if (!known || !ray_kernel_select(kernel))
+      {
+        fprintf(stderr, "Ray kernel %s is not available\n", name);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc &&
+             size_count < BENCH_MAX_SIZES)
+    {
+      BenchSize s;
+      if (sscanf(argv[++i], "%dx%d", &s.width, &s.height) != 2 ||
+          s.width <= 0 || s.height <= 0)
+      {
+        usage(argv[0]);
+        return 1;
+      }
+      sizes[size_count++] = s;
+    }
+    else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+    {
+      map_path = argv[++i];
+    }
+    else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc)
+    {
+      texture_size = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc &&
+             only_count < BENCH_MAX_VARIANTS)
+    {
+      only[only_count++] = argv[++i];
+    }
+    else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc)
+    {
+      trace_path = argv[++i];
+    }
+    else if (strcmp(argv[i], "-B") == 0 && i + 1 < argc)
+    {
+      budget_ms = atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-G") == 0 && i + 1 < argc)
+    {
+      agent_count = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-R") == 0)
+    {
+      turn = true;
+    }
+    else if (strcmp(argv[i], "-L") == 0)
+    {
+      light_cost = true;
+    }
+    else if (strcmp(argv[i], "-I") == 0)
+    {
+      interlace = true;
+    }
+    else if (strcmp(argv[i], "-Y") == 0)
+    {
+      yuv = true;
+    }
+    else if (strcmp(argv[i], "-D") == 0 && i + 1 < argc)
+    {
+      door_count = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-A") == 0 && i + 1 < argc)
+    {
+      int fields = sscanf(argv[++i], "%d:%dx%d", &batch_count,
+                          &batch_size.width, &batch_size.height);
+      if (fields != 1 && fields != 3)
+      {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (frames <= 0 || texture_size < 4 || batch_count < 0 || agent_count < 0 ||
+      door_count < 0 || batch_size.width <= 0 || batch_size.height <= 0)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  if (size_count == 0)
+  {
+    const BenchSize defaults[] = {{320, 240}, {800, 600}, {1920, 1080}};
+    size_count = (int)(sizeof(defaults) / sizeof(defaults[0]));
+    memcpy(sizes, defaults, sizeof(defaults));
+  }
+
+  Map map;
+  if (map_path)
+  {
+    double start = now_ms();
+    if (!map_load(&map, map_path))
+      return 1;
+    printf("%s: %dx%d map opened in %.3f ms\n", map_path, map.width,
+           map.height, now_ms() - start);
+    render_set_map(&map);
+  }
+
+  Texture textures[BENCH_NUM_TEXTURES] = {{0}};
+  Texture column_textures[BENCH_NUM_TEXTURES] = {{0}};
+  Texture indexed_textures[BENCH_NUM_TEXTURES] = {{0}};
+  Texture quantized_textures[BENCH_NUM_TEXTURES] = {{0}};
+  bool textures_ok = make_textures(textures, texture_size);
+  for (int i = 0; i < BENCH_NUM_TEXTURES && textures_ok; ++i)
+  {
+    column_textures[i] = textures[i];
+    column_textures[i].columns = NULL;
+    textures_ok = texture_build_columns(&column_textures[i]);
+  }
+  textures_ok = textures_ok &&
+                make_indexed(textures, indexed_textures, quantized_textures);
+  /* Lit texels for the -lit variants, after the copies above so those do
+     not share them. */
+  for (int i = 0; i < BENCH_NUM_TEXTURES && textures_ok; ++i)
+    textures_ok = light_build_texels(&textures[i]);
+  if (!textures_ok)
+  {
+    fprintf(stderr, "Out of memory while building textures\n");
+    for (int i = 0; i < BENCH_NUM_TEXTURES; ++i)
+    {
+      texture_release(&textures[i]);
+      free(column_textures[i].columns);
+      texture_release(&indexed_textures[i]);
+      texture_release(&quantized_textures[i]);
+    }
+    if (map_path)
+      map_release(&map);
+    return 1;
+  }
+  if (threads <= 0)
+  {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = online > 0 ? (int)online : 1;
+  }
+  /* Shares the drawn map's tiles; only the skip levels are its own. If
+     they cannot be built the -skip variants step cell by cell. */
+  Map skip_map = *render_map();
+  skip_map.skip_levels = 0;
+  map_build_skip(&skip_map);
+
+  /* The drawn map again with its own light; the -lit variants draw it
+     unlit if that cannot be baked. */
+  Map lit_map = *render_map();
+  lit_map.light = NULL;
+  int light_count = lit_map.width * lit_map.height / BENCH_LIGHT_CELLS + 1;
+  MapLight *lights = malloc(sizeof(MapLight) * (size_t)light_count);
+  Lighting lighting;
+  lighting_init(&lighting, BENCH_FOG_DISTANCE, BENCH_SIDE_DROP);
+  bool lit = false;
+  if (lights)
+  {
+    light_scatter(lights, light_count, &lit_map, 1);
+    lit = map_bake_light(&lit_map, BENCH_LIGHT_AMBIENT, lights, light_count);
+    free(lights);
+  }
+
+  /* Without sprites the textured-sprites variant is skipped. */
+  BenchSprites sprites = {NULL, BENCH_SPRITES, {0}, {0}, NULL, 0, 0.0, 0, 0};
+  int max_width = 0;
+  for (int s = 0; s < size_count; ++s)
+    max_width = sizes[s].width > max_width ? sizes[s].width : max_width;
+  sprites.sprites = malloc(sizeof(Sprite) * BENCH_SPRITES);
+  sprites.depth = malloc(sizeof(double) * (size_t)max_width);
+  bool sprites_ok = sprites.sprites && sprites.depth &&
+                    sprite_make_orb(&sprites.texture, texture_size,
+                                    0xFFE08020u);
+  if (sprites_ok)
+  {
+    sprite_scatter(sprites.sprites, BENCH_SPRITES, render_map(), 1, 1);
+    sprites_ok = sprite_grid_build(&sprites.grid, sprites.sprites,
+                                   BENCH_SPRITES, render_map()->width,
+                                   render_map()->height);
+  }
+
+  WorkerPool *pool = worker_pool_create(threads);
+  BenchContext ctx = {textures,
+                      column_textures,
+                      indexed_textures,
+                      quantized_textures,
+                      BENCH_NUM_TEXTURES,
+                      pool,
+                      kernel,
+                      {NULL, 0, 0, 0, false},
+                      &skip_map,
+                      &lit_map,
+                      lit ? &lighting : NULL,
+                      0,
+                      budget_ms,
+                      NULL,
+                      sprites_ok ? &sprites : NULL};
+  ctx.cache = texture_cache_create(BENCH_NUM_TEXTURES, SIZE_MAX, 0,
+                                   load_copy, textures);
+  for (int i = 0; i < BENCH_NUM_TEXTURES && ctx.cache; ++i)
+    texture_cache_request(ctx.cache, i);
+  if (ctx.cache)
+  {
+    texture_cache_flush(ctx.cache);
+    texture_cache_frame(ctx.cache);
+  }
+
+  ray_kernel_select(kernel);
+  printf("%d worker thread(s), %s ray kernel\n", worker_pool_size(pool),
+         ray_kernel_name(ray_kernel_current()));
+  printf("%dx%d map, cells per ray at %dx%d: %.2f, %.2f with empty-space "
+         "skipping\n",
+         skip_map.width, skip_map.height, sizes[0].width, sizes[0].height,
+         cells_per_ray(render_map(), sizes[0], frames),
+         cells_per_ray(&skip_map, sizes[0], frames));
+  printf("rays traced per column with span coalescing: %.3f\n",
+         rays_per_column(render_map(), sizes[0], frames));
+  TexelStats texels;
+  bool counted = render_texel_stats(&texels);
+  printf("%-22s %11s %8s %8s %8s %9s %8s", "variant", "size", "min ms",
+         "med ms", "p99 ms", "fps", "diff");
+  if (counted)
+    printf(" %10s %8s", "misses/f", "miss");
+  printf("\n");
+  int status = 0;
+  const int variant_count = (int)(sizeof(g_variants) / sizeof(g_variants[0]));
+  for (int s = 0; s < size_count && status == 0; ++s)
+  {
+    for (int v = 0; v < variant_count; ++v)
+    {
+      bool selected = only_count == 0;
+      for (int i = 0; i < only_count; ++i)
+      {
+        if (strcmp(only[i], g_variants[v].name) == 0)
+          selected = true;
+      }
+      /* 10k sprites bury the built-in map, so this one only runs when
+         named; make bench-sprites gives it a map its size. */
+      if (g_variants[v].render == bench_textured_sprites &&
+          (!ctx.sprites || only_count == 0))
+        selected = false;
+      /* Backends the build left out (make NUMERIC=...) have nothing to
+         measure. */
+      if (!render_numeric_available(g_variants[v].numeric))
+        selected = false;
+      if (selected && !run_variant(&g_variants[v], sizes[s], frames, &ctx))
+      {
+        status = 1;
+        break;
+      }
+    }
+  }
+
+  if (status == 0 && batch_count > 0 &&
+      !run_batch(batch_count, batch_size, &ctx))
+    status = 1;
+  if (status == 0 && agent_count > 0 && !run_agents(agent_count, &ctx))
+    status = 1;
+  if (status == 0 && turn && !run_turn(sizes[0], frames, &ctx))
+    status = 1;
+  if (status == 0 && interlace && !run_interlace(sizes[0], frames, &ctx))
+    status = 1;
+  if (status == 0 && light_cost && !run_lighting(sizes[0], frames, &ctx))
+    status = 1;
+  if (status == 0 && yuv && !run_yuv(sizes[0], frames, &ctx))
+    status = 1;
+  if (status == 0 && door_count > 0 &&
+      !run_doors(door_count, sizes[0], frames, &ctx))
+    status = 1;
+
+  if (ctx.over_bound > 0)
+  {
+    fprintf(stderr, "%d run(s) differ from their reference beyond the "
+                    "variant's bound\n",
+            ctx.over_bound);
+    status = 1;
+  }
+  if (trace_path && !profile_write_trace(trace_path))
+    status = 1;
+
+  texture_cache_destroy(ctx.cache);
+  worker_pool_destroy(pool);
+  sprite_grid_release(&sprites.grid);
+  texture_release(&sprites.texture);
+  free(sprites.sprites);
+  free(sprites.depth);
+  free(lit_map.light);
+  if (skip_map.skip_levels > 0)
+  {
+    skip_map.mapping = NULL;
+    map_release(&skip_map);
+  }
+  for (int i = 0; i < BENCH_NUM_TEXTURES; ++i)
+  {
+    texture_release(&textures[i]);
+    free(column_textures[i].columns);
+    texture_release(&indexed_textures[i]);
+    texture_release(&quantized_textures[i]);
+  }
+  if (map_path)
+  {
+    render_set_map(NULL);
+    map_release(&map);
+  }
+  return status;
+}
@@ -0,0 +1,185 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "agents.h"
+#include "raycast.h"
+#include "texpack.h"
+#include "video.h"
+#include "yuv.h"
+
+#define CAPTURE_TEXTURES 3
+
+/* Wall, floor and ceiling names looked up in a texture pack (-p). */
+static const char *const g_texture_names[CAPTURE_TEXTURES] = {
+    "brick", "wood", "eagle"};
+
+static double now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1.0e6;
+}
+
+/* The scripted walk: ahead for two seconds, curving left for one, then
+   turning right in place for one, so the camera sweeps the map and turns
+   away from walls it runs into. */
+static unsigned path_actions(int frame, int fps)
+{
+  int phase = frame % (4 * fps);
+  if (phase < 2 * fps)
+    return AGENT_FORWARD;
+  if (phase < 3 * fps)
+    return AGENT_FORWARD | AGENT_LEFT;
+  return AGENT_RIGHT;
+}
+
+/* Packs textures in the order render_frame_textured() takes them. */
+static bool pick_textures(const TexturePack *pack, const char *path,
+                          Texture *out)
+{
+  for (int i = 0; i < CAPTURE_TEXTURES; ++i)
+  {
+    int index = texpack_find(pack, g_texture_names[i]);
+    if (index < 0)
+    {
+      fprintf(stderr, "%s has no texture named %s\n", path,
+              g_texture_names[i]);
+      return false;
+    }
+    out[i] = pack->textures[index];
+  }
+  return true;
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [-o out.y4m|-] [-s WIDTHxHEIGHT] [-f frames] "
+          "[-r fps] [-t threads] [-m map.rcm] [-p pack.rctp] "
+          "[-b buffers] [--raw]\n",
+          argv0);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *out_path = "-";
+  const char *map_path = NULL;
+  const char *pack_path = NULL;
+  int width = 1920;
+  int height = 1080;
+  int frames = 600;
+  int fps = 60;
+  int threads = 0;
+  int buffers = 4;
+  bool raw = false;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      out_path = argv[++i];
+    else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+    {
+      if (sscanf(argv[++i], "%dx%d", &width, &height) != 2)
+        width = 0;
+    }
+    else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+      frames = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+      fps = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+      threads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+      map_path = argv[++i];
+    else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+      pack_path = argv[++i];
+    else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+      buffers = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--raw") == 0)
+      raw = true;
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (width <= 0 || height <= 0 || frames <= 0 || fps <= 0 || buffers < 2)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  RaycastContext *ctx = raycast_create(threads);
+  if (!ctx)
+    return 1;
+  TexturePack pack = {0};
+  Texture textures[CAPTURE_TEXTURES];
+  uint32_t *pixels = malloc(sizeof(uint32_t) * (size_t)width * height);
+  bool ok = pixels != NULL;
+  if (!ok)
+    fprintf(stderr, "Out of memory for a %dx%d frame\n", width, height);
+  if (ok && map_path)
+    ok = raycast_load_map(ctx, map_path);
+  if (ok && pack_path)
+  {
+    ok = texpack_load(&pack, pack_path) &&
+         pick_textures(&pack, pack_path, textures);
+    if (ok)
+      raycast_set_textures(ctx, textures, CAPTURE_TEXTURES);
+  }
+  VideoWriter *writer =
+      ok ? video_writer_open(out_path, width, height, fps, raw, buffers)
+         : NULL;
+  if (!writer)
+  {
+    free(pixels);
+    texpack_release(&pack);
+    raycast_destroy(ctx);
+    return 1;
+  }
+
+  const Map *map = raycast_map(ctx);
+  Camera cam = {map->spawn_x + 0.5, map->spawn_y + 0.5, 1.0, 0.0, 0.0,
+                0.66};
+  const Framebuffer fb = {pixels, width, height, width, false};
+  double renderMs = 0.0;
+  double convertMs = 0.0;
+  double waitMs = 0.0;
+  double start = now_ms();
+  for (int f = 0; f < frames; ++f)
+  {
+    double t = now_ms();
+    raycast_render(ctx, &cam, &fb);
+    double rendered = now_ms();
+    YuvFrame frame;
+    video_writer_frame(writer, &frame);
+    double acquired = now_ms();
+    yuv_from_argb(&frame, &fb, raycast_pool(ctx));
+    video_writer_submit(writer);
+    double converted = now_ms();
+    renderMs += rendered - t;
+    waitMs += acquired - rendered;
+    convertMs += converted - acquired;
+    agent_step(&cam, path_actions(f, fps), 2.5 / fps, 1.5 / fps, map);
+  }
+  ok = video_writer_close(writer);
+  double totalMs = now_ms() - start;
+
+  /* Standard output may be the video, so the summary goes to stderr. */
+  fprintf(stderr,
+          "%d frames at %dx%d in %.2f s: %.1f fps, %.2fx real time at %d "
+          "fps; per frame %.2f ms rendering, %.2f ms converting, %.2f ms "
+          "waiting for the writer\n",
+          frames, width, height, totalMs / 1000.0, frames * 1000.0 / totalMs,
+          frames * 1000.0 / totalMs / fps, fps, renderMs / frames,
+          convertMs / frames, waitMs / frames);
+
+  free(pixels);
+  texpack_release(&pack);
+  raycast_destroy(ctx);
+  return ok ? 0 : 1;
+}
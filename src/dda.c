@@ -0,0 +1,1062 @@
+#include "dda.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                           \
+    (defined(__GNUC__) || defined(__clang__))
+#define DDA_HAVE_X86 1
+#include <immintrin.h>
+#else
+#define DDA_HAVE_X86 0
+#endif
+
+/* Per-ray traversal state; the packet kernels only vectorize the stepping
+   loop, so setup and the final distance go through the same scalar code
+   as cast_ray() and match it bit for bit. */
+typedef struct RayState
+{
+  RayHit hit;
+  double sideDistX;
+  double sideDistY;
+  double deltaDistX;
+  double deltaDistY;
+  double posX;
+  double posY;
+} RayState;
+
+typedef void (*CastRaysFn)(const Map *map, const Camera *cam, int x,
+                           int step, int count, int width, RayHit *out);
+
+static void cast_rays_scalar(const Map *map, const Camera *cam, int x,
+                             int step, int count, int width, RayHit *out);
+
+static CastRaysFn g_cast_rays = cast_rays_scalar;
+static RayKernel g_kernel = RAY_KERNEL_SCALAR;
+static bool g_kernel_chosen = false;
+
+static void ray_begin(const Camera *cam, int x, int width, RayState *s)
+{
+  double cameraX = 2.0 * x / (double)width - 1.0;
+  double rayDirX = cam->dirX + cam->planeX * cameraX;
+  double rayDirY = cam->dirY + cam->planeY * cameraX;
+
+  int mapX = (int)cam->posX;
+  int mapY = (int)cam->posY;
+
+  double deltaDistX = (rayDirX == 0) ? 1e30 : fabs(1.0 / rayDirX);
+  double deltaDistY = (rayDirY == 0) ? 1e30 : fabs(1.0 / rayDirY);
+
+  if (rayDirX < 0)
+  {
+    s->hit.stepX = -1;
+    s->sideDistX = (cam->posX - mapX) * deltaDistX;
+  }
+  else
+  {
+    s->hit.stepX = 1;
+    s->sideDistX = (mapX + 1.0 - cam->posX) * deltaDistX;
+  }
+  if (rayDirY < 0)
+  {
+    s->hit.stepY = -1;
+    s->sideDistY = (cam->posY - mapY) * deltaDistY;
+  }
+  else
+  {
+    s->hit.stepY = 1;
+    s->sideDistY = (mapY + 1.0 - cam->posY) * deltaDistY;
+  }
+
+  s->hit.rayDirX = rayDirX;
+  s->hit.rayDirY = rayDirY;
+  s->hit.mapX = mapX;
+  s->hit.mapY = mapY;
+  s->hit.side = 0;
+  s->hit.door = false;
+  s->hit.shift = 0.0;
+  s->deltaDistX = deltaDistX;
+  s->deltaDistY = deltaDistY;
+  s->posX = cam->posX;
+  s->posY = cam->posY;
+}
+
+static void ray_end(const Camera *cam, RayState *s, RayHit *out)
+{
+  RayHit *hit = &s->hit;
+  if (hit->door)
+  {
+    /* ray_stops() measured the panel. */
+  }
+  else if (hit->side == 0)
+  {
+    hit->perpWallDist =
+        (hit->mapX - cam->posX + (1 - hit->stepX) / 2.0) / hit->rayDirX;
+  }
+  else
+  {
+    hit->perpWallDist =
+        (hit->mapY - cam->posY + (1 - hit->stepY) / 2.0) / hit->rayDirY;
+  }
+  *out = *hit;
+}
+
+static bool cell_blocks(const Map *map, int mapX, int mapY)
+{
+  if (mapX < 0 || mapX >= map->width || mapY < 0 || mapY >= map->height)
+  {
+    return true;
+  }
+  return (map->occupancy[mapY * map->row_words + mapX / 32] >> (mapX % 32)) &
+         1;
+}
+
+static bool cell_inside(const Map *map, int mapX, int mapY)
+{
+  return mapX >= 0 && mapX < map->width && mapY >= 0 && mapY < map->height;
+}
+
+/* Whether a ray that just stepped into blocking cell (mapX, mapY) stops
+   there. A door stops it only if the panel's plane, halfway through the
+   cell, is crossed before the ray leaves the cell and off its open part;
+   the hit then takes the plane's distance. */
+static bool ray_stops(const Map *map, RayState *s)
+{
+  RayHit *hit = &s->hit;
+  if (!map->door_bits || !cell_inside(map, hit->mapX, hit->mapY) ||
+      !((map->door_bits[hit->mapY * map->row_words + hit->mapX / 32] >>
+         (hit->mapX % 32)) &
+        1))
+    return true;
+
+  const MapDoor *door = map_door(map, hit->mapX, hit->mapY);
+  double along;
+  double dist;
+  if (door->side == 0)
+  {
+    double t = s->sideDistX - 0.5 * s->deltaDistX;
+    if (t < s->sideDistY - s->deltaDistY || t >= s->sideDistY)
+      return false;
+    dist = (hit->mapX + 0.5 - s->posX) / hit->rayDirX;
+    along = s->posY + dist * hit->rayDirY - hit->mapY;
+  }
+  else
+  {
+    double t = s->sideDistY - 0.5 * s->deltaDistY;
+    if (t < s->sideDistX - s->deltaDistX || t >= s->sideDistX)
+      return false;
+    dist = (hit->mapY + 0.5 - s->posY) / hit->rayDirY;
+    along = s->posX + dist * hit->rayDirX - hit->mapX;
+  }
+  if (along < door->open)
+    return false;
+  hit->side = door->side;
+  hit->perpWallDist = dist;
+  hit->door = true;
+  hit->shift = door->open;
+  return true;
+}
+
+static int ray_walk(const Map *map, RayState *s)
+{
+  int visited = 0;
+  int hit = 0;
+  while (!hit)
+  {
+    if (s->sideDistX < s->sideDistY)
+    {
+      s->sideDistX += s->deltaDistX;
+      s->hit.mapX += s->hit.stepX;
+      s->hit.side = 0;
+    }
+    else
+    {
+      s->sideDistY += s->deltaDistY;
+      s->hit.mapY += s->hit.stepY;
+      s->hit.side = 1;
+    }
+    ++visited;
+    if (cell_blocks(map, s->hit.mapX, s->hit.mapY) && ray_stops(map, s))
+    {
+      hit = 1;
+    }
+  }
+  return visited;
+}
+
+/* Coarsest skip level whose block around (mapX, mapY) is free of walls, or
+   -1. */
+static int empty_level(const Map *map, int mapX, int mapY)
+{
+  int level = -1;
+  for (int l = 0; l < map->skip_levels; ++l)
+  {
+    int shift = MAP_SKIP_SHIFT * (l + 1);
+    int bx = mapX >> shift;
+    int by = mapY >> shift;
+    if ((map->skip[l][by * map->skip_row_words[l] + bx / 32] >> (bx % 32)) &
+        1)
+      break;
+    level = l;
+  }
+  return level;
+}
+
+/* `side` after `k` more crossings `delta` apart, rounded at each step as
+   the stepping loop's sums are. Within one binade a sum moves by `delta`
+   rounded to its spacing; the first step there settles which way a tie
+   goes, and from then on every step is the same until the sums near the
+   binade's top. So after three steps in one binade the ones that stay
+   clear of its top are taken at once, which is exact: the sum stays on
+   the binade's grid. */
+static double side_advance(double side, double delta, int k)
+{
+  /* Short runs are cheaper to sum. */
+  while (k > 12)
+  {
+    const double a = side + delta;
+    const double b = a + delta;
+    side = b + delta;
+    k -= 3;
+    /* The power of two above a's binade, and the binade's spacing. */
+    uint64_t bits;
+    memcpy(&bits, &a, sizeof bits);
+    bits = (bits & UINT64_C(0x7ff0000000000000)) + (UINT64_C(1) << 52);
+    double top;
+    memcpy(&top, &bits, sizeof top);
+    if (!(side < top))
+      continue;
+    const double ulp = top * 0x1p-53;
+    const double room = (top - ulp - side) / (delta + ulp);
+    int jumps = room < k + 1.0 ? (int)room - 1 : k;
+    if (jumps > 0)
+    {
+      side += jumps * (side - b);
+      k -= jumps;
+    }
+  }
+  for (; k > 0; --k)
+    side += delta;
+  return side;
+}
+
+/* How many of the crossings `side`, `side` + `delta`, .. (summed as by
+   side_advance()) come before `limit`, or at it when `ties`; at most
+   `max`, which the caller knows does not. `next` receives the first that
+   does not come before. */
+static int side_crossings(double side, double delta, double limit, bool ties,
+                          int max, double *next)
+{
+  int k = 0;
+  if (side < limit)
+  {
+    /* The product is within rounding of the sum; start a little short
+       and step up. */
+    double estimate = (limit - side) / delta - 1.0;
+    k = estimate < max ? (int)estimate : max;
+    if (k < 0)
+      k = 0;
+  }
+  double at = side_advance(side, delta, k);
+  if (k > 0 && !(at < limit || (ties && at == limit)))
+  {
+    k = 0;
+    at = side;
+  }
+  while (k < max && (at < limit || (ties && at == limit)))
+  {
+    at += delta;
+    ++k;
+  }
+  *next = at;
+  return k;
+}
+
+/* Advances the ray to the first cell outside the box [x0, x1) x [y0, y1)
+   around it, onto the cell, side and side distances cell-by-cell
+   stepping reaches: the crossings are summed as stepping sums them, and
+   only the tests of the empty cells are left out. Stepping moves along X
+   while its X crossing is strictly nearer, so the ray leaves through X
+   when its last X crossing inside the box is nearer than its last Y one,
+   having crossed in Y every line up to that far. */
+static void ray_leave_box(RayState *s, int x0, int x1, int y0, int y1)
+{
+  RayHit *hit = &s->hit;
+  int nx = hit->stepX > 0 ? x1 - hit->mapX : hit->mapX - x0 + 1;
+  int ny = hit->stepY > 0 ? y1 - hit->mapY : hit->mapY - y0 + 1;
+  if (nx + ny <= 2 << MAP_SKIP_SHIFT)
+  {
+    /* The finest blocks are quicker stepped through. */
+    for (;;)
+    {
+      if (s->sideDistX < s->sideDistY)
+      {
+        s->sideDistX += s->deltaDistX;
+        hit->mapX += hit->stepX;
+        if (--nx == 0)
+        {
+          hit->side = 0;
+          return;
+        }
+      }
+      else
+      {
+        s->sideDistY += s->deltaDistY;
+        hit->mapY += hit->stepY;
+        if (--ny == 0)
+        {
+          hit->side = 1;
+          return;
+        }
+      }
+    }
+  }
+  double tx = side_advance(s->sideDistX, s->deltaDistX, nx - 1);
+  double ty = side_advance(s->sideDistY, s->deltaDistY, ny - 1);
+  if (tx < ty)
+  {
+    int ky = side_crossings(s->sideDistY, s->deltaDistY, tx, true, ny - 1,
+                            &s->sideDistY);
+    hit->mapY += ky * hit->stepY;
+    hit->mapX += nx * hit->stepX;
+    s->sideDistX = tx + s->deltaDistX;
+    hit->side = 0;
+  }
+  else
+  {
+    int kx = side_crossings(s->sideDistX, s->deltaDistX, ty, false, nx - 1,
+                            &s->sideDistX);
+    hit->mapX += kx * hit->stepX;
+    hit->mapY += ny * hit->stepY;
+    s->sideDistY = ty + s->deltaDistY;
+    hit->side = 1;
+  }
+}
+
+/* Stepping loop that crosses wall-free skip blocks in one step. Boxes are
+   clipped to the map, so a ray leaving the map still stops on the first
+   cell outside it. */
+static int ray_walk_skip(const Map *map, RayState *s)
+{
+  RayHit *hit = &s->hit;
+  int visited = 0;
+  for (;;)
+  {
+    int level = -1;
+    if (cell_inside(map, hit->mapX, hit->mapY))
+      level = empty_level(map, hit->mapX, hit->mapY);
+    if (level < 0)
+    {
+      /* Plain steps until the ray leaves the finest block holding a wall
+         (or, outside the map, after one step). */
+      int bx = hit->mapX >> MAP_SKIP_SHIFT;
+      int by = hit->mapY >> MAP_SKIP_SHIFT;
+      do
+      {
+        if (s->sideDistX < s->sideDistY)
+        {
+          s->sideDistX += s->deltaDistX;
+          hit->mapX += hit->stepX;
+          hit->side = 0;
+        }
+        else
+        {
+          s->sideDistY += s->deltaDistY;
+          hit->mapY += hit->stepY;
+          hit->side = 1;
+        }
+        ++visited;
+        if (cell_blocks(map, hit->mapX, hit->mapY) && ray_stops(map, s))
+          return visited;
+      } while (hit->mapX >> MAP_SKIP_SHIFT == bx &&
+               hit->mapY >> MAP_SKIP_SHIFT == by);
+      continue;
+    }
+
+    int shift = MAP_SKIP_SHIFT * (level + 1);
+    int x0 = hit->mapX >> shift << shift;
+    int y0 = hit->mapY >> shift << shift;
+    int x1 = x0 + (1 << shift);
+    int y1 = y0 + (1 << shift);
+    ray_leave_box(s, x0, x1 < map->width ? x1 : map->width, y0,
+                  y1 < map->height ? y1 : map->height);
+    ++visited;
+    if (cell_blocks(map, hit->mapX, hit->mapY) && ray_stops(map, s))
+      return visited;
+  }
+}
+
+int cast_ray_counted(const Map *map, const Camera *cam, int x, int width,
+                     RayHit *out)
+{
+  RayState s;
+  ray_begin(cam, x, width, &s);
+  int visited =
+      map->skip_levels > 0 ? ray_walk_skip(map, &s) : ray_walk(map, &s);
+  ray_end(cam, &s, out);
+  return visited;
+}
+
+void cast_ray(const Map *map, const Camera *cam, int x, int width,
+              RayHit *out)
+{
+  cast_ray_counted(map, cam, x, width, out);
+}
+
+static void cast_rays_scalar(const Map *map, const Camera *cam, int x,
+                             int step, int count, int width, RayHit *out)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    cast_ray(map, cam, x + i * step, width, &out[i]);
+  }
+}
+
+#if DDA_HAVE_X86
+
+/* The packet kernels evaluate the exact operation sequence of ray_begin(),
+   the stepping loop and ray_end() lane-wise in double precision (map
+   coordinates, steps and side are small integers held exactly in double
+   lanes), so every lane reproduces cast_ray() bit for bit.
+
+   Lanes keep stepping until the whole packet is done and latch their cell
+   and side on the first hit, so the stepping chain never waits on the
+   tile lookup. A packet is several independent lane groups stepped in
+   turn to hide the compare/add latency of that chain. Lanes past `count`
+   trace real rays beyond the packet and are dropped. */
+
+#define DDA_SSE2 __attribute__((target("sse2"), always_inline)) static inline
+#define DDA_AVX2 __attribute__((target("avx2"), always_inline)) static inline
+
+#define SSE2_LANES 2
+#define AVX2_LANES 4
+
+typedef struct Sse2Rays
+{
+  __m128d rayDirX;
+  __m128d rayDirY;
+  __m128d deltaDistX;
+  __m128d deltaDistY;
+  __m128d stepX;
+  __m128d stepY;
+  __m128d sideDistX;
+  __m128d sideDistY;
+  __m128d mapX;
+  __m128d mapY;
+  __m128d hitX;
+  __m128d hitY;
+  __m128d side;
+  __m128d active;
+} Sse2Rays;
+
+DDA_SSE2 __m128d sse2_select(__m128d mask, __m128d a, __m128d b)
+{
+  return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+DDA_SSE2 void sse2_begin(const Camera *cam, int x, int step, int width,
+                         Sse2Rays *r)
+{
+  const __m128d zero = _mm_setzero_pd();
+  const __m128d one = _mm_set1_pd(1.0);
+  const __m128d posX = _mm_set1_pd(cam->posX);
+  const __m128d posY = _mm_set1_pd(cam->posY);
+
+  __m128d column = _mm_setr_pd(x, x + step);
+  __m128d cameraX = _mm_sub_pd(
+      _mm_div_pd(_mm_mul_pd(_mm_set1_pd(2.0), column), _mm_set1_pd(width)),
+      one);
+  r->rayDirX = _mm_add_pd(_mm_set1_pd(cam->dirX),
+                          _mm_mul_pd(_mm_set1_pd(cam->planeX), cameraX));
+  r->rayDirY = _mm_add_pd(_mm_set1_pd(cam->dirY),
+                          _mm_mul_pd(_mm_set1_pd(cam->planeY), cameraX));
+  r->mapX = _mm_set1_pd((int)cam->posX);
+  r->mapY = _mm_set1_pd((int)cam->posY);
+
+  const __m128d sign = _mm_set1_pd(-0.0);
+  const __m128d far = _mm_set1_pd(1e30);
+  r->deltaDistX =
+      sse2_select(_mm_cmpeq_pd(r->rayDirX, zero), far,
+                  _mm_andnot_pd(sign, _mm_div_pd(one, r->rayDirX)));
+  r->deltaDistY =
+      sse2_select(_mm_cmpeq_pd(r->rayDirY, zero), far,
+                  _mm_andnot_pd(sign, _mm_div_pd(one, r->rayDirY)));
+
+  __m128d negX = _mm_cmplt_pd(r->rayDirX, zero);
+  __m128d negY = _mm_cmplt_pd(r->rayDirY, zero);
+  r->stepX = sse2_select(negX, _mm_set1_pd(-1.0), one);
+  r->stepY = sse2_select(negY, _mm_set1_pd(-1.0), one);
+  r->sideDistX = _mm_mul_pd(
+      sse2_select(negX, _mm_sub_pd(posX, r->mapX),
+                  _mm_sub_pd(_mm_add_pd(r->mapX, one), posX)),
+      r->deltaDistX);
+  r->sideDistY = _mm_mul_pd(
+      sse2_select(negY, _mm_sub_pd(posY, r->mapY),
+                  _mm_sub_pd(_mm_add_pd(r->mapY, one), posY)),
+      r->deltaDistY);
+  r->hitX = zero;
+  r->hitY = zero;
+  r->side = zero;
+  r->active = _mm_cmpeq_pd(zero, zero);
+}
+
+DDA_SSE2 void sse2_step(const Map *map, Sse2Rays *r)
+{
+  const __m128d one = _mm_set1_pd(1.0);
+
+  __m128d takeX = _mm_cmplt_pd(r->sideDistX, r->sideDistY);
+  r->sideDistX = _mm_add_pd(r->sideDistX, _mm_and_pd(r->deltaDistX, takeX));
+  r->mapX = _mm_add_pd(r->mapX, _mm_and_pd(r->stepX, takeX));
+  r->sideDistY =
+      _mm_add_pd(r->sideDistY, _mm_andnot_pd(takeX, r->deltaDistY));
+  r->mapY = _mm_add_pd(r->mapY, _mm_andnot_pd(takeX, r->stepY));
+
+  /* SSE2 has no gather or variable shift: the two cells are tested from
+     scalar registers, off-map lanes counting as blocked. */
+  __m128i mx = _mm_cvttpd_epi32(r->mapX);
+  __m128i my = _mm_cvttpd_epi32(r->mapY);
+  long long wall_lo =
+      cell_blocks(map, _mm_cvtsi128_si32(mx), _mm_cvtsi128_si32(my));
+  long long wall_hi = cell_blocks(map, _mm_cvtsi128_si32(_mm_srli_si128(mx, 4)),
+                                  _mm_cvtsi128_si32(_mm_srli_si128(my, 4)));
+  __m128d blocked = _mm_castsi128_pd(_mm_set_epi64x(-wall_hi, -wall_lo));
+  __m128d hit = _mm_and_pd(blocked, r->active);
+
+  r->hitX = sse2_select(hit, r->mapX, r->hitX);
+  r->hitY = sse2_select(hit, r->mapY, r->hitY);
+  r->side = sse2_select(hit, _mm_andnot_pd(takeX, one), r->side);
+  r->active = _mm_andnot_pd(hit, r->active);
+}
+
+DDA_SSE2 void sse2_end(const Camera *cam, const Sse2Rays *r, RayHit *out,
+                       int count)
+{
+  const __m128d one = _mm_set1_pd(1.0);
+  const __m128d two = _mm_set1_pd(2.0);
+  __m128d perpX = _mm_div_pd(
+      _mm_add_pd(_mm_sub_pd(r->hitX, _mm_set1_pd(cam->posX)),
+                 _mm_div_pd(_mm_sub_pd(one, r->stepX), two)),
+      r->rayDirX);
+  __m128d perpY = _mm_div_pd(
+      _mm_add_pd(_mm_sub_pd(r->hitY, _mm_set1_pd(cam->posY)),
+                 _mm_div_pd(_mm_sub_pd(one, r->stepY), two)),
+      r->rayDirY);
+  __m128d perp = sse2_select(_mm_cmpeq_pd(r->side, one), perpY, perpX);
+
+  double lanes[8][SSE2_LANES];
+  _mm_storeu_pd(lanes[0], r->rayDirX);
+  _mm_storeu_pd(lanes[1], r->rayDirY);
+  _mm_storeu_pd(lanes[2], r->hitX);
+  _mm_storeu_pd(lanes[3], r->hitY);
+  _mm_storeu_pd(lanes[4], r->stepX);
+  _mm_storeu_pd(lanes[5], r->stepY);
+  _mm_storeu_pd(lanes[6], r->side);
+  _mm_storeu_pd(lanes[7], perp);
+  for (int i = 0; i < count && i < SSE2_LANES; ++i)
+  {
+    out[i].rayDirX = lanes[0][i];
+    out[i].rayDirY = lanes[1][i];
+    out[i].mapX = (int)lanes[2][i];
+    out[i].mapY = (int)lanes[3][i];
+    out[i].stepX = (int)lanes[4][i];
+    out[i].stepY = (int)lanes[5][i];
+    out[i].side = (int)lanes[6][i];
+    out[i].perpWallDist = lanes[7][i];
+    out[i].door = false;
+    out[i].shift = 0.0;
+  }
+}
+
+/* Two-lane registers, so a packet is four groups. */
+__attribute__((target("sse2"))) static void
+cast_rays_sse2(const Map *map, const Camera *cam, int x, int step,
+               int count, int width, RayHit *out)
+{
+  Sse2Rays g[RAY_PACKET / SSE2_LANES];
+  const int groups = RAY_PACKET / SSE2_LANES;
+  for (int i = 0; i < groups; ++i)
+  {
+    sse2_begin(cam, x + i * SSE2_LANES * step, step, width, &g[i]);
+  }
+  for (;;)
+  {
+    __m128d active = _mm_setzero_pd();
+    for (int i = 0; i < groups; ++i)
+    {
+      sse2_step(map, &g[i]);
+      active = _mm_or_pd(active, g[i].active);
+    }
+    if (!_mm_movemask_pd(active))
+      break;
+  }
+  for (int i = 0; i < groups && i * SSE2_LANES < count; ++i)
+  {
+    sse2_end(cam, &g[i], out + i * SSE2_LANES, count - i * SSE2_LANES);
+  }
+}
+
+typedef struct Avx2Rays
+{
+  __m256d rayDirX;
+  __m256d rayDirY;
+  __m256d deltaDistX;
+  __m256d deltaDistY;
+  __m256d stepX;
+  __m256d stepY;
+  __m256d sideDistX;
+  __m256d sideDistY;
+  __m256d mapX;
+  __m256d mapY;
+  __m256d hitX;
+  __m256d hitY;
+  __m256d side;
+  __m256d active;
+} Avx2Rays;
+
+DDA_AVX2 void avx2_begin(const Camera *cam, int x, int step, int width,
+                         Avx2Rays *r)
+{
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d posX = _mm256_set1_pd(cam->posX);
+  const __m256d posY = _mm256_set1_pd(cam->posY);
+
+  __m256d column =
+      _mm256_setr_pd(x, x + step, x + 2 * step, x + 3 * step);
+  __m256d cameraX = _mm256_sub_pd(
+      _mm256_div_pd(_mm256_mul_pd(_mm256_set1_pd(2.0), column),
+                    _mm256_set1_pd(width)),
+      one);
+  r->rayDirX =
+      _mm256_add_pd(_mm256_set1_pd(cam->dirX),
+                    _mm256_mul_pd(_mm256_set1_pd(cam->planeX), cameraX));
+  r->rayDirY =
+      _mm256_add_pd(_mm256_set1_pd(cam->dirY),
+                    _mm256_mul_pd(_mm256_set1_pd(cam->planeY), cameraX));
+  r->mapX = _mm256_set1_pd((int)cam->posX);
+  r->mapY = _mm256_set1_pd((int)cam->posY);
+
+  const __m256d sign = _mm256_set1_pd(-0.0);
+  const __m256d far = _mm256_set1_pd(1e30);
+  r->deltaDistX = _mm256_blendv_pd(
+      _mm256_andnot_pd(sign, _mm256_div_pd(one, r->rayDirX)), far,
+      _mm256_cmp_pd(r->rayDirX, zero, _CMP_EQ_OQ));
+  r->deltaDistY = _mm256_blendv_pd(
+      _mm256_andnot_pd(sign, _mm256_div_pd(one, r->rayDirY)), far,
+      _mm256_cmp_pd(r->rayDirY, zero, _CMP_EQ_OQ));
+
+  __m256d negX = _mm256_cmp_pd(r->rayDirX, zero, _CMP_LT_OQ);
+  __m256d negY = _mm256_cmp_pd(r->rayDirY, zero, _CMP_LT_OQ);
+  r->stepX = _mm256_blendv_pd(one, _mm256_set1_pd(-1.0), negX);
+  r->stepY = _mm256_blendv_pd(one, _mm256_set1_pd(-1.0), negY);
+  r->sideDistX = _mm256_mul_pd(
+      _mm256_blendv_pd(_mm256_sub_pd(_mm256_add_pd(r->mapX, one), posX),
+                       _mm256_sub_pd(posX, r->mapX), negX),
+      r->deltaDistX);
+  r->sideDistY = _mm256_mul_pd(
+      _mm256_blendv_pd(_mm256_sub_pd(_mm256_add_pd(r->mapY, one), posY),
+                       _mm256_sub_pd(posY, r->mapY), negY),
+      r->deltaDistY);
+  r->hitX = zero;
+  r->hitY = zero;
+  r->side = zero;
+  r->active = _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ);
+}
+
+/* The gather fetches each lane's occupancy word for in-bounds lanes only,
+   so lanes that ran off the map never touch memory. */
+DDA_AVX2 void avx2_step(const Map *map, Avx2Rays *r)
+{
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i minus_one = _mm_set1_epi32(-1);
+  const __m128i map_w = _mm_set1_epi32(map->width);
+  const __m128i map_h = _mm_set1_epi32(map->height);
+  const __m128i row_words = _mm_set1_epi32(map->row_words);
+
+  __m256d takeX = _mm256_cmp_pd(r->sideDistX, r->sideDistY, _CMP_LT_OQ);
+  r->sideDistX =
+      _mm256_add_pd(r->sideDistX, _mm256_and_pd(r->deltaDistX, takeX));
+  r->mapX = _mm256_add_pd(r->mapX, _mm256_and_pd(r->stepX, takeX));
+  r->sideDistY =
+      _mm256_add_pd(r->sideDistY, _mm256_andnot_pd(takeX, r->deltaDistY));
+  r->mapY = _mm256_add_pd(r->mapY, _mm256_andnot_pd(takeX, r->stepY));
+
+  __m128i mx = _mm256_cvttpd_epi32(r->mapX);
+  __m128i my = _mm256_cvttpd_epi32(r->mapY);
+  __m128i inside_x = _mm_and_si128(_mm_cmpgt_epi32(mx, minus_one),
+                                   _mm_cmplt_epi32(mx, map_w));
+  __m128i inside_y = _mm_and_si128(_mm_cmpgt_epi32(my, minus_one),
+                                   _mm_cmplt_epi32(my, map_h));
+  __m128i inside = _mm_and_si128(inside_x, inside_y);
+  __m128i word = _mm_add_epi32(_mm_mullo_epi32(my, row_words),
+                               _mm_srai_epi32(mx, 5));
+  __m128i bits = _mm_mask_i32gather_epi32(
+      zero, (const int *)map->occupancy, word, inside, 4);
+  __m128i wall = _mm_and_si128(
+      _mm_srlv_epi32(bits, _mm_and_si128(mx, _mm_set1_epi32(31))),
+      _mm_set1_epi32(1));
+  __m128i blocked = _mm_or_si128(_mm_cmpeq_epi32(inside, zero),
+                                 _mm_cmpgt_epi32(wall, zero));
+  __m256d hit = _mm256_and_pd(
+      _mm256_castsi256_pd(_mm256_cvtepi32_epi64(blocked)), r->active);
+
+  r->hitX = _mm256_blendv_pd(r->hitX, r->mapX, hit);
+  r->hitY = _mm256_blendv_pd(r->hitY, r->mapY, hit);
+  r->side = _mm256_blendv_pd(r->side, _mm256_andnot_pd(takeX, one), hit);
+  r->active = _mm256_andnot_pd(hit, r->active);
+}
+
+DDA_AVX2 void avx2_end(const Camera *cam, const Avx2Rays *r, RayHit *out,
+                       int count)
+{
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d two = _mm256_set1_pd(2.0);
+  __m256d perpX = _mm256_div_pd(
+      _mm256_add_pd(_mm256_sub_pd(r->hitX, _mm256_set1_pd(cam->posX)),
+                    _mm256_div_pd(_mm256_sub_pd(one, r->stepX), two)),
+      r->rayDirX);
+  __m256d perpY = _mm256_div_pd(
+      _mm256_add_pd(_mm256_sub_pd(r->hitY, _mm256_set1_pd(cam->posY)),
+                    _mm256_div_pd(_mm256_sub_pd(one, r->stepY), two)),
+      r->rayDirY);
+  __m256d perp = _mm256_blendv_pd(perpX, perpY,
+                                  _mm256_cmp_pd(r->side, one, _CMP_EQ_OQ));
+
+  double dirs[2][AVX2_LANES];
+  double dist[AVX2_LANES];
+  int ints[5][AVX2_LANES];
+  _mm256_storeu_pd(dirs[0], r->rayDirX);
+  _mm256_storeu_pd(dirs[1], r->rayDirY);
+  _mm256_storeu_pd(dist, perp);
+  _mm_storeu_si128((__m128i *)ints[0], _mm256_cvttpd_epi32(r->hitX));
+  _mm_storeu_si128((__m128i *)ints[1], _mm256_cvttpd_epi32(r->hitY));
+  _mm_storeu_si128((__m128i *)ints[2], _mm256_cvttpd_epi32(r->stepX));
+  _mm_storeu_si128((__m128i *)ints[3], _mm256_cvttpd_epi32(r->stepY));
+  _mm_storeu_si128((__m128i *)ints[4], _mm256_cvttpd_epi32(r->side));
+  for (int i = 0; i < count && i < AVX2_LANES; ++i)
+  {
+    out[i].rayDirX = dirs[0][i];
+    out[i].rayDirY = dirs[1][i];
+    out[i].mapX = ints[0][i];
+    out[i].mapY = ints[1][i];
+    out[i].stepX = ints[2][i];
+    out[i].stepY = ints[3][i];
+    out[i].side = ints[4][i];
+    out[i].perpWallDist = dist[i];
+    out[i].door = false;
+    out[i].shift = 0.0;
+  }
+}
+
+/* Four-lane registers, so a packet is two groups. */
+__attribute__((target("avx2"))) static void
+cast_rays_avx2(const Map *map, const Camera *cam, int x, int step,
+               int count, int width, RayHit *out)
+{
+  Avx2Rays a;
+  Avx2Rays b;
+  avx2_begin(cam, x, step, width, &a);
+  avx2_begin(cam, x + AVX2_LANES * step, step, width, &b);
+  while (_mm256_movemask_pd(_mm256_or_pd(a.active, b.active)))
+  {
+    avx2_step(map, &a);
+    avx2_step(map, &b);
+  }
+  avx2_end(cam, &a, out, count);
+  if (count > AVX2_LANES)
+  {
+    avx2_end(cam, &b, out + AVX2_LANES, count - AVX2_LANES);
+  }
+}
+
+#endif
+
+bool ray_kernel_select(RayKernel kernel)
+{
+#if DDA_HAVE_X86
+  __builtin_cpu_init();
+  bool has_sse2 = __builtin_cpu_supports("sse2");
+  bool has_avx2 = __builtin_cpu_supports("avx2");
+#else
+  bool has_sse2 = false;
+  bool has_avx2 = false;
+#endif
+
+  /* Without a gather the SSE2 kernel measures slower than scalar, so AUTO
+     only upgrades to AVX2. */
+  if (kernel == RAY_KERNEL_AUTO)
+  {
+    kernel = has_avx2 ? RAY_KERNEL_AVX2 : RAY_KERNEL_SCALAR;
+  }
+
+  CastRaysFn fn = NULL;
+  switch (kernel)
+  {
+  case RAY_KERNEL_SCALAR:
+    fn = cast_rays_scalar;
+    break;
+#if DDA_HAVE_X86
+  case RAY_KERNEL_SSE2:
+    fn = has_sse2 ? cast_rays_sse2 : NULL;
+    break;
+  case RAY_KERNEL_AVX2:
+    fn = has_avx2 ? cast_rays_avx2 : NULL;
+    break;
+#endif
+  default:
+    break;
+  }
+  if (!fn)
+  {
+    return false;
+  }
+
+  g_cast_rays = fn;
+  g_kernel = kernel;
+  g_kernel_chosen = true;
+  return true;
+}
+
+RayKernel ray_kernel_current(void)
+{
+  if (!g_kernel_chosen)
+  {
+    ray_kernel_select(RAY_KERNEL_AUTO);
+  }
+  return g_kernel;
+}
+
+const char *ray_kernel_name(RayKernel kernel)
+{
+  switch (kernel)
+  {
+  case RAY_KERNEL_AUTO:
+    return "auto";
+  case RAY_KERNEL_SCALAR:
+    return "scalar";
+  case RAY_KERNEL_SSE2:
+    return "sse2";
+  case RAY_KERNEL_AVX2:
+    return "avx2";
+  }
+  return "unknown";
+}
+
+void cast_rays(const Map *map, const Camera *cam, int x, int step,
+               int count, int width, RayHit *out)
+{
+  /* The packet kernels step every lane cell by cell; skipping rays
+     diverge too much to share them, and doors need the panel test. */
+  if (map->skip_levels > 0 || map->door_count > 0)
+  {
+    cast_rays_scalar(map, cam, x, step, count, width, out);
+    return;
+  }
+  g_cast_rays(map, cam, x, step, count, width, out);
+}
+
+bool ray_same_face(const RayHit *a, const RayHit *b)
+{
+  return a->mapX == b->mapX && a->mapY == b->mapY && a->side == b->side;
+}
+
+void cast_ray_face(const Camera *cam, int x, int width, const RayHit *face,
+                   RayHit *out)
+{
+  RayState s;
+  ray_begin(cam, x, width, &s);
+  s.hit.mapX = face->mapX;
+  s.hit.mapY = face->mapY;
+  s.hit.side = face->side;
+  ray_end(cam, &s, out);
+}
+
+/* Fills out[1 .. last - 1], columns x + step .. x + (last - 1) * step,
+   given the hits of out[0] and out[last]. */
+static int coherent_span(const Map *map, const Camera *cam, int x, int step,
+                         int last, int width, RayHit *out)
+{
+  if (last < 2)
+    return 0;
+  if (ray_same_face(&out[0], &out[last]))
+  {
+    for (int i = 1; i < last; ++i)
+      cast_ray_face(cam, x + i * step, width, &out[0], &out[i]);
+    return 0;
+  }
+  int mid = last / 2;
+  cast_ray(map, cam, x + mid * step, width, &out[mid]);
+  return 1 + coherent_span(map, cam, x, step, mid, width, out) +
+         coherent_span(map, cam, x + mid * step, step, last - mid, width,
+                       out + mid);
+}
+
+int cast_rays_coherent(const Map *map, const Camera *cam, int x, int step,
+                       int count, int width, RayHit *out)
+{
+  if (count <= 0)
+    return 0;
+  if (map->door_count > 0)
+  {
+    for (int i = 0; i < count; ++i)
+      cast_ray(map, cam, x + i * step, width, &out[i]);
+    return count;
+  }
+  cast_ray(map, cam, x, width, &out[0]);
+  if (count == 1)
+    return 1;
+  cast_ray(map, cam, x + (count - 1) * step, width, &out[count - 1]);
+  return 2 + coherent_span(map, cam, x, step, count - 1, width, out);
+}
+
+#if RENDER_HAS_FIXED
+void fixed_camera(const Camera *cam, FixedCamera *out)
+{
+  out->cellX = (int)cam->posX;
+  out->cellY = (int)cam->posY;
+  out->fracX = (Fixed)((cam->posX - out->cellX) * FIXED_ONE);
+  out->fracY = (Fixed)((cam->posY - out->cellY) * FIXED_ONE);
+  out->dirX = fixed_from_double(cam->dirX);
+  out->dirY = fixed_from_double(cam->dirY);
+  out->planeX = fixed_from_double(cam->planeX);
+  out->planeY = fixed_from_double(cam->planeY);
+}
+#endif
+
+#if RENDER_HAS_FLOAT
+void float_camera(const Camera *cam, FloatCamera *out)
+{
+  out->cellX = (int)cam->posX;
+  out->cellY = (int)cam->posY;
+  out->fracX = (float)(cam->posX - out->cellX);
+  out->fracY = (float)(cam->posY - out->cellY);
+  out->dirX = (float)cam->dirX;
+  out->dirY = (float)cam->dirY;
+  out->planeX = (float)cam->planeX;
+  out->planeY = (float)cam->planeY;
+}
+#endif
+
+#if RENDER_HAS_FIXED
+/* Side distances are 16.16 in 64 bits: a near-parallel ray's step is up
+   to 2^32 and rays cross maps of up to 65536 cells. An axis-parallel ray
+   never steps along that axis. */
+#define FIXED_NEVER ((int64_t)1 << 46)
+
+void cast_ray_fixed(const Map *map, const FixedCamera *cam, Fixed cameraX,
+                    RayHitFixed *out)
+{
+  Fixed rayDirX = cam->dirX + fixed_mul(cam->planeX, cameraX);
+  Fixed rayDirY = cam->dirY + fixed_mul(cam->planeY, cameraX);
+
+  int64_t deltaDistX =
+      rayDirX == 0 ? FIXED_NEVER
+                   : (int64_t)fixed_recip(
+                         (uint32_t)(rayDirX < 0 ? -rayDirX : rayDirX));
+  int64_t deltaDistY =
+      rayDirY == 0 ? FIXED_NEVER
+                   : (int64_t)fixed_recip(
+                         (uint32_t)(rayDirY < 0 ? -rayDirY : rayDirY));
+
+  int stepX = rayDirX < 0 ? -1 : 1;
+  int stepY = rayDirY < 0 ? -1 : 1;
+  int64_t sideDistX =
+      ((rayDirX < 0 ? cam->fracX : FIXED_ONE - cam->fracX) * deltaDistX) >>
+      FIXED_SHIFT;
+  int64_t sideDistY =
+      ((rayDirY < 0 ? cam->fracY : FIXED_ONE - cam->fracY) * deltaDistY) >>
+      FIXED_SHIFT;
+
+  int mapX = cam->cellX;
+  int mapY = cam->cellY;
+  int side = 0;
+  do
+  {
+    if (sideDistX < sideDistY)
+    {
+      sideDistX += deltaDistX;
+      mapX += stepX;
+      side = 0;
+    }
+    else
+    {
+      sideDistY += deltaDistY;
+      mapY += stepY;
+      side = 1;
+    }
+  } while (!cell_blocks(map, mapX, mapY));
+
+  int64_t perp = side == 0 ? sideDistX - deltaDistX : sideDistY - deltaDistY;
+  if (perp < 1)
+    perp = 1;
+  if (perp > INT32_MAX)
+    perp = INT32_MAX;
+  int64_t wallX = side == 0 ? cam->fracY + ((perp * rayDirY) >> FIXED_SHIFT)
+                            : cam->fracX + ((perp * rayDirX) >> FIXED_SHIFT);
+
+  out->rayDirX = rayDirX;
+  out->rayDirY = rayDirY;
+  out->mapX = mapX;
+  out->mapY = mapY;
+  out->side = side;
+  out->perpWallDist = (Fixed)perp;
+  out->wallX = (Fixed)(wallX & FIXED_FRACTION);
+}
+#endif
+
+#if RENDER_HAS_FLOAT
+void cast_ray_float(const Map *map, const FloatCamera *cam, float cameraX,
+                    RayHitFixed *out)
+{
+  float rayDirX = cam->dirX + cam->planeX * cameraX;
+  float rayDirY = cam->dirY + cam->planeY * cameraX;
+
+  float deltaDistX = rayDirX == 0.0f ? 1e30f : float_recip(fabsf(rayDirX));
+  float deltaDistY = rayDirY == 0.0f ? 1e30f : float_recip(fabsf(rayDirY));
+
+  int stepX = rayDirX < 0.0f ? -1 : 1;
+  int stepY = rayDirY < 0.0f ? -1 : 1;
+  float sideDistX =
+      (rayDirX < 0.0f ? cam->fracX : 1.0f - cam->fracX) * deltaDistX;
+  float sideDistY =
+      (rayDirY < 0.0f ? cam->fracY : 1.0f - cam->fracY) * deltaDistY;
+
+  int mapX = cam->cellX;
+  int mapY = cam->cellY;
+  int side = 0;
+  do
+  {
+    if (sideDistX < sideDistY)
+    {
+      sideDistX += deltaDistX;
+      mapX += stepX;
+      side = 0;
+    }
+    else
+    {
+      sideDistY += deltaDistY;
+      mapY += stepY;
+      side = 1;
+    }
+  } while (!cell_blocks(map, mapX, mapY));
+
+  float perp = side == 0 ? sideDistX - deltaDistX : sideDistY - deltaDistY;
+  if (perp < 1.0f / FIXED_ONE)
+    perp = 1.0f / FIXED_ONE;
+  if (perp > 32767.0f)
+    perp = 32767.0f;
+  float wallX = side == 0 ? cam->fracY + perp * rayDirY
+                          : cam->fracX + perp * rayDirX;
+  wallX -= floorf(wallX);
+
+  out->rayDirX = (Fixed)(rayDirX * FIXED_ONE);
+  out->rayDirY = (Fixed)(rayDirY * FIXED_ONE);
+  out->mapX = mapX;
+  out->mapY = mapY;
+  out->side = side;
+  out->perpWallDist = (Fixed)(perp * FIXED_ONE);
+  out->wallX = (Fixed)(wallX * FIXED_ONE) & FIXED_FRACTION;
+}
+#endif
@@ -0,0 +1,132 @@
+#ifndef RAYCAST_DDA_H
+#define RAYCAST_DDA_H
+
+#include "fixed.h"
+#include "render.h"
+
+/* Rays cast together by one packet call; adjacent columns are coherent. */
+#define RAY_PACKET 8
+
+typedef struct RayHit
+{
+  double rayDirX;
+  double rayDirY;
+  int mapX;
+  int mapY;
+  int stepX;
+  int stepY;
+  int side;
+  double perpWallDist;
+  /* Set when the ray stopped on a door panel (MapDoor): `side` is the
+     panel's, the distance that of its plane, and `shift` how far it has
+     slid open along the face. */
+  bool door;
+  double shift;
+} RayHit;
+
+typedef enum RayKernel
+{
+  RAY_KERNEL_AUTO,
+  RAY_KERNEL_SCALAR,
+  RAY_KERNEL_SSE2,
+  RAY_KERNEL_AVX2
+} RayKernel;
+
+/* Selects the packet traversal kernel. AUTO picks AVX2 when the CPU has
+   it and scalar otherwise; asking for an unsupported kernel returns false
+   and keeps the current one. Every kernel produces identical hits. */
+bool ray_kernel_select(RayKernel kernel);
+RayKernel ray_kernel_current(void);
+const char *ray_kernel_name(RayKernel kernel);
+
+/* Rays stop at the first occupied cell or when they leave the map. On maps
+   with skip levels (map_build_skip) every kernel walks rays with
+   empty-space skipping instead. Rays entering a door cell stop on its
+   panel unless they miss it or pass its open part; maps with doors are
+   cast by the scalar kernel. */
+void cast_ray(const Map *map, const Camera *cam, int x, int width,
+              RayHit *out);
+/* cast_ray() that also returns how many cells or skipped blocks the ray
+   stepped through. */
+int cast_ray_counted(const Map *map, const Camera *cam, int x, int width,
+                     RayHit *out);
+/* Casts columns x, x + step, .. x + (count - 1) * step
+   (count <= RAY_PACKET). */
+void cast_rays(const Map *map, const Camera *cam, int x, int step,
+               int count, int width, RayHit *out);
+/* Columns x, x + step, .. x + (count - 1) * step (any count) like
+   cast_ray(), tracing only the outer two and, between two hits on
+   different faces, the middle column, recursively. Columns between two
+   hits on the same side of the same cell take that face without a
+   traversal: a blocking cell in the wedge between the two rays would have
+   to cross one of them, since the wedge is narrower than a cell, so the
+   hits match cast_ray() exactly. A partly open door breaks that argument,
+   so maps with doors have every column traced. Returns the number of
+   rays traced. */
+int cast_rays_coherent(const Map *map, const Camera *cam, int x, int step,
+                       int count, int width, RayHit *out);
+
+/* Same cell and side. */
+bool ray_same_face(const RayHit *a, const RayHit *b);
+/* The hit cast_ray() returns for column x when its ray first meets a
+   blocking cell on the face of `face`, found without a traversal. */
+void cast_ray_face(const Camera *cam, int x, int width, const RayHit *face,
+                   RayHit *out);
+
+/* Camera for the low-precision casts: the cell it stands in, its position
+   inside that cell and its vectors. Only the in-cell position takes part
+   in the arithmetic, so precision does not drop on large maps. */
+typedef struct FixedCamera
+{
+  int cellX;
+  int cellY;
+  Fixed fracX;
+  Fixed fracY;
+  Fixed dirX;
+  Fixed dirY;
+  Fixed planeX;
+  Fixed planeY;
+} FixedCamera;
+
+typedef struct FloatCamera
+{
+  int cellX;
+  int cellY;
+  float fracX;
+  float fracY;
+  float dirX;
+  float dirY;
+  float planeX;
+  float planeY;
+} FloatCamera;
+
+/* Hit of a low-precision cast in 16.16: `wallX` is where along the wall
+   face the ray landed, in [0, 1). */
+typedef struct RayHitFixed
+{
+  Fixed rayDirX;
+  Fixed rayDirY;
+  int mapX;
+  int mapY;
+  int side;
+  Fixed perpWallDist;
+  Fixed wallX;
+} RayHitFixed;
+
+/* cast_ray() in 16.16 fixed point and in float for the column at
+   camera-space `cameraX` (-1 at the left edge, 1 at the right). Steps
+   come from table reciprocals and the distance from the side distances,
+   so neither divides. Both step cell by cell, also on maps with skip
+   levels, and need fixed_init(). Each is only built with its backend. */
+#if RENDER_HAS_FIXED
+void fixed_camera(const Camera *cam, FixedCamera *out);
+void cast_ray_fixed(const Map *map, const FixedCamera *cam, Fixed cameraX,
+                    RayHitFixed *out);
+#endif
+#if RENDER_HAS_FLOAT
+void float_camera(const Camera *cam, FloatCamera *out);
+void cast_ray_float(const Map *map, const FloatCamera *cam, float cameraX,
+                    RayHitFixed *out);
+#endif
+
+#endif
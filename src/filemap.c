@@ -0,0 +1,106 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "filemap.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+void *file_map(const char *path, FileMapMode mode, size_t *size)
+{
+  const bool create = mode == FILEMAP_CREATE;
+  HANDLE file = CreateFileA(
+      path, create ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+      FILE_SHARE_READ, NULL, create ? CREATE_ALWAYS : OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return NULL;
+  if (!create)
+  {
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(file, &length) || length.QuadPart <= 0 ||
+        (uint64_t)length.QuadPart > SIZE_MAX)
+    {
+      CloseHandle(file);
+      return NULL;
+    }
+    *size = (size_t)length.QuadPart;
+  }
+
+  /* Copy-on-write pages play the part of MAP_PRIVATE; a mapping object
+     larger than a new file extends it. Both handles can close once the
+     view holds them. */
+  const uint64_t bytes = *size;
+  const DWORD protect = mode == FILEMAP_READ      ? PAGE_READONLY
+                        : mode == FILEMAP_PRIVATE ? PAGE_WRITECOPY
+                                                  : PAGE_READWRITE;
+  const DWORD access = mode == FILEMAP_READ      ? FILE_MAP_READ
+                       : mode == FILEMAP_PRIVATE ? FILE_MAP_COPY
+                                                 : FILE_MAP_WRITE;
+  HANDLE mapping = bytes > 0 ? CreateFileMappingA(file, NULL, protect,
+                                                  (DWORD)(bytes >> 32),
+                                                  (DWORD)bytes, NULL)
+                             : NULL;
+  CloseHandle(file);
+  if (!mapping)
+    return NULL;
+  void *base = MapViewOfFile(mapping, access, 0, 0, *size);
+  CloseHandle(mapping);
+  return base;
+}
+
+void file_unmap(void *base, size_t size)
+{
+  (void)size;
+  UnmapViewOfFile(base);
+}
+#else
+void *file_map(const char *path, FileMapMode mode, size_t *size)
+{
+  const bool create = mode == FILEMAP_CREATE;
+  int fd = create ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)
+                  : open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  bool ok = true;
+  if (create)
+  {
+    ok = ftruncate(fd, (off_t)*size) == 0;
+  }
+  else
+  {
+    struct stat st;
+    ok = fstat(fd, &st) == 0 && st.st_size > 0 &&
+         (uint64_t)st.st_size <= SIZE_MAX;
+    if (ok)
+      *size = (size_t)st.st_size;
+  }
+
+  /* MAP_PRIVATE keeps writes in memory while untouched pages stay shared
+     with the page cache; MAP_SHARED writes through to the file. */
+  void *base = MAP_FAILED;
+  if (ok && *size > 0)
+  {
+    const int prot =
+        mode == FILEMAP_READ ? PROT_READ : PROT_READ | PROT_WRITE;
+    base = mmap(NULL, *size, prot, create ? MAP_SHARED : MAP_PRIVATE, fd,
+                0);
+  }
+  close(fd);
+  return base == MAP_FAILED ? NULL : base;
+}
+
+void file_unmap(void *base, size_t size)
+{
+  munmap(base, size);
+}
+#endif
@@ -0,0 +1,22 @@
+#ifndef RAYCAST_FILEMAP_H
+#define RAYCAST_FILEMAP_H
+
+#include <stddef.h>
+
+/* How file_map() maps a file: read-only, writable with every write kept
+   in memory, or writable through to a file created at a given size. */
+typedef enum FileMapMode
+{
+  FILEMAP_READ,
+  FILEMAP_PRIVATE,
+  FILEMAP_CREATE
+} FileMapMode;
+
+/* Maps all of the file at `path`, with mmap() or, on Windows, a file
+   mapping object. FILEMAP_CREATE creates or truncates the file to `*size`
+   bytes; the other modes set `*size` to the file's size. Returns NULL,
+   without printing, when the file cannot be opened or mapped or is empty. */
+void *file_map(const char *path, FileMapMode mode, size_t *size);
+void file_unmap(void *base, size_t size);
+
+#endif
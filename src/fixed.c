@@ -0,0 +1,82 @@
+#include "fixed.h"
+
+#include <pthread.h>
+#include <string.h>
+
+/* 1 / m for mantissas m in [1, 2], 2^RECIP_BITS intervals, in Q31. */
+#define RECIP_BITS 10
+#define RECIP_SIZE (1 << RECIP_BITS)
+
+static uint32_t g_recip[RECIP_SIZE + 1];
+static pthread_once_t g_recip_once = PTHREAD_ONCE_INIT;
+
+static void build_recip(void)
+{
+  for (int i = 0; i <= RECIP_SIZE; ++i)
+  {
+    double m = 1.0 + (double)i / RECIP_SIZE;
+    g_recip[i] = (uint32_t)(2147483648.0 / m + 0.5);
+  }
+}
+
+void fixed_init(void)
+{
+  pthread_once(&g_recip_once, build_recip);
+}
+
+static int leading_zeros(uint32_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_clz(v);
+#else
+  int n = 0;
+  while (!(v & 0x80000000u))
+  {
+    v <<= 1;
+    ++n;
+  }
+  return n;
+#endif
+}
+
+/* Reciprocal of the mantissa whose top RECIP_BITS fraction bits are
+   `index` and whose remaining `frac_bits` bits are `frac`, in Q31. */
+static uint32_t mantissa_recip(uint32_t index, uint32_t frac, int frac_bits)
+{
+  uint32_t a = g_recip[index];
+  uint32_t b = g_recip[index + 1];
+  return a - (uint32_t)(((uint64_t)(a - b) * frac) >> frac_bits);
+}
+
+uint64_t fixed_recip(uint32_t v)
+{
+  /* v = m * 2^(31 - n) with m in [1, 2), so 2^32 / v = 2^(n + 1) / m. */
+  int n = leading_zeros(v);
+  uint32_t m = v << n;
+  const int frac_bits = 31 - RECIP_BITS;
+  uint32_t r = mantissa_recip((m >> frac_bits) & (RECIP_SIZE - 1),
+                              m & ((1u << frac_bits) - 1), frac_bits);
+  if (n >= 30)
+    return (uint64_t)r << (n - 30);
+  return ((uint64_t)r + (1ull << (29 - n))) >> (30 - n);
+}
+
+float float_recip(float v)
+{
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  int exponent = (int)(bits >> 23) & 0xFF;
+  /* Denormals, and values whose reciprocal would underflow, are divided. */
+  if (exponent == 0 || exponent > 222)
+    return 1.0f / v;
+
+  const int frac_bits = 23 - RECIP_BITS;
+  uint32_t mantissa = bits & 0x7FFFFF;
+  uint32_t r = mantissa_recip(mantissa >> frac_bits,
+                              mantissa & ((1u << frac_bits) - 1), frac_bits);
+  /* 1 / v = r * 2^-31 * 2^(127 - exponent). */
+  uint32_t scale_bits = (uint32_t)(223 - exponent) << 23;
+  float scale;
+  memcpy(&scale, &scale_bits, sizeof(scale));
+  return (float)r * scale;
+}
@@ -0,0 +1,36 @@
+#ifndef RAYCAST_FIXED_H
+#define RAYCAST_FIXED_H
+
+#include <stdint.h>
+
+/* 16.16 fixed point for the low-precision render backends. */
+typedef int32_t Fixed;
+
+#define FIXED_SHIFT 16
+#define FIXED_ONE (1 << FIXED_SHIFT)
+#define FIXED_FRACTION (FIXED_ONE - 1)
+
+static inline Fixed fixed_from_double(double v)
+{
+  return (Fixed)(v * FIXED_ONE + (v < 0.0 ? -0.5 : 0.5));
+}
+
+static inline Fixed fixed_mul(Fixed a, Fixed b)
+{
+  return (Fixed)(((int64_t)a * b) >> FIXED_SHIFT);
+}
+
+/* Builds the reciprocal table the first time it is called, from any
+   thread; call before the other functions. */
+void fixed_init(void);
+
+/* 2^32 / v for v > 0, from a table of mantissa reciprocals with linear
+   interpolation (about 22 significant bits) instead of a divide. For a
+   16.16 `v` that is 1 / v in 16.16; for an integer `v`, 65536 / v in
+   16.16. */
+uint64_t fixed_recip(uint32_t v);
+
+/* 1 / v for finite v > 0 from the same table. */
+float float_recip(float v);
+
+#endif
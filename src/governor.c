@@ -0,0 +1,80 @@
+#include "governor.h"
+
+#include <math.h>
+
+/* Frames skipped after a resize, and the weight of each new frame in the
+   running average. */
+#define GOVERNOR_SETTLE_FRAMES 8
+#define GOVERNOR_SMOOTHING 0.1
+/* Largest change of pixel count in one step, either way. */
+#define GOVERNOR_MAX_STEP 2.0
+
+static int clamp_int(int v, int lo, int hi)
+{
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static int fit_width(const ResolutionGovernor *g, double width)
+{
+  int w = (int)(width / GOVERNOR_COLUMN_STEP + 0.5) * GOVERNOR_COLUMN_STEP;
+  return clamp_int(w, g->min_width, g->max_width);
+}
+
+static int fit_height(const ResolutionGovernor *g, double height)
+{
+  return clamp_int((int)(height + 0.5), g->min_height, g->max_height);
+}
+
+void governor_init(ResolutionGovernor *g, int width, int height,
+                   double budget_ms)
+{
+  g->budget_ms = budget_ms;
+  g->max_width = width;
+  g->max_height = height;
+  g->min_width = width / 2 / GOVERNOR_COLUMN_STEP * GOVERNOR_COLUMN_STEP;
+  if (g->min_width < GOVERNOR_COLUMN_STEP)
+    g->min_width = width < GOVERNOR_COLUMN_STEP ? width : GOVERNOR_COLUMN_STEP;
+  g->min_height = height / 2 > 0 ? height / 2 : 1;
+  g->width = width;
+  g->height = height;
+  g->average_ms = 0.0;
+  g->settle = GOVERNOR_SETTLE_FRAMES;
+}
+
+bool governor_update(ResolutionGovernor *g, double frame_ms)
+{
+  if (g->settle > 0)
+  {
+    --g->settle;
+    return false;
+  }
+  if (g->average_ms <= 0.0)
+    g->average_ms = frame_ms;
+  else
+    g->average_ms += GOVERNOR_SMOOTHING * (frame_ms - g->average_ms);
+
+  double load = g->average_ms / g->budget_ms;
+  if (load <= 1.0 && load >= GOVERNOR_GROW_BELOW)
+    return false;
+
+  double scale = (1.0 + GOVERNOR_GROW_BELOW) / 2.0 / load;
+  if (scale > GOVERNOR_MAX_STEP)
+    scale = GOVERNOR_MAX_STEP;
+  if (scale < 1.0 / GOVERNOR_MAX_STEP)
+    scale = 1.0 / GOVERNOR_MAX_STEP;
+
+  /* Both axes by the square root; when one is pinned at its limit the
+     other takes up the rest. */
+  double pixels = (double)g->width * g->height * scale;
+  int width = fit_width(g, g->width * sqrt(scale));
+  int height = fit_height(g, pixels / width);
+  width = fit_width(g, pixels / height);
+  if (width == g->width && height == g->height)
+    return false;
+
+  g->width = width;
+  g->height = height;
+  g->average_ms = 0.0;
+  g->settle = GOVERNOR_SETTLE_FRAMES;
+  return true;
+}
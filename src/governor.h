@@ -0,0 +1,37 @@
+#ifndef RAYCAST_GOVERNOR_H
+#define RAYCAST_GOVERNOR_H
+
+#include <stdbool.h>
+
+/* Dynamic resolution: picks the internal render size that holds a frame
+   time budget, between half and all of the output size on each axis. Feed
+   it the render time of every frame; when the smoothed time leaves the
+   band between GOVERNOR_GROW_BELOW and 1.0 of the budget it rescales the
+   column and row counts for the middle of the band, taking cost as
+   proportional to pixels. Widths stay multiples of GOVERNOR_COLUMN_STEP
+   so ray packets stay full. A few frames after each change are ignored
+   while caches and per-size tables warm up. */
+#define GOVERNOR_GROW_BELOW 0.75
+#define GOVERNOR_COLUMN_STEP 8
+
+typedef struct ResolutionGovernor
+{
+  double budget_ms;
+  int max_width;
+  int max_height;
+  int min_width;
+  int min_height;
+  int width;
+  int height;
+  double average_ms;
+  int settle;
+} ResolutionGovernor;
+
+/* Starts at the full `width` x `height`. */
+void governor_init(ResolutionGovernor *governor, int width, int height,
+                   double budget_ms);
+/* Takes the render time of a frame drawn at the current size; returns true
+   when width/height changed. */
+bool governor_update(ResolutionGovernor *governor, double frame_ms);
+
+#endif
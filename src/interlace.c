@@ -0,0 +1,537 @@
+#include "interlace.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Rows of a row-major target, or columns of a column-major one, rebuilt
+   per work item. */
+#define INTERLACE_BAND 32
+
+/* Where a missing column comes from: `previous`, when set, is row 0 of a
+   column of the previous half frame and `left` and `right` those of its
+   neighbours in the target, averaged where `previous` is not used
+   (`right` is NULL at the edges). Output row y, at offset o = 2y - h from
+   the horizon, reads row (h + o') / 2 of `previous`: o' = o * rowScale on
+   the wall, |o| < wallRows, and o' = h * o / (shift * |o| + slope * h)
+   on the floor and ceiling, which are at distance h / |o| and were at
+   shift + slope times that from the previous camera. Rows from nearRows
+   on, all of them without `previous`, are floor the step has moved too
+   far across to reuse. */
+typedef struct ColumnSource
+{
+  const uint32_t *previous;
+  const uint32_t *left;
+  const uint32_t *right;
+  double rowScale;
+  double shift;
+  double slope;
+  double wallRows;
+  double nearRows;
+  const double *depth;
+  const double *otherDepth;
+} ColumnSource;
+
+/* halves[p] holds the columns of parity p of the last frame drawn with
+   that parity, seen from cams[p], (width + 1) / 2 columns laid out like
+   the target; depths[p] their wall distances. `sources` plans the
+   missing columns of the current frame. */
+struct Interlace
+{
+  uint32_t *halves[2];
+  double *depths[2];
+  ColumnSource *sources;
+  int width;
+  int height;
+  bool column_major;
+  bool drawn[2];
+  Camera cams[2];
+  const Map *map;
+  unsigned revision;
+  int parity;
+};
+
+typedef struct RebuildJob
+{
+  const Interlace *interlace;
+  const Framebuffer *fb;
+  int parity;
+  bool still;
+} RebuildJob;
+
+Interlace *interlace_create(void)
+{
+  Interlace *interlace = calloc(1, sizeof(*interlace));
+  if (!interlace)
+    fprintf(stderr, "Out of memory for the interlaced frames\n");
+  return interlace;
+}
+
+static void release_buffers(Interlace *interlace)
+{
+  for (int p = 0; p < 2; ++p)
+  {
+    free(interlace->halves[p]);
+    free(interlace->depths[p]);
+    interlace->halves[p] = NULL;
+    interlace->depths[p] = NULL;
+  }
+  free(interlace->sources);
+  interlace->sources = NULL;
+  interlace->width = 0;
+}
+
+void interlace_destroy(Interlace *interlace)
+{
+  if (!interlace)
+    return;
+  release_buffers(interlace);
+  free(interlace);
+}
+
+void interlace_reset(Interlace *interlace)
+{
+  interlace->drawn[0] = false;
+  interlace->drawn[1] = false;
+}
+
+/* Half frames shaped for `fb`, or false when they do not fit in memory. */
+static bool interlace_prepare(Interlace *interlace, const Framebuffer *fb)
+{
+  if (interlace->width == fb->width && interlace->height == fb->height &&
+      interlace->column_major == fb->column_major)
+    return true;
+
+  release_buffers(interlace);
+  interlace_reset(interlace);
+  const size_t columns = (size_t)(fb->width + 1) / 2;
+  const size_t texels = columns * (size_t)fb->height;
+  bool ok = true;
+  for (int p = 0; p < 2; ++p)
+  {
+    interlace->halves[p] = malloc(sizeof(uint32_t) * texels);
+    interlace->depths[p] = malloc(sizeof(double) * columns);
+    ok = ok && interlace->halves[p] && interlace->depths[p];
+  }
+  interlace->sources = malloc(sizeof(ColumnSource) * columns);
+  if (!ok || !interlace->sources)
+  {
+    release_buffers(interlace);
+    return false;
+  }
+  interlace->width = fb->width;
+  interlace->height = fb->height;
+  interlace->column_major = fb->column_major;
+  return true;
+}
+
+static bool same_camera(const Camera *a, const Camera *b)
+{
+  return a->posX == b->posX && a->posY == b->posY && a->dirX == b->dirX &&
+         a->dirY == b->dirY && a->planeX == b->planeX &&
+         a->planeY == b->planeY;
+}
+
+/* Distance of the wall in the missing column between two columns at
+   `left` and `right`, or false when they disagree by more than
+   INTERLACE_MATCH_DEPTH, as at the edge of a wall: the inverse distance
+   to a plane is linear across the screen. */
+static bool between_depth(double left, double right, double *depth)
+{
+  if (fabs(left - right) > INTERLACE_MATCH_DEPTH * fmin(left, right))
+    return false;
+  *depth = 2.0 * left * right / (left + right);
+  return true;
+}
+
+/* Whether column x of the frame seen from `cam`, whose wall is `depth`
+   away, can come from column j of the half frame of parity `parity` seen
+   from `prev`, with wall distances `prevDepths`, and how its rows map:
+   the point `depth` along the ray must project within
+   INTERLACE_MATCH_COLUMNS of column j and, when the camera has moved, at
+   the distance column j saw its wall. In place every point of the ray
+   lands on the same previous ray, so any `depth` will do. */
+static bool match_column(const Camera *cam, const Camera *prev, int width,
+                         int height, int x, int parity, int halfWidth,
+                         double depth, const double *prevDepths, int *j,
+                         ColumnSource *source)
+{
+  double cameraX = 2.0 * x / (double)width - 1.0;
+  double rayDirX = cam->dirX + cam->planeX * cameraX;
+  double rayDirY = cam->dirY + cam->planeY * cameraX;
+
+  /* Point D along the ray, seen from the previous camera: shift + slope * D
+     along its view axis and across + spread * D along its plane. */
+  const double moveX = cam->posX - prev->posX;
+  const double moveY = cam->posY - prev->posY;
+  const double dirNorm = prev->dirX * prev->dirX + prev->dirY * prev->dirY;
+  const double planeNorm =
+      prev->planeX * prev->planeX + prev->planeY * prev->planeY;
+  const double shift = (moveX * prev->dirX + moveY * prev->dirY) / dirNorm;
+  const double slope =
+      (rayDirX * prev->dirX + rayDirY * prev->dirY) / dirNorm;
+  const double across =
+      (moveX * prev->planeX + moveY * prev->planeY) / planeNorm;
+  const double spread =
+      (rayDirX * prev->planeX + rayDirY * prev->planeY) / planeNorm;
+  const double prevDepth = shift + slope * depth;
+  if (!(prevDepth > 0.0) || !(slope > 0.0))
+    return false;
+  const double column =
+      ((across + spread * depth) / prevDepth + 1.0) * width / 2.0;
+  int index = (int)floor((column - parity) / 2.0 + 0.5);
+  const double target = 2.0 * index + parity;
+  if (index < 0 || index >= halfWidth ||
+      fabs(target - column) > INTERLACE_MATCH_COLUMNS)
+    return false;
+  const bool moved = moveX != 0.0 || moveY != 0.0;
+  if (moved && fabs(prevDepths[index] - prevDepth) >
+                   INTERLACE_MATCH_DEPTH * prevDepth)
+    return false;
+
+  /* Nearer floor drifts across the previous columns as the camera moves:
+     the rows of the nearest distance still within the window. */
+  double nearest = 0.0;
+  for (int side = -1; moved && side <= 1; side += 2)
+  {
+    double p = 2.0 * (target + side * INTERLACE_MATCH_COLUMNS) / width - 1.0;
+    double den = spread - p * slope;
+    double d = den != 0.0 ? (p * shift - across) / den : 0.0;
+    if (d > nearest && d < depth)
+      nearest = d;
+  }
+  if (moved && -shift / slope > nearest)
+    nearest = -shift / slope;
+
+  *j = index;
+  source->rowScale = depth / prevDepth;
+  source->shift = shift;
+  source->slope = slope;
+  source->wallRows = moved ? height / depth : INFINITY;
+  source->nearRows = nearest > 0.0 ? height / nearest : INFINITY;
+  return true;
+}
+
+/* Plans the missing columns of parity 1 - `parity` of `fb`, whose other
+   columns are drawn, seen from `cam`; returns how many are filled from
+   their neighbours. */
+static int plan_columns(Interlace *interlace, const Framebuffer *fb,
+                        const Camera *cam, int parity)
+{
+  const int width = interlace->width;
+  const int missing = 1 - parity;
+  const int halfWidth = (width + 1 - parity) / 2;
+  const int missingWidth = (width + 1 - missing) / 2;
+  const size_t columnStride =
+      interlace->column_major ? (size_t)interlace->height : 1;
+  const size_t targetStride = fb->column_major ? (size_t)fb->pitch : 1;
+  const uint32_t *previous = interlace->halves[missing];
+  const double *depths = interlace->depths[parity];
+  const Camera *prev = &interlace->cams[missing];
+  const bool moved = prev->posX != cam->posX || prev->posY != cam->posY;
+
+  bool reuse = interlace->drawn[missing];
+  if (reuse)
+  {
+    double cross = prev->dirX * cam->dirY - prev->dirY * cam->dirX;
+    double dot = prev->dirX * cam->dirX + prev->dirY * cam->dirY;
+    reuse = fabs(atan2(cross, dot)) <= INTERLACE_MAX_TURN;
+  }
+
+  int spatial = 0;
+  for (int k = 0; k < missingWidth; ++k)
+  {
+    const int x = 2 * k + missing;
+    ColumnSource *source = &interlace->sources[k];
+
+    /* Neighbours x - 1 and x + 1 are columns (x - 1) / 2 and (x + 1) / 2
+       of the current half. */
+    int left = x > 0 ? (x - 1) / 2 : -1;
+    int right = x + 1 < width ? (x + 1) / 2 : -1;
+    if (left < 0)
+      left = right;
+    if (right < 0 || right >= halfWidth)
+      right = left;
+    source->left = fb->pixels + (size_t)(2 * left + parity) * targetStride;
+    source->right =
+        right != left
+            ? fb->pixels + (size_t)(2 * right + parity) * targetStride
+            : NULL;
+
+    int j;
+    double depth = 1.0;
+    if (reuse &&
+        (!moved || between_depth(depths[left], depths[right], &depth)) &&
+        match_column(cam, prev, width, interlace->height, x, missing,
+                     missingWidth, depth, interlace->depths[missing], &j,
+                     source))
+    {
+      source->previous = previous + (size_t)j * columnStride;
+      source->depth = interlace->depths[missing] + j;
+      source->otherDepth = NULL;
+      continue;
+    }
+
+    source->previous = NULL;
+    source->nearRows = 0.0;
+    source->rowScale = 1.0;
+    source->depth = depths + left;
+    source->otherDepth = right != left ? depths + right : NULL;
+    ++spatial;
+  }
+  return spatial;
+}
+
+/* Per-channel mean of two pixels, rounded down. */
+static uint32_t mean_color(uint32_t a, uint32_t b)
+{
+  return ((a & 0xFEFEFEFE) >> 1) + ((b & 0xFEFEFEFE) >> 1) +
+         (a & b & 0x01010101);
+}
+
+/* Row y, at `offset` = 2y - h from the horizon, of a missing column
+   whose rows are `rowStride` apart in the target and `halfStride` apart
+   in the half frames. */
+static inline uint32_t source_texel(const ColumnSource *source, int y, int h,
+                                    double offset, size_t rowStride,
+                                    size_t halfStride)
+{
+  const double rows = fabs(offset);
+  if (rows >= source->nearRows)
+  {
+    const uint32_t left = source->left[y * rowStride];
+    return source->right ? mean_color(left, source->right[y * rowStride])
+                         : left;
+  }
+  double scaled = offset * source->rowScale;
+  if (rows >= source->wallRows)
+    scaled = h * offset / (source->shift * rows + source->slope * h);
+  double row = (h + scaled) * 0.5 + 0.5;
+  y = row > 0.0 ? (int)row : 0;
+  y = y < h ? y : h - 1;
+  return source->previous[y * halfStride];
+}
+
+/* The pixels of parity `parity` of a row `w` pixels long kept in
+   `current`, and, when `previous` is set, the others taken from it; eight
+   pixels at a time with SSE2. */
+static void interleave_row(uint32_t *row, uint32_t *current,
+                           const uint32_t *previous, int w, int parity)
+{
+  int x = 0;
+#if defined(__SSE2__)
+  for (; x + 8 <= w; x += 8)
+  {
+    __m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(row + x)));
+    __m128 b =
+        _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(row + x + 4)));
+    __m128i drawn = _mm_castps_si128(
+        parity ? _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))
+               : _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_si128((__m128i *)(current + x / 2), drawn);
+    if (!previous)
+      continue;
+    __m128i other = _mm_loadu_si128((const __m128i *)(previous + x / 2));
+    __m128i even = parity ? other : drawn;
+    __m128i odd = parity ? drawn : other;
+    _mm_storeu_si128((__m128i *)(row + x), _mm_unpacklo_epi32(even, odd));
+    _mm_storeu_si128((__m128i *)(row + x + 4),
+                     _mm_unpackhi_epi32(even, odd));
+  }
+#endif
+  for (; x < w; ++x)
+  {
+    if ((x & 1) == parity)
+      current[x / 2] = row[x];
+    else if (previous)
+      row[x] = previous[x / 2];
+  }
+}
+
+/* Rows [y0, y1) of a row-major target: the drawn columns kept in the
+   current half frame, and the missing ones filled from the previous half
+   or from the planned sources. */
+static void rebuild_rows(const RebuildJob *job, int y0, int y1)
+{
+  const Interlace *interlace = job->interlace;
+  const Framebuffer *fb = job->fb;
+  const int w = fb->width;
+  const int parity = job->parity;
+  const int missing = 1 - parity;
+  const size_t halfPitch = (size_t)(w + 1) / 2;
+  const size_t pitch = (size_t)fb->pitch;
+  for (int y = y0; y < y1; ++y)
+  {
+    uint32_t *row = fb->pixels + (size_t)y * pitch;
+    uint32_t *current = interlace->halves[parity] + y * halfPitch;
+    if (job->still)
+    {
+      interleave_row(row, current, interlace->halves[missing] + y * halfPitch,
+                     w, parity);
+      continue;
+    }
+    interleave_row(row, current, NULL, w, parity);
+    /* Away from the edges the neighbours are the row's own pixels. */
+    const double offset = 2.0 * y - fb->height;
+    const double rows = fabs(offset);
+    for (int x = missing; x < w; x += 2)
+    {
+      const ColumnSource *source = &interlace->sources[x / 2];
+      if (x > 0 && x + 1 < w && rows >= source->nearRows)
+        row[x] = mean_color(row[x - 1], row[x + 1]);
+      else
+        row[x] = source_texel(source, y, fb->height, offset, pitch,
+                              halfPitch);
+    }
+  }
+}
+
+/* Columns [x0, x1) of a column-major target: drawn ones copied into the
+   current half frame, missing ones copied whole from the previous half
+   unless their rows are mixed or stretched. */
+static void rebuild_columns(const RebuildJob *job, int x0, int x1)
+{
+  const Interlace *interlace = job->interlace;
+  const Framebuffer *fb = job->fb;
+  const int h = fb->height;
+  const size_t bytes = sizeof(uint32_t) * h;
+  for (int x = x0; x < x1; ++x)
+  {
+    uint32_t *column = fb->pixels + (size_t)x * fb->pitch;
+    uint32_t *half = interlace->halves[x & 1] + (size_t)(x / 2) * h;
+    if ((x & 1) == job->parity)
+    {
+      memcpy(half, column, bytes);
+      continue;
+    }
+    if (job->still)
+    {
+      memcpy(column, half, bytes);
+      continue;
+    }
+    const ColumnSource *source = &interlace->sources[x / 2];
+    if (!source->previous && source->right)
+    {
+      for (int y = 0; y < h; ++y)
+        column[y] = mean_color(source->left[y], source->right[y]);
+      continue;
+    }
+    for (int y = 0; y < h; ++y)
+      column[y] = source_texel(source, y, h, 2.0 * y - h, 1, 1);
+  }
+}
+
+static void rebuild_band(void *arg, int band, int worker)
+{
+  (void)worker;
+  const RebuildJob *job = arg;
+  const int size = job->fb->column_major ? job->fb->width : job->fb->height;
+  const int begin = band * INTERLACE_BAND;
+  const int end = begin + INTERLACE_BAND < size ? begin + INTERLACE_BAND
+                                                : size;
+  if (job->fb->column_major)
+    rebuild_columns(job, begin, end);
+  else
+    rebuild_rows(job, begin, end);
+}
+
+/* Wall distances of the rebuilt columns: a stretched column is nearer by
+   its row scale, and one between two neighbours takes the nearer. */
+static void rebuild_depth(const RebuildJob *job, double *depth)
+{
+  const Interlace *interlace = job->interlace;
+  const int parity = job->parity;
+  for (int x = 0; x < interlace->width; ++x)
+  {
+    const int half = x & 1;
+    if (half == parity || job->still)
+    {
+      depth[x] = interlace->depths[half][x / 2];
+      continue;
+    }
+    const ColumnSource *source = &interlace->sources[x / 2];
+    depth[x] = *source->depth * source->rowScale;
+    if (source->otherDepth && *source->otherDepth < depth[x])
+      depth[x] = *source->otherDepth;
+  }
+}
+
+int interlace_frame(Interlace *interlace, const Map *map,
+                    const Framebuffer *fb, const Camera *cam,
+                    const Texture *textures, int texture_count,
+                    const RenderOptions *options, WorkerPool *pool)
+{
+  if (fb->width < 2 || !interlace_prepare(interlace, fb))
+  {
+    render_frame_map(map, fb, cam, textures, texture_count, options, pool);
+    return 0;
+  }
+  if (interlace->map != map || interlace->revision != map->revision)
+  {
+    interlace_reset(interlace);
+    interlace->map = map;
+    interlace->revision = map->revision;
+  }
+
+  const int parity = interlace->parity;
+  RenderOptions halfOptions = {FLOOR_COLUMNS, false, NULL, 1, 0};
+  if (options)
+    halfOptions = *options;
+  halfOptions.depth = interlace->depths[parity];
+  halfOptions.column_step = 2;
+  halfOptions.column_first = parity;
+  render_frame_map(map, fb, cam, textures, texture_count, &halfOptions,
+                   pool);
+
+  const int missing = 1 - parity;
+  RebuildJob job = {interlace, fb, parity, false};
+  job.still = interlace->drawn[missing] &&
+              same_camera(cam, &interlace->cams[missing]);
+  int spatial = 0;
+  if (!job.still)
+    spatial = plan_columns(interlace, fb, cam, parity);
+  const int size = fb->column_major ? fb->width : fb->height;
+  worker_pool_run(pool, (size + INTERLACE_BAND - 1) / INTERLACE_BAND,
+                  rebuild_band, &job);
+  if (options && options->depth)
+    rebuild_depth(&job, options->depth);
+
+  interlace->cams[parity] = *cam;
+  interlace->drawn[parity] = true;
+  interlace->parity = missing;
+  return spatial;
+}
+
+static uint32_t framebuffer_pixel(const Framebuffer *fb, int x, int y)
+{
+  return fb->column_major ? fb->pixels[(size_t)x * fb->pitch + y]
+                          : fb->pixels[(size_t)y * fb->pitch + x];
+}
+
+double framebuffer_psnr(const Framebuffer *reference,
+                        const Framebuffer *test)
+{
+  uint64_t sum = 0;
+  for (int y = 0; y < reference->height; ++y)
+  {
+    for (int x = 0; x < reference->width; ++x)
+    {
+      uint32_t a = framebuffer_pixel(reference, x, y);
+      uint32_t b = framebuffer_pixel(test, x, y);
+      for (int shift = 0; shift < 24; shift += 8)
+      {
+        int d = (int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF);
+        sum += (uint64_t)(d * d);
+      }
+    }
+  }
+  if (sum == 0)
+    return INFINITY;
+  double mse = (double)sum / (3.0 * reference->width * reference->height);
+  return 10.0 * log10(255.0 * 255.0 / mse);
+}
@@ -0,0 +1,51 @@
+#ifndef RAYCAST_INTERLACE_H
+#define RAYCAST_INTERLACE_H
+
+#include "render.h"
+
+/* Interlaced frames: each frame casts and shades only the columns of one
+   parity, alternating, with their rays of the whole frame, and rebuilds
+   the other half in place. A missing column takes the column of the last
+   frame of the other parity that saw its wall within
+   INTERLACE_MATCH_COLUMNS of its own ray, with the rows moved for the
+   change in distance: wall rows by the ratio of the two wall distances,
+   floor and ceiling rows by their own. In place every point of a ray lands
+   on the same previous ray. After a step the column's wall distance is
+   taken between its two neighbours, which must agree within
+   INTERLACE_MATCH_DEPTH, and the previous column must have seen its wall
+   that far within the same fraction; floor near enough for the step to
+   move it further across than the window comes from the neighbours. Reuse
+   needs a turn of less than INTERLACE_MAX_TURN radians since, on the same
+   map revision. Otherwise, after a fast turn or an edit, or where the
+   distances disagree, a column is the mean of its two neighbours. A still
+   camera thus gets exactly the whole frame from the second one on. */
+#define INTERLACE_MATCH_COLUMNS 0.25
+#define INTERLACE_MAX_TURN 0.05
+#define INTERLACE_MATCH_DEPTH 0.02
+
+typedef struct Interlace Interlace;
+
+/* Prints why and returns NULL on failure. */
+Interlace *interlace_create(void);
+void interlace_destroy(Interlace *interlace);
+/* Forgets the previous frames, for changes the camera and the map's
+   revision do not show, such as new textures or lighting. */
+void interlace_reset(Interlace *interlace);
+
+/* render_frame_map() at about half the cost. `options->depth`, when set,
+   is rebuilt like the pixels. Returns the number of columns filled from
+   their neighbours, 0 once a still camera has converged; frames narrower
+   than two columns, or for which memory runs out, are drawn whole and
+   return 0. */
+int interlace_frame(Interlace *interlace, const Map *map,
+                    const Framebuffer *fb, const Camera *cam,
+                    const Texture *textures, int texture_count,
+                    const RenderOptions *options, WorkerPool *pool);
+
+/* Peak signal-to-noise ratio of `test` against `reference` over the RGB
+   channels, in dB: the error metric of lossy frames, INFINITY when they
+   are identical. Both have the same size and may differ in layout. */
+double framebuffer_psnr(const Framebuffer *reference,
+                        const Framebuffer *test);
+
+#endif
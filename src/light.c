@@ -0,0 +1,116 @@
+#include "light.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Channel value `v` at light level `level`: a linear ramp to black. */
+static uint8_t ramp(int level, int v)
+{
+  return (uint8_t)((v * level + (MAP_LIGHT_LEVELS - 1) / 2) /
+                   (MAP_LIGHT_LEVELS - 1));
+}
+
+void lighting_init(Lighting *lighting, double fog_distance, int side_drop)
+{
+  lighting->fog_rate = fog_distance > 0.0 ? 1.0 / fog_distance : 0.0;
+  lighting->side_drop = side_drop > 0 ? side_drop : 0;
+  for (int level = 0; level < MAP_LIGHT_LEVELS; ++level)
+  {
+    for (int v = 0; v < 256; ++v)
+      lighting->shade[level][v] = ramp(level, v);
+  }
+}
+
+bool light_build_palette(Texture *tex)
+{
+  if (tex->lit)
+    return true;
+  if (!tex->palette)
+  {
+    fprintf(stderr, "Lit palettes need an indexed texture\n");
+    return false;
+  }
+  tex->lit = malloc(sizeof(uint32_t) * MAP_LIGHT_LEVELS *
+                    TEXTURE_PALETTE_SIZE);
+  if (!tex->lit)
+  {
+    fprintf(stderr, "Out of memory for lit palettes\n");
+    return false;
+  }
+  for (int level = 0; level < MAP_LIGHT_LEVELS; ++level)
+  {
+    uint32_t *row = tex->lit + level * TEXTURE_PALETTE_SIZE;
+    for (int i = 0; i < TEXTURE_PALETTE_SIZE; ++i)
+    {
+      uint32_t c = tex->palette[i];
+      uint32_t red = ramp(level, (c >> 16) & 0xFF);
+      uint32_t green = ramp(level, (c >> 8) & 0xFF);
+      row[i] = (c & 0xFF000000) | red << 16 | green << 8 |
+               ramp(level, c & 0xFF);
+    }
+  }
+  return true;
+}
+
+bool light_build_texels(Texture *tex)
+{
+  if (tex->shaded)
+    return true;
+  const size_t texels = (size_t)tex->width * tex->height;
+  tex->shaded = malloc(sizeof(uint32_t) * MAP_LIGHT_LEVELS * texels);
+  if (!tex->shaded)
+  {
+    fprintf(stderr, "Out of memory for lit texels\n");
+    return false;
+  }
+  for (int level = 0; level < MAP_LIGHT_LEVELS; ++level)
+  {
+    uint32_t *out = tex->shaded + level * texels;
+    for (int x = 0; x < tex->width; ++x)
+    {
+      for (int y = 0; y < tex->height; ++y)
+      {
+        uint32_t c = tex->pixels[(size_t)y * tex->width + x];
+        uint32_t red = ramp(level, (c >> 16) & 0xFF);
+        uint32_t green = ramp(level, (c >> 8) & 0xFF);
+        *out++ = (c & 0xFF000000) | red << 16 | green << 8 |
+                 ramp(level, c & 0xFF);
+      }
+    }
+  }
+  return true;
+}
+
+static uint32_t next_random(uint32_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+void light_scatter(MapLight *lights, int count, const Map *map,
+                   uint32_t seed)
+{
+  uint32_t state = seed ? seed : 2463534242u;
+  for (int i = 0; i < count; ++i)
+  {
+    int x = map->spawn_x;
+    int y = map->spawn_y;
+    for (int attempt = 0; i > 0 && attempt < 64; ++attempt)
+    {
+      uint32_t r = next_random(&state);
+      int cx = (int)(r % (uint32_t)map->width);
+      int cy = (int)((r >> 16) % (uint32_t)map->height);
+      if (map_tile(map, cx, cy) == 0)
+      {
+        x = cx;
+        y = cy;
+        break;
+      }
+    }
+    int half = MAP_LIGHT_LEVELS / 2;
+    lights[i] = (MapLight){x, y,
+                           half + (int)(next_random(&state) % (uint32_t)half)};
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef RAYCAST_LIGHT_H
+#define RAYCAST_LIGHT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "map.h"
+#include "texture.h"
+
+/* Diminishing light for render_set_lighting(). A surface's level is its
+   cell's baked level (map->light, the brightest on an unlit map) less one
+   level per `fog_distance` of depth, so the scene fades to black with
+   distance; y-side walls lose `side_drop` levels more instead of having
+   their colour halved. The level is picked once per wall column and once
+   per cell run of a floor row. `shade[l][v]` is channel value v at level
+   l: three table reads light a texel of a texture without lit palettes
+   or lit texels, which take one. */
+typedef struct Lighting
+{
+  double fog_rate;
+  int side_drop;
+  uint8_t shade[MAP_LIGHT_LEVELS][256];
+} Lighting;
+
+/* A `fog_distance` of 0 or less turns the fog off. */
+void lighting_init(Lighting *lighting, double fog_distance, int side_drop);
+
+/* Builds tex->lit from an indexed texture's palette (see texture.h): the
+   (light level, texel) table lit walls and floors read directly, so they
+   cost what unlit indexed ones do. The levels do not depend on the
+   Lighting's fog or sides. Prints why and returns false on failure. */
+bool light_build_palette(Texture *tex);
+
+/* light_build_palette() for a texture without a palette: builds
+   tex->shaded, level 0 at every light level (128 bytes per texel), so lit
+   walls and floors read one texel as unlit ones do. Prints why and
+   returns false on failure. */
+bool light_build_texels(Texture *tex);
+
+/* `count` lights in empty cells of `map`, at levels from half the range
+   to the brightest, the first at the spawn cell. */
+void light_scatter(MapLight *lights, int count, const Map *map,
+                   uint32_t seed);
+
+#endif
@@ -0,0 +1,531 @@
+#include "map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filemap.h"
+
+/* Keeps bitset word indices and byte offsets comfortably inside int and
+   size_t on every target. */
+#define MAP_MAX_SIZE 65536
+
+int map_row_words(int width)
+{
+  return (width + 31) / 32;
+}
+
+static size_t occupancy_bytes(int width, int height)
+{
+  return (size_t)map_row_words(width) * (size_t)height * sizeof(uint32_t);
+}
+
+static size_t file_size(int width, int height)
+{
+  return sizeof(MapFileHeader) + occupancy_bytes(width, height) +
+         (size_t)width * (size_t)height;
+}
+
+static void map_point_into(Map *map, void *base, int width, int height)
+{
+  map->width = width;
+  map->height = height;
+  map->row_words = map_row_words(width);
+  map->occupancy = (uint32_t *)((char *)base + sizeof(MapFileHeader));
+  map->tiles = (uint8_t *)map->occupancy + occupancy_bytes(width, height);
+}
+
+void map_wrap(Map *map, uint8_t *tiles, uint32_t *occupancy, int width,
+              int height)
+{
+  memset(map, 0, sizeof(*map));
+  map->width = width;
+  map->height = height;
+  map->row_words = map_row_words(width);
+  map->tiles = tiles;
+  map->occupancy = occupancy;
+  memset(occupancy, 0, occupancy_bytes(width, height));
+  for (int y = 0; y < height; ++y)
+  {
+    for (int x = 0; x < width; ++x)
+    {
+      if (tiles[(size_t)y * width + x])
+      {
+        occupancy[y * map->row_words + x / 32] |= 1u << (x % 32);
+      }
+    }
+  }
+}
+
+bool map_load(Map *map, const char *path)
+{
+  memset(map, 0, sizeof(*map));
+  /* Private and writable: tile edits stay in memory and never reach the
+     file, and untouched pages are shared with the page cache. */
+  size_t size;
+  void *base = file_map(path, FILEMAP_PRIVATE, &size);
+  if (!base)
+  {
+    fprintf(stderr, "Unable to map %s\n", path);
+    return false;
+  }
+  if (size < sizeof(MapFileHeader))
+  {
+    fprintf(stderr, "Map %s is truncated\n", path);
+    file_unmap(base, size);
+    return false;
+  }
+
+  const MapFileHeader *header = base;
+  if (memcmp(header->magic, MAP_FILE_MAGIC, 4) != 0 ||
+      header->version != MAP_FILE_VERSION || header->width == 0 ||
+      header->height == 0 || header->width > MAP_MAX_SIZE ||
+      header->height > MAP_MAX_SIZE ||
+      header->row_words != (uint32_t)map_row_words((int)header->width) ||
+      size < file_size((int)header->width, (int)header->height) ||
+      header->spawn_x >= header->width || header->spawn_y >= header->height)
+  {
+    fprintf(stderr, "%s is not a valid map file\n", path);
+    file_unmap(base, size);
+    return false;
+  }
+
+  map_point_into(map, base, (int)header->width, (int)header->height);
+  map->spawn_x = (int)header->spawn_x;
+  map->spawn_y = (int)header->spawn_y;
+  map->mapping = base;
+  map->mapping_size = size;
+  return true;
+}
+
+bool map_create(Map *map, const char *path, int width, int height)
+{
+  memset(map, 0, sizeof(*map));
+  if (width <= 0 || height <= 0 || width > MAP_MAX_SIZE ||
+      height > MAP_MAX_SIZE)
+  {
+    fprintf(stderr, "Map size %dx%d is out of range\n", width, height);
+    return false;
+  }
+  size_t size = file_size(width, height);
+  void *base = file_map(path, FILEMAP_CREATE, &size);
+  if (!base)
+  {
+    fprintf(stderr, "Unable to create map %s\n", path);
+    return false;
+  }
+
+  MapFileHeader *header = base;
+  memcpy(header->magic, MAP_FILE_MAGIC, 4);
+  header->version = MAP_FILE_VERSION;
+  header->width = (uint32_t)width;
+  header->height = (uint32_t)height;
+  header->row_words = (uint32_t)map_row_words(width);
+
+  map_point_into(map, base, width, height);
+  map->mapping = base;
+  map->mapping_size = size;
+  return true;
+}
+
+void map_release(Map *map)
+{
+  if (map->mapping)
+  {
+    file_unmap(map->mapping, map->mapping_size);
+  }
+  for (int level = 0; level < map->skip_levels; ++level)
+  {
+    free(map->skip[level]);
+  }
+  free(map->doors);
+  free(map->door_bits);
+  free(map->moving);
+  free(map->light);
+  memset(map, 0, sizeof(*map));
+}
+
+static int skip_size(int cells, int level)
+{
+  int shift = MAP_SKIP_SHIFT * (level + 1);
+  return (cells + (1 << shift) - 1) >> shift;
+}
+
+/* Bitset of level `level - 1` (the occupancy itself for level 0) with its
+   row count and words per row. */
+static const uint32_t *skip_source(const Map *map, int level, int *height,
+                                   int *row_words)
+{
+  if (level == 0)
+  {
+    *height = map->height;
+    *row_words = map->row_words;
+    return map->occupancy;
+  }
+  *height = skip_size(map->height, level - 1);
+  *row_words = map->skip_row_words[level - 1];
+  return map->skip[level - 1];
+}
+
+/* Recomputes the bit of block (bx, by) of `level` from the 8 x 8 source
+   bits it covers. Eight divides 32, so each source row contributes one
+   byte of one word. */
+static void refresh_skip_bit(Map *map, int level, int bx, int by)
+{
+  int height;
+  int row_words;
+  const uint32_t *src = skip_source(map, level, &height, &row_words);
+
+  const int span = 1 << MAP_SKIP_SHIFT;
+  int shift = (bx * span) % 32;
+  uint32_t any = 0;
+  for (int y = by * span; y < by * span + span && y < height; ++y)
+  {
+    any |= (src[y * row_words + bx * span / 32] >> shift) & 0xFFu;
+  }
+  uint32_t *word =
+      &map->skip[level][by * map->skip_row_words[level] + bx / 32];
+  uint32_t bit = 1u << (bx % 32);
+  *word = any ? (*word | bit) : (*word & ~bit);
+}
+
+bool map_build_skip(Map *map)
+{
+  if (map->skip_levels > 0)
+    return true;
+
+  for (int level = 0; level < MAP_SKIP_LEVELS; ++level)
+  {
+    int bw = skip_size(map->width, level);
+    int bh = skip_size(map->height, level);
+    map->skip_row_words[level] = (bw + 31) / 32;
+    map->skip[level] = calloc((size_t)map->skip_row_words[level] * bh,
+                              sizeof(uint32_t));
+    if (!map->skip[level])
+    {
+      fprintf(stderr, "Out of memory while building map skip levels\n");
+      for (int i = 0; i < level; ++i)
+      {
+        free(map->skip[i]);
+        map->skip[i] = NULL;
+      }
+      return false;
+    }
+    for (int by = 0; by < bh; ++by)
+    {
+      for (int bx = 0; bx < bw; ++bx)
+      {
+        refresh_skip_bit(map, level, bx, by);
+      }
+    }
+  }
+  map->skip_levels = MAP_SKIP_LEVELS;
+  return true;
+}
+
+int map_tile(const Map *map, int x, int y)
+{
+  if (x < 0 || x >= map->width || y < 0 || y >= map->height)
+  {
+    return 0;
+  }
+  return map->tiles[(size_t)y * map->width + x];
+}
+
+bool map_blocked(const Map *map, int x, int y)
+{
+  if (x < 0 || x >= map->width || y < 0 || y >= map->height)
+    return true;
+  return (map->occupancy[y * map->row_words + x / 32] >> (x % 32)) & 1;
+}
+
+static bool door_cell(const Map *map, int x, int y)
+{
+  return map->door_bits &&
+         ((map->door_bits[y * map->row_words + x / 32] >> (x % 32)) & 1);
+}
+
+/* Sets the occupancy bit of in-map cell (x, y) and refreshes the skip
+   blocks above it. */
+static void set_occupied(Map *map, int x, int y, bool occupied)
+{
+  uint32_t *word = &map->occupancy[y * map->row_words + x / 32];
+  uint32_t bit = 1u << (x % 32);
+  *word = occupied ? (*word | bit) : (*word & ~bit);
+
+  for (int level = 0; level < map->skip_levels; ++level)
+  {
+    int shift = MAP_SKIP_SHIFT * (level + 1);
+    refresh_skip_bit(map, level, x >> shift, y >> shift);
+  }
+  ++map->revision;
+}
+
+/* Index of the first door at or after cell key y * width + x. */
+static int door_search(const Map *map, int x, int y)
+{
+  const long key = (long)y * map->width + x;
+  int lo = 0;
+  int hi = map->door_count;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    const MapDoor *door = &map->doors[mid];
+    if ((long)door->y * map->width + door->x < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* Drops the door at (x, y), indices past it shifting down. */
+static void remove_door(Map *map, int x, int y)
+{
+  int index = door_search(map, x, y);
+  memmove(&map->doors[index], &map->doors[index + 1],
+          sizeof(MapDoor) * (size_t)(map->door_count - index - 1));
+  --map->door_count;
+  int kept = 0;
+  for (int i = 0; i < map->moving_count; ++i)
+  {
+    if (map->moving[i] != index)
+      map->moving[kept++] = map->moving[i] - (map->moving[i] > index);
+  }
+  map->moving_count = kept;
+  map->door_bits[y * map->row_words + x / 32] &= ~(1u << (x % 32));
+}
+
+void map_set_tile(Map *map, int x, int y, int tile)
+{
+  if (x < 0 || x >= map->width || y < 0 || y >= map->height)
+  {
+    return;
+  }
+  map->tiles[(size_t)y * map->width + x] = (uint8_t)tile;
+  if (door_cell(map, x, y) && tile == 0)
+    remove_door(map, x, y);
+  if (door_cell(map, x, y))
+    set_occupied(map, x, y, map_door(map, x, y)->open < 1.0);
+  else
+    set_occupied(map, x, y, tile != 0);
+}
+
+const MapDoor *map_door(const Map *map, int x, int y)
+{
+  if (x < 0 || x >= map->width || y < 0 || y >= map->height ||
+      !door_cell(map, x, y))
+    return NULL;
+  return &map->doors[door_search(map, x, y)];
+}
+
+bool map_add_door(Map *map, int x, int y)
+{
+  if (map_tile(map, x, y) == 0)
+  {
+    fprintf(stderr, "Door at %d,%d is not on a wall\n", x, y);
+    return false;
+  }
+  if (door_cell(map, x, y))
+    return true;
+  if (!map->door_bits)
+  {
+    map->door_bits = calloc(occupancy_bytes(map->width, map->height), 1);
+    if (!map->door_bits)
+    {
+      fprintf(stderr, "Out of memory for the door cells\n");
+      return false;
+    }
+  }
+  if (map->door_count == map->door_capacity)
+  {
+    int capacity = map->door_capacity ? map->door_capacity * 2 : 64;
+    MapDoor *doors = realloc(map->doors, sizeof(MapDoor) * (size_t)capacity);
+    if (doors)
+      map->doors = doors;
+    int *moving = doors ? realloc(map->moving, sizeof(int) * (size_t)capacity)
+                        : NULL;
+    if (!moving)
+    {
+      fprintf(stderr, "Out of memory for %d doors\n", capacity);
+      return false;
+    }
+    map->moving = moving;
+    map->door_capacity = capacity;
+  }
+
+  /* Indices past the new door shift up, moving ones included. */
+  int index = door_search(map, x, y);
+  memmove(&map->doors[index + 1], &map->doors[index],
+          sizeof(MapDoor) * (size_t)(map->door_count - index));
+  ++map->door_count;
+  for (int i = 0; i < map->moving_count; ++i)
+  {
+    if (map->moving[i] >= index)
+      ++map->moving[i];
+  }
+  bool rowOfWalls = map_tile(map, x - 1, y) && map_tile(map, x + 1, y);
+  map->doors[index] = (MapDoor){x, y, rowOfWalls ? 1 : 0, 0.0, 0.0};
+  map->door_bits[y * map->row_words + x / 32] |= 1u << (x % 32);
+  ++map->revision;
+  return true;
+}
+
+int map_add_doors(Map *map, int tile)
+{
+  int count = 0;
+  for (int y = 0; y < map->height; ++y)
+  {
+    for (int x = 0; x < map->width; ++x)
+    {
+      if (map->tiles[(size_t)y * map->width + x] != tile)
+        continue;
+      if (!map_add_door(map, x, y))
+        return -1;
+      ++count;
+    }
+  }
+  return count;
+}
+
+bool map_move_door(Map *map, int x, int y, double target)
+{
+  if (!map_door(map, x, y))
+    return false;
+  int index = door_search(map, x, y);
+  MapDoor *door = &map->doors[index];
+  bool moving = door->open != door->target;
+  door->target = target < 0.0 ? 0.0 : (target > 1.0 ? 1.0 : target);
+  if (!moving && door->open != door->target)
+    map->moving[map->moving_count++] = index;
+  return true;
+}
+
+void map_update_doors(Map *map, double amount)
+{
+  int i = 0;
+  while (i < map->moving_count)
+  {
+    MapDoor *door = &map->doors[map->moving[i]];
+    bool wasOpen = door->open >= 1.0;
+    if (door->open < door->target)
+      door->open = door->open + amount < door->target ? door->open + amount
+                                                       : door->target;
+    else
+      door->open = door->open - amount > door->target ? door->open - amount
+                                                       : door->target;
+    bool isOpen = door->open >= 1.0;
+    if (isOpen != wasOpen)
+      set_occupied(map, door->x, door->y, !isOpen);
+    else
+      ++map->revision;
+    if (door->open == door->target)
+      map->moving[i] = map->moving[--map->moving_count];
+    else
+      ++i;
+  }
+}
+
+void map_set_spawn(Map *map, int x, int y)
+{
+  map->spawn_x = x;
+  map->spawn_y = y;
+  if (map->mapping)
+  {
+    MapFileHeader *header = map->mapping;
+    header->spawn_x = (uint32_t)x;
+    header->spawn_y = (uint32_t)y;
+  }
+}
+
+/* Cells of one breadth-first step of map_bake_light(). */
+typedef struct LightFront
+{
+  int *cells;
+  size_t count;
+  size_t capacity;
+} LightFront;
+
+static bool front_push(LightFront *front, int cell)
+{
+  if (front->count == front->capacity)
+  {
+    size_t capacity = front->capacity ? front->capacity * 2 : 256;
+    int *cells = realloc(front->cells, sizeof(int) * capacity);
+    if (!cells)
+      return false;
+    front->cells = cells;
+    front->capacity = capacity;
+  }
+  front->cells[front->count++] = cell;
+  return true;
+}
+
+bool map_bake_light(Map *map, int ambient, const MapLight *lights,
+                    int count)
+{
+  const size_t cells = (size_t)map->width * map->height;
+  if (!map->light)
+    map->light = malloc(cells);
+  if (!map->light)
+  {
+    fprintf(stderr, "Out of memory for the light of %zu cells\n", cells);
+    return false;
+  }
+  ambient = ambient < 0 ? 0
+                        : (ambient < MAP_LIGHT_LEVELS ? ambient
+                                                      : MAP_LIGHT_LEVELS - 1);
+  memset(map->light, ambient, cells);
+
+  /* Levels are settled brightest first: a cell first reached at level l
+     cannot be reached brighter later, so each cell joins one front. */
+  LightFront front = {NULL, 0, 0};
+  LightFront next = {NULL, 0, 0};
+  bool ok = true;
+  for (int level = MAP_LIGHT_LEVELS - 1; level > 0 && ok; --level)
+  {
+    for (int i = 0; i < count && ok; ++i)
+    {
+      int x = lights[i].x;
+      int y = lights[i].y;
+      int start = lights[i].level < MAP_LIGHT_LEVELS ? lights[i].level
+                                                     : MAP_LIGHT_LEVELS - 1;
+      if (start != level || map_blocked(map, x, y))
+        continue;
+      uint8_t *cell = &map->light[(size_t)y * map->width + x];
+      if (*cell < level)
+      {
+        *cell = (uint8_t)level;
+        ok = front_push(&front, y * map->width + x);
+      }
+    }
+    next.count = 0;
+    for (size_t i = 0; i < front.count && ok; ++i)
+    {
+      static const int offsets[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+      int x = front.cells[i] % map->width;
+      int y = front.cells[i] / map->width;
+      for (int d = 0; d < 4 && ok; ++d)
+      {
+        int nx = x + offsets[d][0];
+        int ny = y + offsets[d][1];
+        if (map_blocked(map, nx, ny))
+          continue;
+        uint8_t *cell = &map->light[(size_t)ny * map->width + nx];
+        if (*cell < level - 1)
+        {
+          *cell = (uint8_t)(level - 1);
+          ok = front_push(&next, ny * map->width + nx);
+        }
+      }
+    }
+    LightFront swap = front;
+    front = next;
+    next = swap;
+  }
+  free(front.cells);
+  free(next.cells);
+  if (!ok)
+    fprintf(stderr, "Out of memory while baking the light\n");
+  return ok;
+}
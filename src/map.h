@@ -0,0 +1,146 @@
+#ifndef RAYCAST_MAP_H
+#define RAYCAST_MAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tile grid: one byte per cell in row-major `tiles` (0 is empty, anything
+   else a wall and its texture/colour index) plus an occupancy bitset with
+   one bit per cell, `row_words` 32-bit words per row, that the ray
+   traversal tests instead of the bytes.
+
+   A map loaded with map_load() points straight into a private mapping of
+   the file, so opening one costs the same regardless of its size and pages
+   are only read as rays reach them. */
+/* Empty-space skipping pyramid built by map_build_skip(): level l has one
+   bit per square block of 1 << (MAP_SKIP_SHIFT * (l + 1)) cells (8, 64),
+   set when the block holds any wall. Rays cross empty blocks in one step.
+   map_set_tile() keeps it up to date. */
+#define MAP_SKIP_LEVELS 2
+#define MAP_SKIP_SHIFT 3
+
+/* A door is a wall cell drawn as a thin panel halfway through the cell,
+   running between its two neighbouring walls. `open` is the fraction of
+   the panel slid aside, moving toward `target` under map_update_doors();
+   rays pass through the open part. A fully open door clears its
+   occupancy bit, so rays and walkers cross the cell as if it were empty.
+   `side` is that of hits on the panel: 0 when it runs along y. */
+typedef struct MapDoor
+{
+  int x;
+  int y;
+  int side;
+  double open;
+  double target;
+} MapDoor;
+
+/* Light levels of map_bake_light(), 0 (dark) to MAP_LIGHT_LEVELS - 1. A
+   light at (x, y) gives its own cell `level` and each cell one step
+   further away through open cells one level less. */
+#define MAP_LIGHT_LEVELS 32
+
+typedef struct MapLight
+{
+  int x;
+  int y;
+  int level;
+} MapLight;
+
+typedef struct Map
+{
+  int width;
+  int height;
+  int row_words;
+  int spawn_x;
+  int spawn_y;
+  uint32_t *occupancy;
+  uint8_t *tiles;
+  void *mapping;
+  size_t mapping_size;
+  int skip_levels;
+  int skip_row_words[MAP_SKIP_LEVELS];
+  uint32_t *skip[MAP_SKIP_LEVELS];
+  /* Bumped by every change to what rays hit, so caches of hits know to
+     drop them. */
+  unsigned revision;
+  /* Doors sorted by cell, their cells flagged in `door_bits` (laid out
+     like `occupancy`), and the indices of those still moving. */
+  MapDoor *doors;
+  int door_count;
+  int door_capacity;
+  uint32_t *door_bits;
+  int *moving;
+  int moving_count;
+  /* Baked light level of each cell, row-major, or NULL when the map is
+     unlit. */
+  uint8_t *light;
+} Map;
+
+/* On-disk layout (little-endian): this header, the occupancy words, then
+   the tile bytes. The bitset starts on a 32-byte boundary. */
+#define MAP_FILE_MAGIC "RCMP"
+#define MAP_FILE_VERSION 1u
+
+typedef struct MapFileHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t spawn_x;
+  uint32_t spawn_y;
+  uint32_t row_words;
+  uint32_t reserved;
+} MapFileHeader;
+
+int map_row_words(int width);
+
+/* Uses caller-owned `tiles` and `occupancy` (height * map_row_words(width)
+   words) and derives the bitset from the tiles. */
+void map_wrap(Map *map, uint8_t *tiles, uint32_t *occupancy, int width,
+              int height);
+
+bool map_load(Map *map, const char *path);
+/* Creates a zero-filled map file and maps it writable; tiles and spawn set
+   on it are written back to the file. */
+bool map_create(Map *map, const char *path, int width, int height);
+void map_release(Map *map);
+bool map_build_skip(Map *map);
+
+/* 0 outside the map. */
+int map_tile(const Map *map, int x, int y);
+/* The occupancy bit: set for walls and doors not fully open, and outside
+   the map. */
+bool map_blocked(const Map *map, int x, int y);
+/* Updates the cell's occupancy and skip bits only. The tile of a door
+   cell picks the panel's texture; clearing it removes the door. */
+void map_set_tile(Map *map, int x, int y, int tile);
+void map_set_spawn(Map *map, int x, int y);
+
+/* Makes wall cell (x, y) a closed door, its panel running between the
+   walls on either side (along y unless walls are left and right of it).
+   Prints why and returns false on failure. */
+bool map_add_door(Map *map, int x, int y);
+/* Makes a door of every cell holding `tile`; returns how many, or -1 on
+   failure. */
+int map_add_doors(Map *map, int tile);
+/* The door at (x, y), or NULL. */
+const MapDoor *map_door(const Map *map, int x, int y);
+/* Starts the door at (x, y) moving toward `target`, 0 closed to 1 open;
+   false when there is none. */
+bool map_move_door(Map *map, int x, int y, double target);
+/* Slides every moving door `amount` toward its target. Only the doors in
+   motion are visited, and only the cells of doors that finish opening or
+   start closing have their occupancy and skip bits refreshed. */
+void map_update_doors(Map *map, double amount);
+
+/* Bakes `light`: every cell gets `ambient` or the brightest level any of
+   `lights` reaches it with, spreading through cells that are not
+   blocked, so walls and closed doors cast shadows. Walls keep `ambient`;
+   the renderer lights a wall face from the cell in front of it. Prints
+   why and returns false on failure. */
+bool map_bake_light(Map *map, int ambient, const MapLight *lights,
+                    int count);
+
+#endif
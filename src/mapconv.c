@@ -0,0 +1,216 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "map.h"
+
+/* Text maps have one row per line: '1'-'9' are walls of that tile, '#' is
+   tile 1, '.', ' ' and '0' are empty and 'P' marks the (empty) spawn
+   cell. Short lines are padded with empty cells. */
+static int tile_from_char(int c)
+{
+  if (c >= '1' && c <= '9')
+    return c - '0';
+  if (c == '#')
+    return 1;
+  if (c == '.' || c == ' ' || c == '0' || c == 'P')
+    return 0;
+  return -1;
+}
+
+/* First pass: size, spawn and validation without keeping any rows. */
+static bool scan_text(FILE *in, const char *path, int *width, int *height,
+                      int *spawn_x, int *spawn_y)
+{
+  int x = 0;
+  int y = 0;
+  int c;
+  *width = 0;
+  *spawn_x = -1;
+  *spawn_y = -1;
+  while ((c = getc(in)) != EOF)
+  {
+    if (c == '\n')
+    {
+      ++y;
+      x = 0;
+      continue;
+    }
+    if (c == '\r')
+      continue;
+    if (tile_from_char(c) < 0)
+    {
+      fprintf(stderr, "%s:%d:%d: unexpected '%c'\n", path, y + 1, x + 1, c);
+      return false;
+    }
+    if (c == 'P')
+    {
+      *spawn_x = x;
+      *spawn_y = y;
+    }
+    if (++x > *width)
+      *width = x;
+  }
+  *height = x > 0 ? y + 1 : y;
+  if (*width == 0 || *height == 0)
+  {
+    fprintf(stderr, "%s is empty\n", path);
+    return false;
+  }
+  return true;
+}
+
+static bool convert_text(const char *in_path, const char *out_path)
+{
+  FILE *in = fopen(in_path, "r");
+  if (!in)
+  {
+    fprintf(stderr, "Unable to open %s\n", in_path);
+    return false;
+  }
+
+  int width;
+  int height;
+  int spawn_x;
+  int spawn_y;
+  if (!scan_text(in, in_path, &width, &height, &spawn_x, &spawn_y))
+  {
+    fclose(in);
+    return false;
+  }
+
+  Map map;
+  if (!map_create(&map, out_path, width, height))
+  {
+    fclose(in);
+    return false;
+  }
+
+  rewind(in);
+  int x = 0;
+  int y = 0;
+  int c;
+  while ((c = getc(in)) != EOF)
+  {
+    if (c == '\n')
+    {
+      ++y;
+      x = 0;
+    }
+    else if (c != '\r')
+    {
+      int tile = tile_from_char(c);
+      if (tile > 0)
+        map_set_tile(&map, x, y, tile);
+      ++x;
+    }
+  }
+  fclose(in);
+
+  /* Without a 'P' the player starts in the first empty cell. */
+  for (int sy = 0; spawn_x < 0 && sy < height; ++sy)
+  {
+    for (int sx = 0; spawn_x < 0 && sx < width; ++sx)
+    {
+      if (map_tile(&map, sx, sy) == 0)
+      {
+        spawn_x = sx;
+        spawn_y = sy;
+      }
+    }
+  }
+  if (spawn_x < 0)
+  {
+    fprintf(stderr, "%s has no empty cell to spawn in\n", in_path);
+    map_release(&map);
+    return false;
+  }
+  map_set_spawn(&map, spawn_x, spawn_y);
+
+  printf("%s: %dx%d, spawn %d,%d\n", out_path, width, height, spawn_x,
+         spawn_y);
+  map_release(&map);
+  return true;
+}
+
+/* Walled rectangle scattered with single-cell pillars, `permille` of the
+   cells on average, for benchmarking large open maps. */
+static bool generate(int width, int height, int permille,
+                     const char *out_path)
+{
+  Map map;
+  if (!map_create(&map, out_path, width, height))
+    return false;
+
+  uint32_t state = 2463534242u;
+  for (int y = 0; y < height; ++y)
+  {
+    for (int x = 0; x < width; ++x)
+    {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      bool border = x == 0 || y == 0 || x == width - 1 || y == height - 1;
+      if (border || state % 1000 < (uint32_t)permille)
+        map_set_tile(&map, x, y, border ? 1 : 1 + (int)(state >> 16) % 3);
+    }
+  }
+  map_set_tile(&map, width / 2, height / 2, 0);
+  map_set_spawn(&map, width / 2, height / 2);
+
+  printf("%s: %dx%d, spawn %d,%d\n", out_path, width, height, width / 2,
+         height / 2);
+  map_release(&map);
+  return true;
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s input.txt output.rcm\n"
+          "       %s -g WIDTHxHEIGHT [-d permille] output.rcm\n",
+          argv0, argv0);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc == 3 && argv[1][0] != '-')
+  {
+    return convert_text(argv[1], argv[2]) ? 0 : 1;
+  }
+
+  int width = 0;
+  int height = 0;
+  int permille = 10;
+  const char *out_path = NULL;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+    {
+      if (sscanf(argv[++i], "%dx%d", &width, &height) != 2)
+        width = 0;
+    }
+    else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+    {
+      permille = atoi(argv[++i]);
+    }
+    else if (!out_path && argv[i][0] != '-')
+    {
+      out_path = argv[i];
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (width <= 0 || height <= 0 || permille < 0 || permille > 1000 ||
+      !out_path)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  return generate(width, height, permille, out_path) ? 0 : 1;
+}
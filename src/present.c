@@ -0,0 +1,316 @@
+#include "present.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "governor.h"
+#include "profile.h"
+
+struct Presenter
+{
+  SDL_Renderer *renderer;
+  SDL_Texture *textures[PRESENT_BUFFERS];
+  int width;
+  int height;
+  Uint32 *columns;
+  WorkerPool *pool;
+  PresentDrawFn draw;
+  void *arg;
+
+  /* Internal render size: each slot remembers the size it was drawn at
+     and is stretched to the window when shown. */
+  bool governed;
+  ResolutionGovernor governor;
+  SDL_Rect drawn[PRESENT_BUFFERS];
+  double draw_ms;
+
+  /* Pipelined mode: the job handed to the render thread, the ring slot it
+     is drawing (-1 for none) and the slot on screen (-1 before the first
+     frame). */
+  SDL_Thread *thread;
+  SDL_sem *job_ready;
+  SDL_sem *job_done;
+  bool quit;
+  Framebuffer job_fb;
+  Camera job_cam;
+  int pending;
+  int shown;
+
+  /* Camera of the newest frame drawn or being drawn; `stale` until the
+     first one or after presenter_invalidate(). */
+  Camera last_cam;
+  bool stale;
+
+  Uint32 last_report;
+};
+
+static void draw_frame(Presenter *p, const Framebuffer *fb,
+                       const Camera *cam)
+{
+  Uint64 start = SDL_GetPerformanceCounter();
+  if (!p->columns)
+  {
+    p->draw(fb, cam, p->arg);
+  }
+  else
+  {
+    Framebuffer target = {p->columns, fb->width, fb->height, fb->height,
+                          true};
+    p->draw(&target, cam, p->arg);
+    framebuffer_resolve(fb, &target, p->pool);
+  }
+  p->draw_ms = (SDL_GetPerformanceCounter() - start) * 1000.0 /
+               SDL_GetPerformanceFrequency();
+}
+
+static bool same_camera(const Camera *a, const Camera *b)
+{
+  return a->posX == b->posX && a->posY == b->posY && a->dirX == b->dirX &&
+         a->dirY == b->dirY && a->planeX == b->planeX &&
+         a->planeY == b->planeY;
+}
+
+static int render_thread(void *data)
+{
+  Presenter *p = data;
+  for (;;)
+  {
+    SDL_SemWait(p->job_ready);
+    if (p->quit)
+      break;
+    draw_frame(p, &p->job_fb, &p->job_cam);
+    SDL_SemPost(p->job_done);
+  }
+  return 0;
+}
+
+/* Locks the top-left corner of ring slot `slot` at the current render
+   size and describes it as a row-major target; SDL's pitch is in bytes. */
+static bool lock_slot(Presenter *p, int slot, Framebuffer *fb)
+{
+  SDL_Rect rect = {0, 0, p->width, p->height};
+  if (p->governed)
+  {
+    rect.w = p->governor.width;
+    rect.h = p->governor.height;
+  }
+  void *pixels;
+  int pitch;
+  if (SDL_LockTexture(p->textures[slot], &rect, &pixels, &pitch) != 0)
+  {
+    fprintf(stderr, "SDL_LockTexture Error: %s\n", SDL_GetError());
+    return false;
+  }
+  p->drawn[slot] = rect;
+  *fb = (Framebuffer){pixels, rect.w, rect.h, pitch / (int)sizeof(Uint32),
+                      false};
+  return true;
+}
+
+static void govern(Presenter *p)
+{
+  if (p->governed)
+    governor_update(&p->governor, p->draw_ms);
+}
+
+static void unlock_slot(Presenter *p, int slot)
+{
+  PROFILE_BEGIN(start);
+  SDL_UnlockTexture(p->textures[slot]);
+  PROFILE_END(start, PROFILE_UPLOAD);
+}
+
+static void show_slot(Presenter *p, int slot)
+{
+  PROFILE_BEGIN(start);
+  SDL_RenderClear(p->renderer);
+  SDL_RenderCopy(p->renderer, p->textures[slot], &p->drawn[slot], NULL);
+  SDL_RenderPresent(p->renderer);
+  PROFILE_END(start, PROFILE_PRESENT);
+}
+
+/* Once a second, the stage breakdown of a profiling build. */
+static void report_profile(Presenter *p)
+{
+  Uint32 now = SDL_GetTicks();
+  if (now - p->last_report < 1000)
+    return;
+  ProfileSummary summary;
+  if (profile_summary(&summary) && summary.frames > 0)
+  {
+    char line[256];
+    profile_format(&summary, line, sizeof(line));
+    double fps = summary.frames * 1000.0 / (now - p->last_report);
+    if (p->governed)
+      printf("%.0f fps at %dx%d | %s\n", fps, p->governor.width,
+             p->governor.height, line);
+    else
+      printf("%.0f fps | %s\n", fps, line);
+  }
+  p->last_report = now;
+}
+
+Presenter *presenter_create(SDL_Renderer *renderer, int width, int height,
+                            bool column_major, bool pipelined,
+                            WorkerPool *pool, PresentDrawFn draw, void *arg)
+{
+  Presenter *p = calloc(1, sizeof(*p));
+  if (!p)
+  {
+    fprintf(stderr, "Out of memory for the presenter\n");
+    return NULL;
+  }
+  p->renderer = renderer;
+  p->width = width;
+  p->height = height;
+  p->pool = pool;
+  p->draw = draw;
+  p->arg = arg;
+  p->pending = -1;
+  p->shown = -1;
+  p->stale = true;
+  p->last_report = SDL_GetTicks();
+  for (int i = 0; i < PRESENT_BUFFERS; ++i)
+    p->drawn[i] = (SDL_Rect){0, 0, width, height};
+
+  int count = pipelined ? PRESENT_BUFFERS : 1;
+  for (int i = 0; i < count; ++i)
+  {
+    p->textures[i] =
+        SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                          SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (!p->textures[i])
+    {
+      fprintf(stderr, "SDL_CreateTexture Error: %s\n", SDL_GetError());
+      presenter_destroy(p);
+      return NULL;
+    }
+  }
+
+  if (column_major)
+  {
+    p->columns = malloc(sizeof(Uint32) * (size_t)width * height);
+    if (!p->columns)
+      fprintf(stderr, "Column-major target unavailable, using rows\n");
+  }
+
+  if (pipelined)
+  {
+    p->job_ready = SDL_CreateSemaphore(0);
+    p->job_done = SDL_CreateSemaphore(0);
+    if (p->job_ready && p->job_done)
+      p->thread = SDL_CreateThread(render_thread, "render", p);
+    if (!p->thread)
+    {
+      fprintf(stderr, "Render thread unavailable: %s\n", SDL_GetError());
+      presenter_destroy(p);
+      return NULL;
+    }
+  }
+  return p;
+}
+
+void presenter_destroy(Presenter *p)
+{
+  if (!p)
+    return;
+  if (p->thread)
+  {
+    if (p->pending >= 0)
+    {
+      SDL_SemWait(p->job_done);
+      unlock_slot(p, p->pending);
+    }
+    p->quit = true;
+    SDL_SemPost(p->job_ready);
+    SDL_WaitThread(p->thread, NULL);
+  }
+  if (p->job_ready)
+    SDL_DestroySemaphore(p->job_ready);
+  if (p->job_done)
+    SDL_DestroySemaphore(p->job_done);
+  for (int i = 0; i < PRESENT_BUFFERS; ++i)
+  {
+    if (p->textures[i])
+      SDL_DestroyTexture(p->textures[i]);
+  }
+  free(p->columns);
+  free(p);
+}
+
+void presenter_set_budget(Presenter *p, double budget_ms)
+{
+  p->governed = budget_ms > 0.0;
+  if (p->governed)
+    governor_init(&p->governor, p->width, p->height, budget_ms);
+  p->stale = true;
+}
+
+void presenter_invalidate(Presenter *p)
+{
+  p->stale = true;
+}
+
+/* Takes the frame the render thread finished into the ring as the one
+   on screen. */
+static void collect(Presenter *p)
+{
+  SDL_SemWait(p->job_done);
+  unlock_slot(p, p->pending);
+  govern(p);
+  p->shown = p->pending;
+  p->pending = -1;
+}
+
+void presenter_sync(Presenter *p)
+{
+  if (p->pending < 0)
+    return;
+  collect(p);
+  p->stale = true;
+}
+
+bool presenter_frame(Presenter *p, const Camera *cam)
+{
+  const bool changed = p->stale || !same_camera(cam, &p->last_cam);
+  if (changed)
+  {
+    p->last_cam = *cam;
+    p->stale = false;
+  }
+
+  Framebuffer fb;
+  if (!p->thread)
+  {
+    if (!changed)
+      return false;
+    if (lock_slot(p, 0, &fb))
+    {
+      draw_frame(p, &fb, cam);
+      unlock_slot(p, 0);
+      govern(p);
+    }
+    show_slot(p, 0);
+    report_profile(p);
+    return true;
+  }
+
+  /* Collect the frame drawn during the last present, hand the render
+     thread the next slot of the ring, then present while it draws. The
+     slot relocked is the one shown two frames ago. */
+  if (!changed && p->pending < 0)
+    return false;
+  if (p->pending >= 0)
+    collect(p);
+  int slot = (p->shown + 1) % PRESENT_BUFFERS;
+  if (changed && lock_slot(p, slot, &p->job_fb))
+  {
+    p->job_cam = *cam;
+    p->pending = slot;
+    SDL_SemPost(p->job_ready);
+  }
+  if (p->shown >= 0)
+    show_slot(p, p->shown);
+  report_profile(p);
+  return true;
+}
@@ -0,0 +1,51 @@
+#ifndef RAYCAST_PRESENT_H
+#define RAYCAST_PRESENT_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#include "render.h"
+
+/* Streaming textures in the pipelined ring: one being drawn, one on
+   screen and one the GPU may still be reading. */
+#define PRESENT_BUFFERS 3
+
+/* Draws the view from `cam` into `fb`. */
+typedef void (*PresentDrawFn)(const Framebuffer *fb, const Camera *cam,
+                              void *arg);
+
+/* Shows frames drawn straight into locked streaming-texture memory, so
+   nothing is copied on the way to SDL. A column-major presenter draws
+   into its own scratch target and resolves it into the texture. A
+   pipelined one draws on a render thread: while the main thread presents
+   frame N, frame N + 1 is drawn into the next texture of the ring, and
+   the picture lags input by one frame. */
+typedef struct Presenter Presenter;
+
+/* Prints why and returns NULL on failure. `pool` resolves column-major
+   frames. */
+Presenter *presenter_create(SDL_Renderer *renderer, int width, int height,
+                            bool column_major, bool pipelined,
+                            WorkerPool *pool, PresentDrawFn draw, void *arg);
+void presenter_destroy(Presenter *presenter);
+
+/* Holds the time spent drawing each frame near `budget_ms` by scaling the
+   internal render size (see governor.h); frames are stretched to the
+   window when shown. 0 renders at full size again. */
+void presenter_set_budget(Presenter *presenter, double budget_ms);
+
+/* Draws the view from `cam` and presents the newest finished frame. When
+   `cam` matches the camera of the last frame drawn and nothing was
+   invalidated since, nothing is drawn or uploaded; once that frame is on
+   screen it returns false and does nothing at all, so an idle caller
+   should wait for input rather than call again right away. */
+bool presenter_frame(Presenter *presenter, const Camera *cam);
+/* Makes the next presenter_frame() draw even for an unchanged camera: the
+   scene changed, or the window needs repainting. */
+void presenter_invalidate(Presenter *presenter);
+/* Waits for the frame a pipelined presenter is drawing, if any, so the
+   caller may change what the draw function reads; the next
+   presenter_frame() draws again. Does nothing for other presenters. */
+void presenter_sync(Presenter *presenter);
+
+#endif
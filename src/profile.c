@@ -0,0 +1,237 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "profile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(RENDER_PROFILE) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define PROFILE_TSC 1
+#include <x86intrin.h>
+#else
+#define PROFILE_TSC 0
+#endif
+
+static const char *const g_stage_names[PROFILE_STAGE_COUNT] = {
+    "frame", "background", "rays",   "walls",
+    "floor", "resolve",    "upload", "present"};
+
+const char *profile_stage_name(ProfileStage stage)
+{
+  return stage < PROFILE_STAGE_COUNT ? g_stage_names[stage] : "unknown";
+}
+
+void profile_format(const ProfileSummary *summary, char *buf, size_t size)
+{
+  int n = snprintf(buf, size, "%s %.2f ms |",
+                   g_stage_names[PROFILE_FRAME], summary->ms[PROFILE_FRAME]);
+  for (int s = PROFILE_FRAME + 1; s < PROFILE_STAGE_COUNT; ++s)
+  {
+    if (n < 0 || (size_t)n >= size)
+      return;
+    if (summary->ms[s] > 0.0)
+      n += snprintf(buf + n, size - (size_t)n, " %s %.2f", g_stage_names[s],
+                    summary->ms[s]);
+  }
+}
+
+#ifdef RENDER_PROFILE
+
+/* Power of two: about 200 events per 800-pixel frame, so a few hundred
+   frames of history. */
+#define PROFILE_RING_EVENTS (1 << 16)
+
+typedef struct ProfileEvent
+{
+  uint64_t start;
+  uint64_t end;
+  uint16_t stage;
+  uint16_t thread;
+} ProfileEvent;
+
+/* Writers claim slots with one atomic add and never wait; old events are
+   overwritten. Totals feed profile_summary(). */
+static ProfileEvent g_events[PROFILE_RING_EVENTS];
+static uint64_t g_head;
+static uint64_t g_totals[PROFILE_STAGE_COUNT];
+static uint64_t g_frames;
+static int g_thread_count;
+static __thread int t_thread = -1;
+
+/* First timestamp and the monotonic clock at that moment; ticks are
+   converted to time against them. g_base_state goes 0 -> 1 (claimed) ->
+   2 (set). */
+static int g_base_state;
+static uint64_t g_base_ticks;
+static uint64_t g_base_ns;
+
+static uint64_t monotonic_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t profile_now(void)
+{
+#if PROFILE_TSC
+  return __rdtsc();
+#else
+  return monotonic_ns();
+#endif
+}
+
+static void set_base(void)
+{
+  int expected = 0;
+  if (__atomic_compare_exchange_n(&g_base_state, &expected, 1, false,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+  {
+    g_base_ticks = profile_now();
+    g_base_ns = monotonic_ns();
+    __atomic_store_n(&g_base_state, 2, __ATOMIC_RELEASE);
+  }
+}
+
+static double ns_per_tick(void)
+{
+#if PROFILE_TSC
+  if (__atomic_load_n(&g_base_state, __ATOMIC_ACQUIRE) != 2)
+    return 1.0;
+  uint64_t ticks = profile_now();
+  uint64_t ns = monotonic_ns();
+  if (ticks <= g_base_ticks || ns <= g_base_ns)
+    return 1.0;
+  return (double)(ns - g_base_ns) / (double)(ticks - g_base_ticks);
+#else
+  return 1.0;
+#endif
+}
+
+void profile_record(ProfileStage stage, uint64_t start, uint64_t end)
+{
+  if (t_thread < 0)
+    t_thread = __atomic_fetch_add(&g_thread_count, 1, __ATOMIC_RELAXED);
+  if (__atomic_load_n(&g_base_state, __ATOMIC_ACQUIRE) != 2)
+    set_base();
+
+  uint64_t index = __atomic_fetch_add(&g_head, 1, __ATOMIC_RELAXED);
+  ProfileEvent *event = &g_events[index & (PROFILE_RING_EVENTS - 1)];
+  event->start = start;
+  event->end = end;
+  event->stage = (uint16_t)stage;
+  event->thread = (uint16_t)t_thread;
+
+  __atomic_fetch_add(&g_totals[stage], end - start, __ATOMIC_RELAXED);
+  if (stage == PROFILE_FRAME)
+    __atomic_fetch_add(&g_frames, 1, __ATOMIC_RELAXED);
+}
+
+void profile_span_begin(ProfileSpan *span)
+{
+  memset(span->total, 0, sizeof(span->total));
+  span->start = profile_now();
+  span->last = span->start;
+}
+
+void profile_span_mark(ProfileSpan *span, ProfileStage stage)
+{
+  uint64_t now = profile_now();
+  span->total[stage] += now - span->last;
+  span->last = now;
+}
+
+void profile_span_end(ProfileSpan *span)
+{
+  uint64_t t = span->start;
+  for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+  {
+    if (span->total[s] > 0)
+    {
+      profile_record((ProfileStage)s, t, t + span->total[s]);
+      t += span->total[s];
+    }
+  }
+}
+
+#endif
+
+bool profile_summary(ProfileSummary *out)
+{
+  memset(out, 0, sizeof(*out));
+#ifdef RENDER_PROFILE
+  double ms_per_tick = ns_per_tick() / 1.0e6;
+  uint64_t frames = __atomic_exchange_n(&g_frames, 0, __ATOMIC_RELAXED);
+  out->frames = (int)frames;
+  for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+  {
+    uint64_t ticks = __atomic_exchange_n(&g_totals[s], 0, __ATOMIC_RELAXED);
+    out->ms[s] = frames ? ticks * ms_per_tick / frames : 0.0;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool profile_write_trace(const char *path)
+{
+#ifdef RENDER_PROFILE
+  FILE *file = fopen(path, "w");
+  if (!file)
+  {
+    fprintf(stderr, "Unable to write trace %s\n", path);
+    return false;
+  }
+
+  double us_per_tick = ns_per_tick() / 1000.0;
+  uint64_t head = __atomic_load_n(&g_head, __ATOMIC_ACQUIRE);
+  uint64_t first = head > PROFILE_RING_EVENTS ? head - PROFILE_RING_EVENTS : 0;
+  int threads = __atomic_load_n(&g_thread_count, __ATOMIC_RELAXED);
+
+  /* Spans are recorded when they end, so the earliest start can precede
+     the first event written. */
+  uint64_t origin = g_base_ticks;
+  for (uint64_t i = first; i < head; ++i)
+  {
+    uint64_t start = g_events[i & (PROFILE_RING_EVENTS - 1)].start;
+    if ((int64_t)(start - origin) < 0)
+      origin = start;
+  }
+
+  fprintf(file, "{\"traceEvents\":[\n");
+  for (int t = 0; t < threads; ++t)
+  {
+    fprintf(file,
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+            t > 0 ? ",\n" : "", t, t);
+  }
+  for (uint64_t i = first; i < head; ++i)
+  {
+    const ProfileEvent *event = &g_events[i & (PROFILE_RING_EVENTS - 1)];
+    double ts = (double)(event->start - origin) * us_per_tick;
+    double dur = (double)(event->end - event->start) * us_per_tick;
+    fprintf(file,
+            "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+            "\"ts\":%.3f,\"dur\":%.3f}",
+            threads > 0 || i > first ? ",\n" : "",
+            profile_stage_name((ProfileStage)event->stage),
+            (unsigned)event->thread, ts, dur);
+  }
+  fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  bool ok = !ferror(file);
+  if (fclose(file) != 0)
+    ok = false;
+  if (!ok)
+    fprintf(stderr, "Unable to write trace %s\n", path);
+  return ok;
+#else
+  fprintf(stderr, "Unable to write trace %s: built without RENDER_PROFILE\n",
+          path);
+  return false;
+#endif
+}
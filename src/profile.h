@@ -0,0 +1,76 @@
+#ifndef RAYCAST_PROFILE_H
+#define RAYCAST_PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Frame stages timed when the renderer is built with RENDER_PROFILE. */
+typedef enum ProfileStage
+{
+  PROFILE_FRAME,
+  PROFILE_BACKGROUND,
+  PROFILE_RAYS,
+  PROFILE_WALLS,
+  PROFILE_FLOOR,
+  PROFILE_RESOLVE,
+  PROFILE_UPLOAD,
+  PROFILE_PRESENT,
+  PROFILE_STAGE_COUNT
+} ProfileStage;
+
+/* Stage time of one work item whose stages interleave (per column rays,
+   walls and floor): marks charge the time since the previous mark to a
+   stage, and the end records the totals as consecutive slices starting
+   at the item's start. */
+typedef struct ProfileSpan
+{
+  uint64_t start;
+  uint64_t last;
+  uint64_t total[PROFILE_STAGE_COUNT];
+} ProfileSpan;
+
+#ifdef RENDER_PROFILE
+uint64_t profile_now(void);
+/* Appends [start, end) on the calling thread to the event ring; safe from
+   any number of threads. */
+void profile_record(ProfileStage stage, uint64_t start, uint64_t end);
+void profile_span_begin(ProfileSpan *span);
+void profile_span_mark(ProfileSpan *span, ProfileStage stage);
+void profile_span_end(ProfileSpan *span);
+
+#define PROFILE_BEGIN(name) uint64_t name = profile_now()
+#define PROFILE_END(name, stage) profile_record(stage, name, profile_now())
+#define PROFILE_SPAN_BEGIN(span)                                           \
+  ProfileSpan span;                                                        \
+  profile_span_begin(&span)
+#define PROFILE_SPAN_MARK(span, stage) profile_span_mark(&span, stage)
+#define PROFILE_SPAN_END(span) profile_span_end(&span)
+#else
+#define PROFILE_BEGIN(name)
+#define PROFILE_END(name, stage)
+#define PROFILE_SPAN_BEGIN(span)
+#define PROFILE_SPAN_MARK(span, stage)
+#define PROFILE_SPAN_END(span)
+#endif
+
+/* Milliseconds per frame spent in each stage since the previous call,
+   summed over threads, with a frame being one render_frame_* call. Reads
+   and clears the totals; returns false when profiling is compiled out. */
+typedef struct ProfileSummary
+{
+  int frames;
+  double ms[PROFILE_STAGE_COUNT];
+} ProfileSummary;
+
+bool profile_summary(ProfileSummary *out);
+/* One line such as "frame 4.10 ms | rays 1.20 walls 2.05 ...". */
+void profile_format(const ProfileSummary *summary, char *buf, size_t size);
+const char *profile_stage_name(ProfileStage stage);
+
+/* Writes the newest events as Chrome trace_event JSON (chrome://tracing,
+   Perfetto). Call while no frame is being rendered. Prints why and returns
+   false when profiling is compiled out or the file cannot be written. */
+bool profile_write_trace(const char *path);
+
+#endif
@@ -0,0 +1,177 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "raycast.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/* `owned` is the loaded map when there is one; `map` the caller's. */
+struct RaycastContext
+{
+  WorkerPool *pool;
+  RenderState *state;
+  Map owned;
+  bool has_owned;
+  const Map *map;
+  const Texture *textures;
+  int texture_count;
+  RenderOptions options;
+  RenderHistory *history;
+};
+
+/* Processors online, for a pool sized to the machine. */
+static int online_processors(void)
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  long online = (long)info.dwNumberOfProcessors;
+#else
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return online > 0 ? (int)online : 1;
+}
+
+int raycast_api_version(void)
+{
+  return RAYCAST_API_VERSION;
+}
+
+RaycastContext *raycast_create(int threads)
+{
+  if (threads <= 0)
+    threads = online_processors();
+  RaycastContext *ctx = calloc(1, sizeof(*ctx));
+  if (ctx)
+  {
+    ctx->pool = worker_pool_create(threads);
+    ctx->state = render_state_create();
+  }
+  if (!ctx || !ctx->pool || !ctx->state)
+  {
+    fprintf(stderr, "Unable to create a renderer with %d thread(s)\n",
+            threads);
+    if (ctx)
+    {
+      worker_pool_destroy(ctx->pool);
+      render_state_destroy(ctx->state);
+    }
+    free(ctx);
+    return NULL;
+  }
+  ctx->options = (RenderOptions){FLOOR_COLUMNS, false, NULL, 1, 0};
+  return ctx;
+}
+
+static void release_owned(RaycastContext *ctx)
+{
+  if (ctx->has_owned)
+    map_release(&ctx->owned);
+  ctx->has_owned = false;
+}
+
+void raycast_destroy(RaycastContext *ctx)
+{
+  if (!ctx)
+    return;
+  worker_pool_destroy(ctx->pool);
+  render_state_destroy(ctx->state);
+  render_history_destroy(ctx->history);
+  release_owned(ctx);
+  free(ctx);
+}
+
+bool raycast_load_map(RaycastContext *ctx, const char *path)
+{
+  Map map;
+  if (!map_load(&map, path))
+    return false;
+  release_owned(ctx);
+  ctx->owned = map;
+  ctx->has_owned = true;
+  ctx->map = &ctx->owned;
+  raycast_map_changed(ctx);
+  return true;
+}
+
+void raycast_set_map(RaycastContext *ctx, const Map *map)
+{
+  release_owned(ctx);
+  ctx->map = map;
+  raycast_map_changed(ctx);
+}
+
+void raycast_map_changed(RaycastContext *ctx)
+{
+  if (ctx->history)
+    render_history_reset(ctx->history);
+}
+
+const Map *raycast_map(const RaycastContext *ctx)
+{
+  return ctx->map ? ctx->map : render_builtin_map();
+}
+
+void raycast_set_textures(RaycastContext *ctx, const Texture *textures,
+                          int count)
+{
+  ctx->textures = textures;
+  ctx->texture_count = textures ? count : 0;
+}
+
+void raycast_set_options(RaycastContext *ctx, const RenderOptions *options)
+{
+  ctx->options =
+      options ? *options
+              : (RenderOptions){FLOOR_COLUMNS, false, NULL, 1, 0};
+}
+
+void raycast_set_lighting(RaycastContext *ctx, const Lighting *lighting)
+{
+  render_state_set_lighting(ctx->state, lighting);
+}
+
+void raycast_set_numeric(RaycastContext *ctx, RenderNumeric numeric)
+{
+  render_state_set_numeric(ctx->state, numeric);
+}
+
+void raycast_set_coalesce(RaycastContext *ctx, bool enabled)
+{
+  render_state_set_coalesce(ctx->state, enabled);
+}
+
+RenderNumeric raycast_numeric(const RaycastContext *ctx)
+{
+  return render_state_numeric(ctx->state, raycast_map(ctx));
+}
+
+bool raycast_set_reprojection(RaycastContext *ctx, bool enabled)
+{
+  if (enabled && !ctx->history)
+    ctx->history = render_history_create();
+  else if (!enabled)
+  {
+    render_history_destroy(ctx->history);
+    ctx->history = NULL;
+  }
+  return ctx->history != NULL || !enabled;
+}
+
+WorkerPool *raycast_pool(RaycastContext *ctx)
+{
+  return ctx->pool;
+}
+
+void raycast_render(RaycastContext *ctx, const Camera *cam,
+                    const Framebuffer *fb)
+{
+  render_frame_state(ctx->state, raycast_map(ctx), fb, cam, ctx->textures,
+                     ctx->texture_count, &ctx->options, ctx->pool,
+                     ctx->history);
+}
@@ -0,0 +1,66 @@
+#ifndef RAYCAST_RAYCAST_H
+#define RAYCAST_RAYCAST_H
+
+#include <stdbool.h>
+
+#include "render.h"
+
+/* Entry point of build/librender.a for programs that only need frames: a
+   context owns a worker pool, the map it draws and a RenderState with
+   its lighting, numeric backend and scratch tables, and holds the
+   textures and options it draws with. Contexts share nothing but the ray
+   kernel (ray_kernel_select()), so different contexts may render on
+   different threads at once; renders of one context must not overlap.
+   Functions here keep their meaning for a given RAYCAST_API_VERSION;
+   raycast_api_version() reports the one the library was built with.
+   Version 2 gave each context its own state, where version 1 drew with
+   the process-wide one. */
+#define RAYCAST_API_VERSION 2
+
+typedef struct RaycastContext RaycastContext;
+
+int raycast_api_version(void);
+
+/* `threads` <= 0 uses one per online CPU. Prints why and returns NULL on
+   failure. */
+RaycastContext *raycast_create(int threads);
+void raycast_destroy(RaycastContext *ctx);
+
+/* Draws the map file at `path` from now on; on failure prints why,
+   returns false and keeps the current map. */
+bool raycast_load_map(RaycastContext *ctx, const char *path);
+/* Draws the caller's `map` (which must outlive its use), or with NULL the
+   built-in one. */
+void raycast_set_map(RaycastContext *ctx, const Map *map);
+const Map *raycast_map(const RaycastContext *ctx);
+/* Call after changing tiles of the map being drawn. */
+void raycast_map_changed(RaycastContext *ctx);
+
+/* Walls, floor and ceiling as in render_frame_textured(); NULL textures
+   (the default) draw flat-shaded walls. The array must outlive its use. */
+void raycast_set_textures(RaycastContext *ctx, const Texture *textures,
+                          int count);
+/* Copied; NULL restores the defaults. */
+void raycast_set_options(RaycastContext *ctx, const RenderOptions *options);
+
+/* As render_set_lighting(), render_numeric_select() and
+   render_coalesce_select() do process-wide, for this context only: unlit,
+   RENDER_NUMERIC and no coalescing by default. */
+void raycast_set_lighting(RaycastContext *ctx, const Lighting *lighting);
+void raycast_set_numeric(RaycastContext *ctx, RenderNumeric numeric);
+void raycast_set_coalesce(RaycastContext *ctx, bool enabled);
+/* The backend the context's frames are drawn with, as
+   render_numeric_effective() reports it. */
+RenderNumeric raycast_numeric(const RaycastContext *ctx);
+
+/* Reprojects each frame from the last one as render_frame_history()
+   does; off by default. Prints why and returns false when the history
+   cannot be allocated. */
+bool raycast_set_reprojection(RaycastContext *ctx, bool enabled);
+
+WorkerPool *raycast_pool(RaycastContext *ctx);
+
+void raycast_render(RaycastContext *ctx, const Camera *cam,
+                    const Framebuffer *fb);
+
+#endif
@@ -0,0 +1,2403 @@
+#include "render.h"
+
+#include "dda.h"
+#include "fixed.h"
+#include "light.h"
+#include "profile.h"
+#include "transpose.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Columns per work item: 16 pixels is one 64-byte cache line per row, so
+   workers never write the same line. */
+#define RENDER_TILE_COLUMNS 16
+
+/* Colours of the background's ceiling and floor halves. */
+#define RENDER_SKY 0xFF1C1F2B
+#define RENDER_FLOOR 0xFF252D2A
+
+/* Helpers taking a kernel's compile-time choices as constant arguments;
+   forced inline so every specialized kernel folds them away. */
+#define RENDER_INLINE __attribute__((always_inline)) static inline
+
+static uint8_t g_default_tiles[MAP_HEIGHT][MAP_WIDTH] = {
+    {1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
+    {1, 0, 0, 0, 0, 0, 0, 0, 0, 1},
+    {1, 0, 0, 0, 0, 0, 0, 0, 0, 1},
+    {1, 0, 0, 2, 2, 2, 0, 0, 0, 1},
+    {1, 0, 0, 2, 0, 2, 0, 0, 0, 1},
+    {1, 0, 0, 2, 2, 2, 0, 0, 0, 1},
+    {1, 0, 0, 0, 0, 0, 0, 3, 0, 1},
+    {1, 0, 0, 0, 0, 0, 0, 3, 0, 1},
+    {1, 0, 0, 0, 0, 0, 0, 3, 0, 1},
+    {1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
+};
+static uint32_t g_default_occupancy[MAP_HEIGHT * ((MAP_WIDTH + 31) / 32)];
+static Map g_default_map;
+static pthread_once_t g_default_once = PTHREAD_ONCE_INIT;
+static const Map *g_map;
+
+#ifndef RENDER_NUMERIC
+#define RENDER_NUMERIC RENDER_NUMERIC_DOUBLE
+#endif
+
+/* Size-dependent tables of the low-precision backends: the camera-space x
+   of every column, and per row below the horizon the floor distance and
+   the floor distance covered by one row. Rebuilt when the target size
+   changes. */
+typedef struct LowTables
+{
+  int width;
+  int height;
+  Fixed *cameraX;
+  float *cameraXf;
+  Fixed *rowDist;
+  Fixed *rowSpread;
+} LowTables;
+
+/* The most runs of one fog level in a frame: the fog only grows towards
+   the horizon, so each half has at most one per level and one for 0. */
+#define FOG_RUNS (2 * (MAP_LIGHT_LEVELS + 1))
+
+/* Light levels the fog takes off floor row y of a frame `height` rows
+   high at `rate` levels per unit of depth; rows at or above the horizon
+   lose them all. Ceiling rows mirror floor rows, and rows run_ends[r - 1]
+   up to run_ends[r] share run_levels[r], the first `ceiling_runs` of
+   those runs in the ceiling. */
+typedef struct FogRows
+{
+  int height;
+  double rate;
+  uint8_t *levels;
+  int runs;
+  int ceiling_runs;
+  int run_ends[FOG_RUNS];
+  uint8_t run_levels[FOG_RUNS];
+} FogRows;
+
+/* `span_hits` holds the hits of the coalesced columns, one frame width per
+   worker. */
+struct RenderState
+{
+  const Lighting *lighting;
+  RenderNumeric numeric;
+  bool coalesce;
+  RayHit *span_hits;
+  size_t span_capacity;
+  LowTables low;
+  FogRows fog;
+};
+
+/* What the process-wide setters configure. */
+static RenderState g_state = {NULL, RENDER_NUMERIC, false, NULL, 0, {0},
+                              {0}};
+
+/* `previous` holds the hits of the last frame drawn with the history,
+   `width` columns seen from `cam` (0 for none), and `hits` receives the
+   current frame's. */
+struct RenderHistory
+{
+  RayHit *hits;
+  RayHit *previous;
+  int capacity;
+  int width;
+  const Map *map;
+  unsigned revision;
+  Camera cam;
+  int traced;
+};
+
+/* `numeric` may fall back to double for a frame whose tables could not be
+   allocated; the cameras and `lod_scale` are only set for the other
+   backends. `map` is the one drawn, under `lighting` when it is set,
+   with `fog_rows` its fog per row and `background` the colours of
+   state->fog's runs of rows from the camera's cell; `state` is what the
+   frame is drawn with and `low` its tables. `fb` is the drawn columns:
+   the target, or `view` of every ray_step-th of its columns. Column x of
+   `fb` casts ray ray_first + ray_step * x of a frame ray_width columns
+   wide, and in a row-major target lies column_pitch pixels from the
+   next. */
+typedef struct RenderJob
+{
+  RenderState *state;
+  const LowTables *low;
+  const Map *map;
+  const Framebuffer *fb;
+  Framebuffer view;
+  int ray_first;
+  int ray_step;
+  int ray_width;
+  int column_pitch;
+  const Camera *cam;
+  const Texture *textures;
+  int texture_count;
+  RenderOptions options;
+  RenderNumeric numeric;
+  RayHit *hits;
+  RenderHistory *history;
+  const Lighting *lighting;
+  const uint8_t *fog_rows;
+  uint32_t background[FOG_RUNS];
+  FixedCamera fixed_cam;
+  FloatCamera float_cam;
+  Fixed lod_scale;
+} RenderJob;
+
+static void wrap_default_map(void)
+{
+  map_wrap(&g_default_map, &g_default_tiles[0][0], g_default_occupancy,
+           MAP_WIDTH, MAP_HEIGHT);
+  g_default_map.spawn_x = 2;
+  g_default_map.spawn_y = 2;
+}
+
+const Map *render_builtin_map(void)
+{
+  pthread_once(&g_default_once, wrap_default_map);
+  return &g_default_map;
+}
+
+void render_set_map(const Map *map)
+{
+  g_map = map;
+}
+
+const Map *render_map(void)
+{
+  return g_map ? g_map : render_builtin_map();
+}
+
+void render_set_lighting(const Lighting *lighting)
+{
+  g_state.lighting = lighting;
+}
+
+const Lighting *render_lighting(void)
+{
+  return g_state.lighting;
+}
+
+void render_numeric_select(RenderNumeric numeric)
+{
+  g_state.numeric = numeric;
+}
+
+RenderNumeric render_numeric_current(void)
+{
+  return g_state.numeric;
+}
+
+bool render_numeric_available(RenderNumeric numeric)
+{
+  switch (numeric)
+  {
+  case RENDER_NUMERIC_DOUBLE:
+    return true;
+  case RENDER_NUMERIC_FLOAT:
+    return RENDER_HAS_FLOAT;
+  case RENDER_NUMERIC_FIXED:
+    return RENDER_HAS_FIXED;
+  }
+  return false;
+}
+
+RenderNumeric render_state_numeric(const RenderState *state,
+                                   const Map *map)
+{
+  if (!render_numeric_available(state->numeric) || state->lighting ||
+      map->door_count > 0)
+    return RENDER_NUMERIC_DOUBLE;
+  return state->numeric;
+}
+
+RenderNumeric render_numeric_effective(const Map *map)
+{
+  return render_state_numeric(&g_state, map);
+}
+
+void render_coalesce_select(bool enabled)
+{
+  g_state.coalesce = enabled;
+}
+
+bool render_coalesce_current(void)
+{
+  return g_state.coalesce;
+}
+
+RenderState *render_state_create(void)
+{
+  RenderState *state = calloc(1, sizeof(*state));
+  if (!state)
+  {
+    fprintf(stderr, "Out of memory for a renderer state\n");
+    return NULL;
+  }
+  state->numeric = RENDER_NUMERIC;
+  return state;
+}
+
+void render_state_destroy(RenderState *state)
+{
+  if (!state)
+    return;
+  free(state->span_hits);
+  free(state->low.cameraX);
+  free(state->fog.levels);
+  free(state);
+}
+
+void render_state_set_lighting(RenderState *state, const Lighting *lighting)
+{
+  state->lighting = lighting;
+}
+
+void render_state_set_numeric(RenderState *state, RenderNumeric numeric)
+{
+  state->numeric = numeric;
+}
+
+void render_state_set_coalesce(RenderState *state, bool enabled)
+{
+  state->coalesce = enabled;
+}
+
+const char *render_numeric_name(RenderNumeric numeric)
+{
+  switch (numeric)
+  {
+  case RENDER_NUMERIC_DOUBLE:
+    return "double";
+  case RENDER_NUMERIC_FLOAT:
+    return "float";
+  case RENDER_NUMERIC_FIXED:
+    return "fixed";
+  }
+  return "unknown";
+}
+
+bool is_walkable(double x, double y)
+{
+  const Map *map = render_map();
+  int mx = (int)x;
+  int my = (int)y;
+  if (mx < 0 || mx >= map->width || my < 0 || my >= map->height)
+  {
+    return false;
+  }
+  return !map_blocked(map, mx, my);
+}
+
+/* First pixel of column x and the distance between its rows, for the
+   layout a kernel was specialized on. */
+RENDER_INLINE uint32_t *column_start(const RenderJob *job, int x,
+                                     bool columnMajor, size_t *stride)
+{
+  const Framebuffer *fb = job->fb;
+  if (columnMajor)
+  {
+    *stride = 1;
+    return fb->pixels + (size_t)x * fb->pitch;
+  }
+  *stride = (size_t)fb->pitch;
+  return fb->pixels + (size_t)x * job->column_pitch;
+}
+
+/* Ray of column x of the job's frame. */
+RENDER_INLINE int ray_column(const RenderJob *job, int x)
+{
+  return job->ray_first + job->ray_step * x;
+}
+
+/* Points the job at `fb`, or at the columns of it its options draw. */
+static void job_target(RenderJob *job, const Framebuffer *fb)
+{
+  const int step = job->options.column_step;
+  const int first = job->options.column_first;
+  job->fb = fb;
+  job->ray_first = 0;
+  job->ray_step = 1;
+  job->ray_width = fb->width;
+  job->column_pitch = 1;
+  if (step <= 1)
+    return;
+  job->view = *fb;
+  job->view.width = first < fb->width ? (fb->width - first + step - 1) / step
+                                      : 0;
+  if (fb->column_major)
+  {
+    job->view.pixels += (size_t)first * fb->pitch;
+    job->view.pitch *= step;
+  }
+  else
+  {
+    job->view.pixels += first;
+    job->column_pitch = step;
+  }
+  job->fb = &job->view;
+  job->ray_first = first;
+  job->ray_step = step;
+}
+
+static void fill_background(const RenderJob *job, int x0, int x1,
+                            uint32_t sky, uint32_t floor)
+{
+  const Framebuffer *fb = job->fb;
+  if (fb->column_major)
+  {
+    for (int x = x0; x < x1; ++x)
+    {
+      uint32_t *column = fb->pixels + (size_t)x * fb->pitch;
+      for (int y = 0; y < fb->height; ++y)
+      {
+        column[y] = (y < fb->height / 2) ? sky : floor;
+      }
+    }
+    return;
+  }
+  for (int y = 0; y < fb->height; ++y)
+  {
+    uint32_t color = (y < fb->height / 2) ? sky : floor;
+    uint32_t *row = fb->pixels + (size_t)y * fb->pitch;
+    for (int x = x0; x < x1; ++x)
+    {
+      row[(size_t)x * job->column_pitch] = color;
+    }
+  }
+}
+
+static int hit_tile(const Map *map, const RayHit *hit)
+{
+  return map_tile(map, hit->mapX, hit->mapY);
+}
+
+static void tile_bounds(const Framebuffer *fb, int tile, int *x0, int *x1)
+{
+  *x0 = tile * RENDER_TILE_COLUMNS;
+  *x1 = *x0 + RENDER_TILE_COLUMNS;
+  if (*x1 > fb->width)
+    *x1 = fb->width;
+}
+
+static int tile_count(const Framebuffer *fb)
+{
+  return (fb->width + RENDER_TILE_COLUMNS - 1) / RENDER_TILE_COLUMNS;
+}
+
+#ifdef RENDER_TEXEL_STATS
+#define TEXEL_CACHE_SETS 64
+#define TEXEL_CACHE_WAYS 8
+
+static TexelStats g_texel_stats;
+
+/* Ways of each set ordered most to least recently used. */
+static __thread uintptr_t g_texel_cache[TEXEL_CACHE_SETS][TEXEL_CACHE_WAYS];
+
+/* Counts a fetch of the texel or palette index at `texel`. */
+static void texel_touch(const void *texel)
+{
+  uintptr_t line = ((uintptr_t)texel >> 6) + 1;
+  uintptr_t *ways = g_texel_cache[line % TEXEL_CACHE_SETS];
+  int hit = 0;
+  while (hit < TEXEL_CACHE_WAYS - 1 && ways[hit] != line)
+    ++hit;
+  if (ways[hit] != line)
+    __atomic_fetch_add(&g_texel_stats.misses, 1, __ATOMIC_RELAXED);
+  for (int i = hit; i > 0; --i)
+    ways[i] = ways[i - 1];
+  ways[0] = line;
+  __atomic_fetch_add(&g_texel_stats.fetches, 1, __ATOMIC_RELAXED);
+}
+
+#define TEXEL(p) (texel_touch(p), *(p))
+#else
+#define TEXEL(p) (*(p))
+#endif
+
+bool render_texel_stats(TexelStats *out)
+{
+#ifdef RENDER_TEXEL_STATS
+  out->fetches = __atomic_exchange_n(&g_texel_stats.fetches, 0,
+                                     __ATOMIC_RELAXED);
+  out->misses = __atomic_exchange_n(&g_texel_stats.misses, 0,
+                                    __ATOMIC_RELAXED);
+  return true;
+#else
+  out->fetches = 0;
+  out->misses = 0;
+  return false;
+#endif
+}
+
+static int level_size(int size, int level)
+{
+  size >>= level;
+  return size > 0 ? size : 1;
+}
+
+static const uint32_t *level_pixels(const Texture *tex, int level)
+{
+  return level == 0 ? tex->pixels : tex->mips[level - 1];
+}
+
+/* Flags a streamed texture as sampled this frame. Loading first keeps
+   the flag's cache line shared between workers once it is set. */
+static void mark_used(const Texture *tex)
+{
+  if (tex && tex->used && !__atomic_load_n(tex->used, __ATOMIC_RELAXED))
+    __atomic_store_n(tex->used, 1, __ATOMIC_RELAXED);
+}
+
+/* Coarsest level whose texels are still no larger than a pixel, given
+   `footprint` level-0 texels per pixel. */
+static int mip_level(const Texture *tex, double footprint)
+{
+  int level = 0;
+  while (footprint >= 2.0 && level < tex->mip_count)
+  {
+    footprint *= 0.5;
+    ++level;
+  }
+  return level;
+}
+
+static bool is_pow2(int v)
+{
+  return v > 0 && (v & (v - 1)) == 0;
+}
+
+/* Texel index along one axis. For power-of-two sizes the mask equals the
+   wrapped `%` in two's complement. */
+static int wrap_texel(int t, int size)
+{
+  if (is_pow2(size))
+    return t & (size - 1);
+  t %= size;
+  return t < 0 ? t + size : t;
+}
+
+/* World distance covered by one floor pixel at depth `dist`: the larger of
+   the step to the next column and the step to the next row, which grows
+   with the square of the depth towards the horizon. */
+static double floor_footprint(double dist, double lodScale, int h)
+{
+  return fmax(dist * lodScale, 2.0 * dist * dist / h);
+}
+
+/* Repeating lookup of world position (u, v) in one level of `tex`,
+   rounding down so the repeat carries on past the map's edges. */
+static uint32_t sample_wrapped(const Texture *tex, int level, double u,
+                               double v)
+{
+  int w = level_size(tex->width, level);
+  int h = level_size(tex->height, level);
+  int texX = wrap_texel((int)floor(u * w), w);
+  int texY = wrap_texel((int)floor(v * h), h);
+  if (level == 0 && tex->indices)
+  {
+    uint8_t index = TEXEL(tex->indices + texX * h + texY);
+    return TEXEL(tex->palette + index);
+  }
+  return TEXEL(level_pixels(tex, level) + texY * w + texX);
+}
+
+/* One level of a floor or ceiling texture, looked up once per row: its
+   size, for power-of-two sizes the shifts that take a 32.32 position to
+   a texel index, and its texels, through `palette` when `indices` is
+   set and through the lit palettes `lit` when those are. `shaded` is
+   the lit texels of a texture without a palette. */
+typedef struct FloorLevel
+{
+  int width;
+  int height;
+  bool pow2;
+  int shiftX;
+  int shiftY;
+  const uint32_t *pixels;
+  const uint8_t *indices;
+  const uint32_t *palette;
+  const uint32_t *lit;
+  const uint32_t *shaded;
+} FloorLevel;
+
+static inline int log2_size(int size)
+{
+  int bits = 0;
+  while ((1 << bits) < size)
+    ++bits;
+  return bits;
+}
+
+static inline FloorLevel floor_level(const Texture *tex, int level)
+{
+  FloorLevel out;
+  out.width = level_size(tex->width, level);
+  out.height = level_size(tex->height, level);
+  out.pow2 = is_pow2(out.width) && is_pow2(out.height);
+  out.shiftX = 32 - log2_size(out.width);
+  out.shiftY = 32 - log2_size(out.height);
+  out.pixels = level_pixels(tex, level);
+  out.indices = level == 0 ? tex->indices : NULL;
+  out.palette = tex->palette;
+  out.lit = level == 0 && tex->indices ? tex->lit : NULL;
+  out.shaded = level == 0 && !tex->indices ? tex->shaded : NULL;
+  return out;
+}
+
+/* A world coordinate as a 32.32 position. */
+static inline int64_t to_position(double v)
+{
+  return (int64_t)(v * 4294967296.0);
+}
+
+/* Column and row of the texel of `level` at the 32.32 position (u, v),
+   wrapped; `pow2` is level->pow2 when the caller knows it. */
+RENDER_INLINE void floor_coords(const FloorLevel *level, int64_t u,
+                                int64_t v, bool pow2, int *texX, int *texY)
+{
+  if (pow2)
+  {
+    *texX = (int)((u >> level->shiftX) & (level->width - 1));
+    *texY = (int)((v >> level->shiftY) & (level->height - 1));
+  }
+  else
+  {
+    *texX = wrap_texel((int)((u * level->width) >> 32), level->width);
+    *texY = wrap_texel((int)((v * level->height) >> 32), level->height);
+  }
+}
+
+/* sample_wrapped() at the 32.32 position (u, v); `pow2` is level->pow2
+   when the caller knows it. */
+RENDER_INLINE uint32_t floor_texel(const FloorLevel *level, int64_t u,
+                                   int64_t v, bool pow2)
+{
+  int texX;
+  int texY;
+  floor_coords(level, u, v, pow2, &texX, &texY);
+  if (level->indices)
+  {
+    uint8_t index = TEXEL(level->indices + texX * level->height + texY);
+    return TEXEL(level->palette + index);
+  }
+  return TEXEL(level->pixels + texY * level->width + texX);
+}
+
+/* Floor and ceiling texels of columns [x0, x1) of one row from the 32.32
+   position (u, v), advancing (du, dv) per column: adds and the texel
+   fetches. Columns whose floor starts below the row are skipped. */
+RENDER_INLINE void floor_row(uint32_t *floorRow, uint32_t *ceilRow,
+                             size_t colStride, int x0, int x1, int y,
+                             const int *floorStarts,
+                             const FloorLevel *floorLevel,
+                             const FloorLevel *ceilLevel, int64_t u,
+                             int64_t v, int64_t du, int64_t dv, bool pow2)
+{
+  for (int x = x0; x < x1; ++x, u += du, v += dv)
+  {
+    if (y < floorStarts[x - x0])
+      continue;
+    floorRow[x * colStride] = floor_texel(floorLevel, u, v, pow2);
+    ceilRow[x * colStride] = floor_texel(ceilLevel, u, v, pow2);
+  }
+}
+
+/* Rows [drawStart, drawEnd] of a wall `lineHeight` pixels tall, clipped
+   to the target. */
+static void wall_span(int h, int lineHeight, int *drawStart, int *drawEnd)
+{
+  *drawStart = -lineHeight / 2 + h / 2;
+  if (*drawStart < 0)
+  {
+    *drawStart = 0;
+  }
+  *drawEnd = lineHeight / 2 + h / 2;
+  if (*drawEnd >= h)
+  {
+    *drawEnd = h - 1;
+  }
+}
+
+/* Simple shading for y sides: every channel halved. */
+static uint32_t shade_y_side(uint32_t color)
+{
+  return ((color & 0xFEFEFE) >> 1) | 0xFF000000;
+}
+
+/* `color` through the shade table of one light level. */
+static uint32_t shade_texel(const uint8_t *shade, uint32_t color)
+{
+  return (color & 0xFF000000) | (uint32_t)shade[(color >> 16) & 0xFF] << 16 |
+         (uint32_t)shade[(color >> 8) & 0xFF] << 8 | shade[color & 0xFF];
+}
+
+/* Light levels the fog takes off a surface `dist` away. */
+static int fog_levels(const Lighting *lighting, double dist)
+{
+  double fog = dist * lighting->fog_rate;
+  return fog < MAP_LIGHT_LEVELS ? (int)fog : MAP_LIGHT_LEVELS;
+}
+
+/* Fills `fog` for frames `height` rows high under `lighting`, unless it
+   already holds them. */
+static bool fog_rows_prepare(FogRows *fog, const Lighting *lighting,
+                             int height)
+{
+  if (fog->levels && fog->height == height &&
+      fog->rate == lighting->fog_rate)
+    return true;
+  uint8_t *levels = realloc(fog->levels, (size_t)height);
+  if (!levels)
+    return false;
+  fog->levels = levels;
+  fog->height = height;
+  fog->rate = lighting->fog_rate;
+  for (int y = 0; y < height; ++y)
+    levels[y] = (uint8_t)fog_levels(
+        lighting, height / fmax(2.0 * y - height, 1e-6));
+  fog->runs = 0;
+  fog->ceiling_runs = 0;
+  for (int y = 0; y < height; ++fog->runs)
+  {
+    const bool ceiling = y < height / 2;
+    const int level = levels[ceiling ? height - 1 - y : y];
+    const int end = ceiling ? height / 2 : height;
+    while (++y < end && levels[ceiling ? height - 1 - y : y] == level)
+      ;
+    fog->run_ends[fog->runs] = y;
+    fog->run_levels[fog->runs] = (uint8_t)level;
+    if (ceiling)
+      fog->ceiling_runs = fog->runs + 1;
+  }
+  return true;
+}
+
+/* Light level of a surface in cell (x, y), clamped to the map, with `fog`
+   levels taken off. */
+static int cell_light(const Map *map, int x, int y, int fog)
+{
+  int level = MAP_LIGHT_LEVELS - 1;
+  if (map->light)
+  {
+    x = x < 0 ? 0 : (x < map->width ? x : map->width - 1);
+    y = y < 0 ? 0 : (y < map->height ? y : map->height - 1);
+    level = map->light[(size_t)y * map->width + x];
+  }
+  return level > fog ? level - fog : 0;
+}
+
+/* Points the palette and lit texels of `out`, a copy of `level`, at
+   light level `light`'s, for floor_texel_lit(). */
+RENDER_INLINE void floor_level_lit(FloorLevel *out, const FloorLevel *level,
+                                   int light)
+{
+  if (level->lit)
+    out->palette = level->lit + light * TEXTURE_PALETTE_SIZE;
+  if (level->shaded)
+    out->shaded =
+        level->shaded + (size_t)light * level->width * level->height;
+}
+
+/* floor_texel() of a floor_level_lit() level, as sample_lit() shades it:
+   one read of the lit palette or texels when the level has them, and
+   otherwise the texel through `shade`. */
+RENDER_INLINE uint32_t floor_texel_lit(const FloorLevel *level, int64_t u,
+                                       int64_t v, bool pow2,
+                                       const uint8_t *shade)
+{
+  if (level->lit)
+    return floor_texel(level, u, v, pow2);
+  if (!level->shaded)
+    return shade_texel(shade, floor_texel(level, u, v, pow2));
+  int texX;
+  int texY;
+  floor_coords(level, u, v, pow2, &texX, &texY);
+  return TEXEL(level->shaded + texX * level->height + texY);
+}
+
+/* floor_row() under lighting, `fog` levels into the distance: the light
+   is looked up again only where the row enters another cell, and not at
+   all once the fog has taken every level. Without `textured` the floor
+   and ceiling are plain colours. */
+RENDER_INLINE void floor_row_lit(const RenderJob *job, uint32_t *floorRow,
+                                 uint32_t *ceilRow, size_t colStride, int x0,
+                                 int x1, int y, const int *floorStarts,
+                                 const FloorLevel *floorLevel,
+                                 const FloorLevel *ceilLevel, int64_t u,
+                                 int64_t v, int64_t du, int64_t dv, int fog,
+                                 bool pow2, bool textured)
+{
+  const Lighting *lighting = job->lighting;
+  const bool dark = fog >= MAP_LIGHT_LEVELS - 1;
+  FloorLevel floorLit = textured ? *floorLevel : (FloorLevel){0};
+  FloorLevel ceilLit = textured ? *ceilLevel : (FloorLevel){0};
+  const uint8_t *shade = NULL;
+  uint32_t floorColor = 0;
+  uint32_t ceilColor = 0;
+  /* No cell yet: cellX differs from the first one. */
+  int cellX = ~(int)(u >> 32);
+  int cellY = 0;
+  for (int x = x0; x < x1; ++x, u += du, v += dv)
+  {
+    if (y < floorStarts[x - x0])
+      continue;
+    const int cx = (int)(u >> 32);
+    const int cy = (int)(v >> 32);
+    if (((cx ^ cellX) | (cy ^ cellY)) != 0 && (!dark || shade == NULL))
+    {
+      cellX = cx;
+      cellY = cy;
+      const int light = cell_light(job->map, cx, cy, fog);
+      shade = lighting->shade[light];
+      if (textured)
+      {
+        floor_level_lit(&floorLit, floorLevel, light);
+        floor_level_lit(&ceilLit, ceilLevel, light);
+      }
+      else
+      {
+        floorColor = shade_texel(shade, 0xFF444444);
+        ceilColor = shade_texel(shade, 0xFF222222);
+      }
+    }
+    if (textured)
+    {
+      floorColor = floor_texel_lit(&floorLit, u, v, pow2, shade);
+      ceilColor = floor_texel_lit(&ceilLit, u, v, pow2, shade);
+    }
+    floorRow[x * colStride] = floorColor;
+    ceilRow[x * colStride] = ceilColor;
+  }
+}
+
+/* Light level of the wall face `hit` shows, lit from the cell in front of
+   the face; a door panel stands in its own cell. */
+static int wall_light(const Map *map, const Lighting *lighting,
+                      const RayHit *hit)
+{
+  int x = hit->mapX;
+  int y = hit->mapY;
+  if (!hit->door && hit->side == 0)
+    x += hit->rayDirX > 0 ? -1 : 1;
+  else if (!hit->door)
+    y += hit->rayDirY > 0 ? -1 : 1;
+  int level = cell_light(map, x, y, fog_levels(lighting, hit->perpWallDist));
+  if (hit->side == 1)
+    level = level > lighting->side_drop ? level - lighting->side_drop : 0;
+  return level;
+}
+
+/* sample_wrapped() at light level `light`: level 0 of a texture with lit
+   palettes or lit texels reads the lit colour directly, anything else
+   goes through the shade table. */
+static uint32_t sample_lit(const Texture *tex, int level, double u, double v,
+                           const Lighting *lighting, int light)
+{
+  const bool shaded = !tex->indices && tex->shaded;
+  if (level != 0 || (!tex->lit && !shaded))
+  {
+    uint32_t color = sample_wrapped(tex, level, u, v);
+    return shade_texel(lighting->shade[light], color);
+  }
+  int w = tex->width;
+  int h = tex->height;
+  int texX = wrap_texel((int)floor(u * w), w);
+  int texY = wrap_texel((int)floor(v * h), h);
+  if (shaded)
+    return TEXEL(tex->shaded + ((size_t)light * w + texX) * h + texY);
+  uint8_t index = TEXEL(tex->indices + texX * h + texY);
+  return TEXEL(tex->lit + light * TEXTURE_PALETTE_SIZE + index);
+}
+
+/* fill_background() in job->background, each run of rows of one fog
+   level darkened to the light of the camera's cell less that fog. */
+static void fill_background_lit(const RenderJob *job, int x0, int x1)
+{
+  const Framebuffer *fb = job->fb;
+  const FogRows *fog = &job->state->fog;
+  if (fb->column_major)
+  {
+    for (int x = x0; x < x1; ++x)
+    {
+      uint32_t *column = fb->pixels + (size_t)x * fb->pitch;
+      for (int r = 0, y = 0; r < fog->runs; ++r)
+      {
+        for (; y < fog->run_ends[r]; ++y)
+          column[y] = job->background[r];
+      }
+    }
+    return;
+  }
+  for (int r = 0, y = 0; r < fog->runs; ++r)
+  {
+    const uint32_t color = job->background[r];
+    for (; y < fog->run_ends[r]; ++y)
+    {
+      uint32_t *row = fb->pixels + (size_t)y * fb->pitch;
+      for (int x = x0; x < x1; ++x)
+      {
+        row[(size_t)x * job->column_pitch] = color;
+      }
+    }
+  }
+}
+
+static uint32_t flat_color(int tile, int side)
+{
+  const uint32_t wall_colors[] = {
+      0xFF9B1B30, /* red */
+      0xFF2F80ED, /* blue */
+      0xFF00B894, /* teal */
+      0xFFF2C94C  /* yellow */
+  };
+
+  uint32_t color = wall_colors[(tile - 1) % 4];
+  return side == 1 ? shade_y_side(color) : color;
+}
+
+/* `lit` shades by job->lighting instead of halving y sides. */
+RENDER_INLINE void flat_tile(const RenderJob *job, int tile, bool columnMajor,
+                             bool lit)
+{
+  const Framebuffer *fb = job->fb;
+  const Camera *cam = job->cam;
+  int x0;
+  int x1;
+  tile_bounds(fb, tile, &x0, &x1);
+
+  PROFILE_SPAN_BEGIN(span);
+  if (lit)
+    fill_background_lit(job, x0, x1);
+  else
+    fill_background(job, x0, x1, RENDER_SKY, RENDER_FLOOR);
+  PROFILE_SPAN_MARK(span, PROFILE_BACKGROUND);
+
+  const int h = fb->height;
+  RayHit hits[RAY_PACKET];
+  for (int x = x0; x < x1; ++x)
+  {
+    int lane = (x - x0) % RAY_PACKET;
+    if (lane == 0 && !job->hits)
+    {
+      int count = x1 - x < RAY_PACKET ? x1 - x : RAY_PACKET;
+      cast_rays(job->map, cam, ray_column(job, x), job->ray_step, count,
+                job->ray_width, hits);
+      PROFILE_SPAN_MARK(span, PROFILE_RAYS);
+    }
+    const RayHit hit = job->hits ? job->hits[x] : hits[lane];
+
+    int lineHeight = (int)(h / fmax(hit.perpWallDist, 1e-6));
+    int drawStart;
+    int drawEnd;
+    wall_span(h, lineHeight, &drawStart, &drawEnd);
+
+    uint32_t color;
+    if (lit)
+    {
+      int light = wall_light(job->map, job->lighting, &hit);
+      color = shade_texel(job->lighting->shade[light],
+                          flat_color(hit_tile(job->map, &hit), 0));
+    }
+    else
+    {
+      color = flat_color(hit_tile(job->map, &hit), hit.side);
+    }
+    size_t stride;
+    uint32_t *column = column_start(job, x, columnMajor, &stride);
+    for (int y = drawStart; y <= drawEnd; ++y)
+    {
+      column[y * stride] = color;
+    }
+    PROFILE_SPAN_MARK(span, PROFILE_WALLS);
+  }
+  PROFILE_SPAN_END(span);
+}
+
+/* Wall rows [drawStart, drawEnd] from texel column `texels`, `texStride`
+   apart, starting `texPos` texels down and advancing `step` per row;
+   `dark` shades a y side. */
+RENDER_INLINE void wall_texels(uint32_t *column, size_t stride, int drawStart,
+                               int drawEnd, const uint32_t *texels,
+                               int texStride, int texH, double texPos,
+                               double step, bool dark)
+{
+  for (int y = drawStart; y <= drawEnd; ++y)
+  {
+    int texY = (int)texPos;
+    if (texY < 0)
+      texY = 0;
+    if (texY >= texH)
+      texY = texH - 1;
+    texPos += step;
+    uint32_t color = TEXEL(texels + texY * texStride);
+    column[y * stride] = dark ? shade_y_side(color) : color;
+  }
+}
+
+/* wall_texels() through the shade table of the column's light level. */
+RENDER_INLINE void wall_texels_lit(uint32_t *column, size_t stride,
+                                   int drawStart, int drawEnd,
+                                   const uint32_t *texels, int texStride,
+                                   int texH, double texPos, double step,
+                                   const uint8_t *shade)
+{
+  for (int y = drawStart; y <= drawEnd; ++y)
+  {
+    int texY = (int)texPos;
+    if (texY < 0)
+      texY = 0;
+    if (texY >= texH)
+      texY = texH - 1;
+    texPos += step;
+    column[y * stride] =
+        shade_texel(shade, TEXEL(texels + texY * texStride));
+  }
+}
+
+/* The half of an indexed texture's palette for walls on `side`. */
+static const uint32_t *side_palette(const Texture *tex, int side)
+{
+  return tex->palette + (side == 1 ? TEXTURE_PALETTE_SIZE : 0);
+}
+
+/* wall_texels() from a column of palette indices; `palette` is the half
+   of the texture's palette for the side, so shading costs nothing per
+   pixel. */
+RENDER_INLINE void wall_texels_indexed(uint32_t *column, size_t stride,
+                                       int drawStart, int drawEnd,
+                                       const uint8_t *indices, int texH,
+                                       double texPos, double step,
+                                       const uint32_t *palette)
+{
+  for (int y = drawStart; y <= drawEnd; ++y)
+  {
+    int texY = (int)texPos;
+    if (texY < 0)
+      texY = 0;
+    if (texY >= texH)
+      texY = texH - 1;
+    texPos += step;
+    uint8_t index = TEXEL(indices + texY);
+    column[y * stride] = TEXEL(palette + index);
+  }
+}
+
+/* wall_texels_indexed() from the unshaded palette through the shade
+   table of the column's light level. */
+RENDER_INLINE void wall_texels_indexed_lit(uint32_t *column, size_t stride,
+                                           int drawStart, int drawEnd,
+                                           const uint8_t *indices, int texH,
+                                           double texPos, double step,
+                                           const uint32_t *palette,
+                                           const uint8_t *shade)
+{
+  for (int y = drawStart; y <= drawEnd; ++y)
+  {
+    int texY = (int)texPos;
+    if (texY < 0)
+      texY = 0;
+    if (texY >= texH)
+      texY = texH - 1;
+    texPos += step;
+    uint8_t index = TEXEL(indices + texY);
+    column[y * stride] = shade_texel(shade, TEXEL(palette + index));
+  }
+}
+
+/* Rows [drawStart, drawEnd] of a wall without a texture; a set `shade`
+   lights it instead of the y-side halving. */
+static void wall_fill(uint32_t *column, size_t stride, int drawStart,
+                      int drawEnd, int side, const uint8_t *shade)
+{
+  uint32_t color = side == 1 ? shade_y_side(0xFFFFFFFF) : 0xFFFFFFFF;
+  if (shade)
+    color = shade_texel(shade, 0xFFFFFFFF);
+  for (int y = drawStart; y <= drawEnd; ++y)
+  {
+    column[y * stride] = color;
+  }
+}
+/* Floor & ceiling for one column below its wall, interpolating between
+   the player and the wall hit for perspective correct texturing.
+   `lodScale` is the world distance one pixel spans per unit of depth, or 0
+   to always sample level 0. Without `textured` the floor and ceiling are
+   plain colours and the textures are not read. `lit` shades each pixel by
+   the light of the cell it shows. */
+RENDER_INLINE void floor_column(const RenderJob *job, const RayHit *hit,
+                                double wallX, int floorStart, int h,
+                                uint32_t *column, size_t stride,
+                                const Texture *floorTex,
+                                const Texture *ceilTex, double lodScale,
+                                bool textured, bool mipmaps, bool lit)
+{
+  const Camera *cam = job->cam;
+  const int mapX = hit->mapX;
+  const int mapY = hit->mapY;
+  const int side = hit->side;
+
+  double floorXWall;
+  double floorYWall;
+  if (hit->door)
+  {
+    floorXWall = side == 0 ? mapX + 0.5 : mapX + wallX;
+    floorYWall = side == 0 ? mapY + wallX : mapY + 0.5;
+  }
+  else if (side == 0 && hit->rayDirX > 0)
+  {
+    floorXWall = mapX;
+    floorYWall = mapY + wallX;
+  }
+  else if (side == 0 && hit->rayDirX < 0)
+  {
+    floorXWall = mapX + 1.0;
+    floorYWall = mapY + wallX;
+  }
+  else if (side == 1 && hit->rayDirY > 0)
+  {
+    floorXWall = mapX + wallX;
+    floorYWall = mapY;
+  }
+  else
+  {
+    floorXWall = mapX + wallX;
+    floorYWall = mapY + 1.0;
+  }
+
+  double distWall = hit->perpWallDist;
+  double distPlayer = 0.0;
+  /* The cell under the last lit pixel and its light before the fog. */
+  int cellX = 0;
+  int cellY = 0;
+  int cellLevel = -1;
+
+  for (int y = floorStart; y < h; ++y)
+  {
+    double denom = 2.0 * y - h;
+    double currentDist = h / fmax(denom, 1e-6);
+    double weight = (currentDist - distPlayer) / (distWall - distPlayer);
+    double currentFloorX = weight * floorXWall + (1.0 - weight) * cam->posX;
+    double currentFloorY = weight * floorYWall + (1.0 - weight) * cam->posY;
+
+    uint32_t floorColor = 0xFF444444;
+    uint32_t ceilColor = 0xFF222222;
+    int light = 0;
+    if (lit)
+    {
+      const int cx = (int)currentFloorX;
+      const int cy = (int)currentFloorY;
+      if (cellLevel < 0 || cx != cellX || cy != cellY)
+      {
+        cellX = cx;
+        cellY = cy;
+        cellLevel = cell_light(job->map, cx, cy, 0);
+      }
+      const int fog = job->fog_rows[y];
+      light = cellLevel > fog ? cellLevel - fog : 0;
+    }
+    if (textured)
+    {
+      double footprint = mipmaps && lodScale > 0.0
+                             ? floor_footprint(currentDist, lodScale, h)
+                             : 0.0;
+      int floorLevel = mip_level(floorTex, footprint * floorTex->width);
+      int ceilLevel = mip_level(ceilTex, footprint * ceilTex->width);
+      if (lit)
+      {
+        floorColor = sample_lit(floorTex, floorLevel, currentFloorX,
+                                currentFloorY, job->lighting, light);
+        ceilColor = sample_lit(ceilTex, ceilLevel, currentFloorX,
+                               currentFloorY, job->lighting, light);
+      }
+      else
+      {
+        floorColor = sample_wrapped(floorTex, floorLevel, currentFloorX,
+                                    currentFloorY);
+        ceilColor =
+            sample_wrapped(ceilTex, ceilLevel, currentFloorX, currentFloorY);
+      }
+    }
+    else if (lit)
+    {
+      floorColor = shade_texel(job->lighting->shade[light], floorColor);
+      ceilColor = shade_texel(job->lighting->shade[light], ceilColor);
+    }
+
+    column[y * stride] = floorColor;
+    int ceilY = h - y - 1;
+    if (ceilY >= 0)
+      column[ceilY * stride] = ceilColor;
+  }
+}
+
+/* Floor & ceiling one row at a time across the tile: every pixel of a row
+   is at the same distance, so the world position, held in 32.32, advances
+   by a constant step per column. Texture levels are looked up once per
+   row, and the inner loop is two adds and the texel fetches, which
+   power-of-two textures wrap with a shift and a mask. Only pixels below
+   each column's wall (and their mirrored ceiling) are written, exactly
+   as in floor_column(). */
+RENDER_INLINE void floor_scanlines(const RenderJob *job, int x0, int x1,
+                                   const int *floorStarts,
+                                   const Texture *floorTex,
+                                   const Texture *ceilTex, double lodScale,
+                                   bool textured, bool mipmaps,
+                                   bool columnMajor, bool lit)
+{
+  const Framebuffer *fb = job->fb;
+  const Camera *cam = job->cam;
+  const int h = fb->height;
+  int firstRow = h;
+  for (int x = x0; x < x1; ++x)
+  {
+    if (floorStarts[x - x0] < firstRow)
+      firstRow = floorStarts[x - x0];
+  }
+
+  double cameraX = 2.0 * ray_column(job, x0) / (double)job->ray_width - 1.0;
+  double rayDirX = cam->dirX + cam->planeX * cameraX;
+  double rayDirY = cam->dirY + cam->planeY * cameraX;
+  double rayStepX = 2.0 * job->ray_step * cam->planeX / job->ray_width;
+  double rayStepY = 2.0 * job->ray_step * cam->planeY / job->ray_width;
+
+  size_t rowStride;
+  uint32_t *origin = column_start(job, 0, columnMajor, &rowStride);
+  const size_t colStride =
+      columnMajor ? (size_t)fb->pitch : (size_t)job->column_pitch;
+
+  for (int y = firstRow; y < h; ++y)
+  {
+    double denom = 2.0 * y - h;
+    double rowDist = h / fmax(denom, 1e-6);
+    int64_t u = to_position(cam->posX + rowDist * rayDirX);
+    int64_t v = to_position(cam->posY + rowDist * rayDirY);
+    const int64_t du = to_position(rowDist * rayStepX);
+    const int64_t dv = to_position(rowDist * rayStepY);
+    uint32_t *floorRow = origin + (size_t)y * rowStride;
+    uint32_t *ceilRow = origin + (size_t)(h - y - 1) * rowStride;
+
+    if (lit && !textured)
+    {
+      floor_row_lit(job, floorRow, ceilRow, colStride, x0, x1, y,
+                    floorStarts, NULL, NULL, u, v, du, dv, job->fog_rows[y],
+                    false, false);
+      continue;
+    }
+    if (!textured)
+    {
+      for (int x = x0; x < x1; ++x)
+      {
+        if (y < floorStarts[x - x0])
+          continue;
+        floorRow[x * colStride] = 0xFF444444;
+        ceilRow[x * colStride] = 0xFF222222;
+      }
+      continue;
+    }
+
+    double footprint = mipmaps && lodScale > 0.0
+                           ? floor_footprint(rowDist, lodScale, h)
+                           : 0.0;
+    const FloorLevel floorLevel =
+        floor_level(floorTex, mip_level(floorTex, footprint * floorTex->width));
+    const FloorLevel ceilLevel =
+        floor_level(ceilTex, mip_level(ceilTex, footprint * ceilTex->width));
+    const bool pow2 = floorLevel.pow2 && ceilLevel.pow2;
+    if (lit && pow2)
+    {
+      floor_row_lit(job, floorRow, ceilRow, colStride, x0, x1, y,
+                    floorStarts, &floorLevel, &ceilLevel, u, v, du, dv,
+                    job->fog_rows[y], true, true);
+    }
+    else if (lit)
+    {
+      floor_row_lit(job, floorRow, ceilRow, colStride, x0, x1, y,
+                    floorStarts, &floorLevel, &ceilLevel, u, v, du, dv,
+                    job->fog_rows[y], false, true);
+    }
+    else if (pow2)
+    {
+      floor_row(floorRow, ceilRow, colStride, x0, x1, y, floorStarts,
+                &floorLevel, &ceilLevel, u, v, du, dv, true);
+    }
+    else
+    {
+      floor_row(floorRow, ceilRow, colStride, x0, x1, y, floorStarts,
+                &floorLevel, &ceilLevel, u, v, du, dv, false);
+    }
+  }
+}
+
+/* `lit` shades by job->lighting instead of halving y sides; `floored`
+   is whether the job has a floor texture. */
+RENDER_INLINE void textured_tile(const RenderJob *job, int tile,
+                                 bool floored, bool scanline, bool mipmaps,
+                                 bool columnMajor, bool lit)
+{
+  const Framebuffer *fb = job->fb;
+  const Camera *cam = job->cam;
+  const Texture *textures = job->textures;
+  const int texture_count = job->texture_count;
+  int x0;
+  int x1;
+  tile_bounds(fb, tile, &x0, &x1);
+
+  PROFILE_SPAN_BEGIN(span);
+  if (lit)
+    fill_background_lit(job, x0, x1);
+  else
+    fill_background(job, x0, x1, RENDER_SKY, RENDER_FLOOR);
+  PROFILE_SPAN_MARK(span, PROFILE_BACKGROUND);
+
+  const Texture *floorTex = floored ? &textures[1] : NULL;
+  const Texture *ceilTex =
+      (floored && texture_count > 2) ? &textures[2] : floorTex;
+  mark_used(floorTex);
+  mark_used(ceilTex);
+  const Texture *lastTex = NULL;
+
+  const int h = fb->height;
+  const double lodScale =
+      mipmaps ? 2.0 * hypot(cam->planeX, cam->planeY) / job->ray_width : 0.0;
+  int floorStarts[RENDER_TILE_COLUMNS];
+  RayHit hits[RAY_PACKET];
+  for (int x = x0; x < x1; ++x)
+  {
+    int lane = (x - x0) % RAY_PACKET;
+    if (lane == 0 && !job->hits)
+    {
+      int count = x1 - x < RAY_PACKET ? x1 - x : RAY_PACKET;
+      cast_rays(job->map, cam, ray_column(job, x), job->ray_step, count,
+                job->ray_width, hits);
+      PROFILE_SPAN_MARK(span, PROFILE_RAYS);
+    }
+    const RayHit hit = job->hits ? job->hits[x] : hits[lane];
+    const double rayDirX = hit.rayDirX;
+    const double rayDirY = hit.rayDirY;
+    const int side = hit.side;
+    const double perpWallDist = hit.perpWallDist;
+    if (job->options.depth)
+      job->options.depth[x] = perpWallDist;
+
+    int lineHeight = (int)(h / fmax(perpWallDist, 1e-6));
+    int drawStart;
+    int drawEnd;
+    wall_span(h, lineHeight, &drawStart, &drawEnd);
+
+    int tile = hit_tile(job->map, &hit);
+    const Texture *tex =
+        (tile > 0 && tile <= texture_count) ? &textures[tile - 1] : NULL;
+    if (tex != lastTex)
+    {
+      mark_used(tex);
+      lastTex = tex;
+    }
+
+    double wallX;
+    if (side == 0)
+    {
+      wallX = cam->posY + perpWallDist * rayDirY;
+    }
+    else
+    {
+      wallX = cam->posX + perpWallDist * rayDirX;
+    }
+    wallX -= floor(wallX);
+
+    size_t stride;
+    uint32_t *column = column_start(job, x, columnMajor, &stride);
+    const int light = lit ? wall_light(job->map, job->lighting, &hit) : 0;
+    const uint8_t *shade = lit ? job->lighting->shade[light] : NULL;
+    if (tex)
+    {
+      int level = 0;
+      if (mipmaps)
+      {
+        level = mip_level(tex, (double)tex->height / lineHeight);
+      }
+      const int texW = level_size(tex->width, level);
+      const int texH = level_size(tex->height, level);
+
+      /* A door's texture slides with its panel. */
+      int texX = (int)((wallX - hit.shift) * texW);
+      if (side == 0 && rayDirX > 0)
+        texX = texW - texX - 1;
+      if (side == 1 && rayDirY < 0)
+        texX = texW - texX - 1;
+
+      double step = (double)texH / lineHeight;
+      double texPos = (drawStart - h / 2.0 + lineHeight / 2.0) * step;
+
+      /* Texel column texX, read down the sequential copy when present. */
+      bool columns = tex->columns && level == 0;
+      const uint32_t *texels = columns ? tex->columns + texX * tex->height
+                                       : level_pixels(tex, level) + texX;
+      const int texStride = columns ? 1 : texW;
+      if (lit && level == 0 && tex->lit)
+        wall_texels_indexed(column, stride, drawStart, drawEnd,
+                            tex->indices + texX * texH, texH, texPos, step,
+                            tex->lit + light * TEXTURE_PALETTE_SIZE);
+      else if (lit && level == 0 && !tex->indices && tex->shaded)
+        wall_texels(column, stride, drawStart, drawEnd,
+                    tex->shaded + ((size_t)light * texW + texX) * texH, 1,
+                    texH, texPos, step, false);
+      else if (lit && level == 0 && tex->indices)
+        wall_texels_indexed_lit(column, stride, drawStart, drawEnd,
+                                tex->indices + texX * texH, texH, texPos,
+                                step, tex->palette, shade);
+      else if (lit)
+        wall_texels_lit(column, stride, drawStart, drawEnd, texels,
+                        texStride, texH, texPos, step, shade);
+      else if (level == 0 && tex->indices)
+        wall_texels_indexed(column, stride, drawStart, drawEnd,
+                            tex->indices + texX * texH, texH, texPos, step,
+                            side_palette(tex, side));
+      else if (side == 1)
+        wall_texels(column, stride, drawStart, drawEnd, texels, texStride,
+                    texH, texPos, step, true);
+      else
+        wall_texels(column, stride, drawStart, drawEnd, texels, texStride,
+                    texH, texPos, step, false);
+    }
+    else
+    {
+      wall_fill(column, stride, drawStart, drawEnd, side, shade);
+    }
+    PROFILE_SPAN_MARK(span, PROFILE_WALLS);
+
+    int floorStart = drawEnd + 1;
+    if (floorStart < 0)
+      floorStart = 0;
+    if (scanline)
+    {
+      floorStarts[x - x0] = floorStart;
+    }
+    else
+    {
+      floor_column(job, &hit, wallX, floorStart, h, column, stride, floorTex,
+                   ceilTex, lodScale, floored, floored && mipmaps, lit);
+    }
+    PROFILE_SPAN_MARK(span, PROFILE_FLOOR);
+  }
+
+  if (scanline)
+  {
+    floor_scanlines(job, x0, x1, floorStarts, floorTex, ceilTex, lodScale,
+                    floored, floored && mipmaps, columnMajor, lit);
+    PROFILE_SPAN_MARK(span, PROFILE_FLOOR);
+  }
+  PROFILE_SPAN_END(span);
+}
+
+#if RENDER_HAS_LOW
+/* Builds `low` for a `width` x `height` target. */
+static bool low_tables_prepare(LowTables *low, int width, int height)
+{
+  if (low->cameraX && low->width == width && low->height == height)
+    return true;
+
+  fixed_init();
+  size_t words = (size_t)width * 2 + (size_t)height * 2;
+  void *block = realloc(low->cameraX, words * sizeof(Fixed));
+  if (!block)
+    return false;
+  low->width = width;
+  low->height = height;
+  low->cameraX = block;
+  low->cameraXf = (float *)(low->cameraX + width);
+  low->rowDist = low->cameraX + 2 * (size_t)width;
+  low->rowSpread = low->rowDist + height;
+
+  for (int x = 0; x < width; ++x)
+  {
+    double cameraX = 2.0 * x / (double)width - 1.0;
+    low->cameraX[x] = fixed_from_double(cameraX);
+    low->cameraXf[x] = (float)cameraX;
+  }
+  /* Rows at or above the horizon never hold floor; they get the distance
+     of the first row below it. */
+  for (int y = 0; y < height; ++y)
+  {
+    double dist = height / fmax(2.0 * y - height, 1.0);
+    low->rowDist[y] = fixed_from_double(dist);
+    low->rowSpread[y] = fixed_from_double(fmin(2.0 * dist * dist / height,
+                                                32767.0));
+  }
+  return true;
+}
+
+static void cast_ray_low(const RenderJob *job, int x, RayHitFixed *hit)
+{
+  x = ray_column(job, x);
+#if RENDER_HAS_FLOAT && RENDER_HAS_FIXED
+  if (job->numeric == RENDER_NUMERIC_FLOAT)
+    cast_ray_float(job->map, &job->float_cam, job->low->cameraXf[x], hit);
+  else
+    cast_ray_fixed(job->map, &job->fixed_cam, job->low->cameraX[x], hit);
+#elif RENDER_HAS_FLOAT
+  cast_ray_float(job->map, &job->float_cam, job->low->cameraXf[x], hit);
+#else
+  cast_ray_fixed(job->map, &job->fixed_cam, job->low->cameraX[x], hit);
+#endif
+}
+
+/* h / perpWallDist truncated, as in the double path, but from the
+   reciprocal table. */
+static int line_height_low(int h, Fixed perpWallDist)
+{
+  uint64_t lineHeight =
+      ((uint64_t)h * fixed_recip((uint32_t)perpWallDist)) >> FIXED_SHIFT;
+  return lineHeight < (1u << 30) ? (int)lineHeight : 1 << 30;
+}
+
+/* mip_level() for a 16.16 footprint. */
+static int mip_level_fixed(const Texture *tex, uint64_t footprint)
+{
+  int level = 0;
+  while (footprint >= 2 * FIXED_ONE && level < tex->mip_count)
+  {
+    footprint >>= 1;
+    ++level;
+  }
+  return level;
+}
+
+/* sample_wrapped() for in-cell positions (u, v) in 16.16; the camera's
+   cell is a whole number of texture repeats away. */
+static uint32_t sample_wrapped_fixed(const Texture *tex, int level, Fixed u,
+                                     Fixed v)
+{
+  int w = level_size(tex->width, level);
+  int h = level_size(tex->height, level);
+  int texX = wrap_texel((int)(((int64_t)u * w) >> FIXED_SHIFT), w);
+  int texY = wrap_texel((int)(((int64_t)v * h) >> FIXED_SHIFT), h);
+  if (level == 0 && tex->indices)
+  {
+    uint8_t index = TEXEL(tex->indices + texX * h + texY);
+    return TEXEL(tex->palette + index);
+  }
+  return TEXEL(level_pixels(tex, level) + texY * w + texX);
+}
+
+/* wall_texels() with a 16.16 texture position and step. */
+RENDER_INLINE void wall_texels_low(uint32_t *column, size_t stride,
+                                   int drawStart, int drawEnd,
+                                   const uint32_t *texels, int texStride,
+                                   int texH, int64_t texPos, int64_t step,
+                                   bool dark)
+{
+  for (int y = drawStart; y <= drawEnd; ++y)
+  {
+    int texY = (int)(texPos >> FIXED_SHIFT);
+    if (texY < 0)
+      texY = 0;
+    if (texY >= texH)
+      texY = texH - 1;
+    texPos += step;
+    uint32_t color = TEXEL(texels + texY * texStride);
+    column[y * stride] = dark ? shade_y_side(color) : color;
+  }
+}
+
+/* wall_texels_indexed() with a 16.16 texture position and step. */
+RENDER_INLINE void wall_texels_indexed_low(uint32_t *column, size_t stride,
+                                           int drawStart, int drawEnd,
+                                           const uint8_t *indices, int texH,
+                                           int64_t texPos, int64_t step,
+                                           const uint32_t *palette)
+{
+  for (int y = drawStart; y <= drawEnd; ++y)
+  {
+    int texY = (int)(texPos >> FIXED_SHIFT);
+    if (texY < 0)
+      texY = 0;
+    if (texY >= texH)
+      texY = texH - 1;
+    texPos += step;
+    uint8_t index = TEXEL(indices + texY);
+    column[y * stride] = TEXEL(palette + index);
+  }
+}
+
+/* Mip levels of the floor and ceiling under row y. */
+RENDER_INLINE void floor_levels_low(const RenderJob *job, int y,
+                                    const Texture *floorTex,
+                                    const Texture *ceilTex, int *floorLevel,
+                                    int *ceilLevel, bool mipmaps)
+{
+  *floorLevel = 0;
+  *ceilLevel = 0;
+  if (mipmaps && job->lod_scale > 0)
+  {
+    Fixed footprint = fixed_mul(job->low->rowDist[y], job->lod_scale);
+    if (footprint < job->low->rowSpread[y])
+      footprint = job->low->rowSpread[y];
+    *floorLevel =
+        mip_level_fixed(floorTex, (uint64_t)footprint * floorTex->width);
+    *ceilLevel =
+        mip_level_fixed(ceilTex, (uint64_t)footprint * ceilTex->width);
+  }
+}
+
+/* Floor and ceiling texels of row y at in-cell position (u, v). */
+RENDER_INLINE void floor_texels_low(const RenderJob *job, int y, Fixed u,
+                                    Fixed v, const Texture *floorTex,
+                                    const Texture *ceilTex,
+                                    uint32_t *floorColor,
+                                    uint32_t *ceilColor, bool mipmaps)
+{
+  int floorLevel;
+  int ceilLevel;
+  floor_levels_low(job, y, floorTex, ceilTex, &floorLevel, &ceilLevel,
+                   mipmaps);
+  *floorColor = sample_wrapped_fixed(floorTex, floorLevel, u, v);
+  *ceilColor = sample_wrapped_fixed(ceilTex, ceilLevel, u, v);
+}
+
+/* floor_column() from the row distance table: the floor under row y is
+   rowDist[y] along the column's ray, so there is no per-pixel divide. */
+RENDER_INLINE void floor_column_low(const RenderJob *job,
+                                    const RayHitFixed *hit, int floorStart,
+                                    int h, uint32_t *column, size_t stride,
+                                    const Texture *floorTex,
+                                    const Texture *ceilTex, bool textured,
+                                    bool mipmaps)
+{
+  for (int y = floorStart; y < h; ++y)
+  {
+    uint32_t floorColor = 0xFF444444;
+    uint32_t ceilColor = 0xFF222222;
+    if (textured)
+    {
+      Fixed dist = job->low->rowDist[y];
+      floor_texels_low(job, y,
+                       job->fixed_cam.fracX + fixed_mul(dist, hit->rayDirX),
+                       job->fixed_cam.fracY + fixed_mul(dist, hit->rayDirY),
+                       floorTex, ceilTex, &floorColor, &ceilColor, mipmaps);
+    }
+
+    column[y * stride] = floorColor;
+    int ceilY = h - y - 1;
+    if (ceilY >= 0)
+      column[ceilY * stride] = ceilColor;
+  }
+}
+
+/* floor_scanlines() on the row distance table: the first column's
+   position is exact in 32.32, and the step per column is the row
+   distance times the mean step between the tile's rays, so the inner
+   loop is adds and the texel fetches. It differs from floor_column_low()
+   only where rounding lands on a texel edge. */
+RENDER_INLINE void floor_scanlines_low(const RenderJob *job, int x0, int x1,
+                                       const int *floorStarts,
+                                       const Fixed *rayDirX,
+                                       const Fixed *rayDirY,
+                                       const Texture *floorTex,
+                                       const Texture *ceilTex, bool textured,
+                                       bool mipmaps, bool columnMajor)
+{
+  const Framebuffer *fb = job->fb;
+  const int h = fb->height;
+  int firstRow = h;
+  for (int x = x0; x < x1; ++x)
+  {
+    if (floorStarts[x - x0] < firstRow)
+      firstRow = floorStarts[x - x0];
+  }
+
+  size_t rowStride;
+  uint32_t *origin = column_start(job, 0, columnMajor, &rowStride);
+  const size_t colStride =
+      columnMajor ? (size_t)fb->pitch : (size_t)job->column_pitch;
+
+  /* Ray steps per column in 16.32, scaled up by a multiply since the
+     differences may be negative. */
+  const int last = x1 - x0 - 1;
+  const int64_t rayStepX =
+      last > 0 ? (int64_t)(rayDirX[last] - rayDirX[0]) * 65536 / last : 0;
+  const int64_t rayStepY =
+      last > 0 ? (int64_t)(rayDirY[last] - rayDirY[0]) * 65536 / last : 0;
+  const int64_t fracX = (int64_t)job->fixed_cam.fracX << 16;
+  const int64_t fracY = (int64_t)job->fixed_cam.fracY << 16;
+
+  for (int y = firstRow; y < h; ++y)
+  {
+    uint32_t *floorRow = origin + (size_t)y * rowStride;
+    uint32_t *ceilRow = origin + (size_t)(h - y - 1) * rowStride;
+    if (!textured)
+    {
+      for (int x = x0; x < x1; ++x)
+      {
+        if (y < floorStarts[x - x0])
+          continue;
+        floorRow[x * colStride] = 0xFF444444;
+        ceilRow[x * colStride] = 0xFF222222;
+      }
+      continue;
+    }
+
+    const int64_t dist = job->low->rowDist[y];
+    int floorMip;
+    int ceilMip;
+    floor_levels_low(job, y, floorTex, ceilTex, &floorMip, &ceilMip,
+                     mipmaps);
+    const FloorLevel floorLevel = floor_level(floorTex, floorMip);
+    const FloorLevel ceilLevel = floor_level(ceilTex, ceilMip);
+    const int64_t u = fracX + dist * rayDirX[0];
+    const int64_t v = fracY + dist * rayDirY[0];
+    const int64_t du = (dist * rayStepX) >> 16;
+    const int64_t dv = (dist * rayStepY) >> 16;
+    if (floorLevel.pow2 && ceilLevel.pow2)
+      floor_row(floorRow, ceilRow, colStride, x0, x1, y, floorStarts,
+                &floorLevel, &ceilLevel, u, v, du, dv, true);
+    else
+      floor_row(floorRow, ceilRow, colStride, x0, x1, y, floorStarts,
+                &floorLevel, &ceilLevel, u, v, du, dv, false);
+  }
+}
+
+RENDER_INLINE void flat_tile_low(const RenderJob *job, int tile,
+                                 bool columnMajor)
+{
+  const Framebuffer *fb = job->fb;
+  int x0;
+  int x1;
+  tile_bounds(fb, tile, &x0, &x1);
+
+  PROFILE_SPAN_BEGIN(span);
+  fill_background(job, x0, x1, RENDER_SKY, RENDER_FLOOR);
+  PROFILE_SPAN_MARK(span, PROFILE_BACKGROUND);
+
+  const int h = fb->height;
+  for (int x = x0; x < x1; ++x)
+  {
+    RayHitFixed hit;
+    cast_ray_low(job, x, &hit);
+    PROFILE_SPAN_MARK(span, PROFILE_RAYS);
+
+    int drawStart;
+    int drawEnd;
+    wall_span(h, line_height_low(h, hit.perpWallDist), &drawStart, &drawEnd);
+
+    uint32_t color =
+        flat_color(map_tile(job->map, hit.mapX, hit.mapY), hit.side);
+    size_t stride;
+    uint32_t *column = column_start(job, x, columnMajor, &stride);
+    for (int y = drawStart; y <= drawEnd; ++y)
+    {
+      column[y * stride] = color;
+    }
+    PROFILE_SPAN_MARK(span, PROFILE_WALLS);
+  }
+  PROFILE_SPAN_END(span);
+}
+
+/* textured_tile() on a low-precision backend: texture rows advance
+   by a 16.16 step instead of a double. */
+RENDER_INLINE void textured_tile_low(const RenderJob *job, int tile,
+                                     bool floored, bool scanline,
+                                     bool mipmaps, bool columnMajor)
+{
+  const Framebuffer *fb = job->fb;
+  const Texture *textures = job->textures;
+  const int texture_count = job->texture_count;
+  int x0;
+  int x1;
+  tile_bounds(fb, tile, &x0, &x1);
+
+  PROFILE_SPAN_BEGIN(span);
+  fill_background(job, x0, x1, RENDER_SKY, RENDER_FLOOR);
+  PROFILE_SPAN_MARK(span, PROFILE_BACKGROUND);
+
+  const Texture *floorTex = floored ? &textures[1] : NULL;
+  const Texture *ceilTex =
+      (floored && texture_count > 2) ? &textures[2] : floorTex;
+  mark_used(floorTex);
+  mark_used(ceilTex);
+  const Texture *lastTex = NULL;
+
+  const int h = fb->height;
+  int floorStarts[RENDER_TILE_COLUMNS];
+  Fixed rayDirX[RENDER_TILE_COLUMNS];
+  Fixed rayDirY[RENDER_TILE_COLUMNS];
+  for (int x = x0; x < x1; ++x)
+  {
+    RayHitFixed hit;
+    cast_ray_low(job, x, &hit);
+    PROFILE_SPAN_MARK(span, PROFILE_RAYS);
+    const int side = hit.side;
+    if (job->options.depth)
+      job->options.depth[x] = (double)hit.perpWallDist / FIXED_ONE;
+
+    int lineHeight = line_height_low(h, hit.perpWallDist);
+    int drawStart;
+    int drawEnd;
+    wall_span(h, lineHeight, &drawStart, &drawEnd);
+
+    int tile = map_tile(job->map, hit.mapX, hit.mapY);
+    const Texture *tex =
+        (tile > 0 && tile <= texture_count) ? &textures[tile - 1] : NULL;
+    if (tex != lastTex)
+    {
+      mark_used(tex);
+      lastTex = tex;
+    }
+
+    size_t stride;
+    uint32_t *column = column_start(job, x, columnMajor, &stride);
+    if (tex)
+    {
+      /* 65536 / lineHeight: the level-0 texels per pixel, then the step. */
+      uint64_t perPixel =
+          fixed_recip((uint32_t)(lineHeight > 0 ? lineHeight : 1));
+      int level = 0;
+      if (mipmaps)
+      {
+        level = mip_level_fixed(tex, (uint64_t)tex->height * perPixel >>
+                                         FIXED_SHIFT);
+      }
+      const int texW = level_size(tex->width, level);
+      const int texH = level_size(tex->height, level);
+
+      int texX = (int)(((int64_t)hit.wallX * texW) >> FIXED_SHIFT);
+      if (side == 0 && hit.rayDirX > 0)
+        texX = texW - texX - 1;
+      if (side == 1 && hit.rayDirY < 0)
+        texX = texW - texX - 1;
+
+      int64_t step = (int64_t)((uint64_t)texH * perPixel >> FIXED_SHIFT);
+      int64_t texPos =
+          ((int64_t)(2 * drawStart - h + lineHeight) * step) >> 1;
+
+      bool columns = tex->columns && level == 0;
+      const uint32_t *texels = columns ? tex->columns + texX * tex->height
+                                       : level_pixels(tex, level) + texX;
+      const int texStride = columns ? 1 : texW;
+      if (level == 0 && tex->indices)
+        wall_texels_indexed_low(column, stride, drawStart, drawEnd,
+                                tex->indices + texX * texH, texH, texPos,
+                                step, side_palette(tex, side));
+      else if (side == 1)
+        wall_texels_low(column, stride, drawStart, drawEnd, texels,
+                        texStride, texH, texPos, step, true);
+      else
+        wall_texels_low(column, stride, drawStart, drawEnd, texels,
+                        texStride, texH, texPos, step, false);
+    }
+    else
+    {
+      wall_fill(column, stride, drawStart, drawEnd, side, NULL);
+    }
+    PROFILE_SPAN_MARK(span, PROFILE_WALLS);
+
+    int floorStart = drawEnd + 1;
+    if (floorStart < 0)
+      floorStart = 0;
+    if (scanline)
+    {
+      floorStarts[x - x0] = floorStart;
+      rayDirX[x - x0] = hit.rayDirX;
+      rayDirY[x - x0] = hit.rayDirY;
+    }
+    else
+    {
+      floor_column_low(job, &hit, floorStart, h, column, stride, floorTex,
+                       ceilTex, floored, floored && mipmaps);
+    }
+    PROFILE_SPAN_MARK(span, PROFILE_FLOOR);
+  }
+
+  if (scanline)
+  {
+    floor_scanlines_low(job, x0, x1, floorStarts, rayDirX, rayDirY,
+                        floorTex, ceilTex, floored, floored && mipmaps,
+                        columnMajor);
+    PROFILE_SPAN_MARK(span, PROFILE_FLOOR);
+  }
+  PROFILE_SPAN_END(span);
+}
+#endif
+
+/* Every combination of the compile-time choices as its own work item
+   function, generated from the inline kernels above. Kernel tables are
+   indexed [floor texture][floor == FLOOR_SCANLINE][mipmaps][column_major];
+   the `_flat` kernels draw untextured floors. */
+#define RENDER_FLAT_KERNEL(name, body, columnMajor)                          \
+  static void name(void *arg, int tile, int worker)                          \
+  {                                                                          \
+    (void)worker;                                                            \
+    body(arg, tile, columnMajor);                                            \
+  }
+#define RENDER_TEXTURED_KERNEL(name, body, floored, scanline, mipmaps,       \
+                               columnMajor)                                  \
+  static void name(void *arg, int tile, int worker)                          \
+  {                                                                          \
+    (void)worker;                                                            \
+    body(arg, tile, floored, scanline, mipmaps, columnMajor);                \
+  }
+#define RENDER_TEXTURED_FLOOR_KERNELS(prefix, body, floored)                 \
+  RENDER_TEXTURED_KERNEL(prefix##_cols, body, floored, false, false, false)  \
+  RENDER_TEXTURED_KERNEL(prefix##_cols_cm, body, floored, false, false,      \
+                         true)                                               \
+  RENDER_TEXTURED_KERNEL(prefix##_cols_mip, body, floored, false, true,      \
+                         false)                                              \
+  RENDER_TEXTURED_KERNEL(prefix##_cols_mip_cm, body, floored, false, true,   \
+                         true)                                               \
+  RENDER_TEXTURED_KERNEL(prefix##_scan, body, floored, true, false, false)   \
+  RENDER_TEXTURED_KERNEL(prefix##_scan_cm, body, floored, true, false, true) \
+  RENDER_TEXTURED_KERNEL(prefix##_scan_mip, body, floored, true, true,       \
+                         false)                                              \
+  RENDER_TEXTURED_KERNEL(prefix##_scan_mip_cm, body, floored, true, true,    \
+                         true)
+#define RENDER_TEXTURED_FLOOR_TABLE(prefix)                                  \
+  {{{prefix##_cols, prefix##_cols_cm},                                       \
+    {prefix##_cols_mip, prefix##_cols_mip_cm}},                              \
+   {{prefix##_scan, prefix##_scan_cm},                                       \
+    {prefix##_scan_mip, prefix##_scan_mip_cm}}}
+#define RENDER_TEXTURED_KERNELS(prefix, body)                                \
+  RENDER_TEXTURED_FLOOR_KERNELS(prefix##_flat, body, false)                  \
+  RENDER_TEXTURED_FLOOR_KERNELS(prefix, body, true)                          \
+  static const WorkerFn prefix##_kernels[2][2][2][2] = {                     \
+      RENDER_TEXTURED_FLOOR_TABLE(prefix##_flat),                            \
+      RENDER_TEXTURED_FLOOR_TABLE(prefix)};
+
+/* The double backend's tiles with lighting folded in or out. */
+RENDER_INLINE void flat_tile_unlit(const RenderJob *job, int tile,
+                                   bool columnMajor)
+{
+  flat_tile(job, tile, columnMajor, false);
+}
+
+RENDER_INLINE void flat_tile_lit(const RenderJob *job, int tile,
+                                 bool columnMajor)
+{
+  flat_tile(job, tile, columnMajor, true);
+}
+
+RENDER_INLINE void textured_tile_unlit(const RenderJob *job, int tile,
+                                       bool floored, bool scanline,
+                                       bool mipmaps, bool columnMajor)
+{
+  textured_tile(job, tile, floored, scanline, mipmaps, columnMajor, false);
+}
+
+RENDER_INLINE void textured_tile_lit(const RenderJob *job, int tile,
+                                     bool floored, bool scanline,
+                                     bool mipmaps, bool columnMajor)
+{
+  textured_tile(job, tile, floored, scanline, mipmaps, columnMajor, true);
+}
+
+RENDER_FLAT_KERNEL(flat_rm, flat_tile_unlit, false)
+RENDER_FLAT_KERNEL(flat_cm, flat_tile_unlit, true)
+RENDER_FLAT_KERNEL(flat_lit_rm, flat_tile_lit, false)
+RENDER_FLAT_KERNEL(flat_lit_cm, flat_tile_lit, true)
+RENDER_TEXTURED_KERNELS(textured, textured_tile_unlit)
+RENDER_TEXTURED_KERNELS(textured_lit, textured_tile_lit)
+#if RENDER_HAS_LOW
+RENDER_FLAT_KERNEL(flat_low_rm, flat_tile_low, false)
+RENDER_FLAT_KERNEL(flat_low_cm, flat_tile_low, true)
+RENDER_TEXTURED_KERNELS(textured_low, textured_tile_low)
+#endif
+
+/* Work item function for `job` once its backend is chosen. */
+static WorkerFn select_kernel(const RenderJob *job, bool textured)
+{
+  const bool cm = job->fb->column_major;
+  const bool lit = job->lighting != NULL;
+  const int floored = job->texture_count > 1;
+  const int scan = job->options.floor == FLOOR_SCANLINE;
+  const int mip = job->options.mipmaps;
+#if RENDER_HAS_LOW
+  if (job->numeric != RENDER_NUMERIC_DOUBLE && !textured)
+    return cm ? flat_low_cm : flat_low_rm;
+  if (job->numeric != RENDER_NUMERIC_DOUBLE)
+    return textured_low_kernels[floored][scan][mip][cm];
+#endif
+  if (!textured)
+    return lit ? (cm ? flat_lit_cm : flat_lit_rm) : (cm ? flat_cm : flat_rm);
+  return lit ? textured_lit_kernels[floored][scan][mip][cm]
+             : textured_kernels[floored][scan][mip][cm];
+}
+
+/* The camera state of the low-precision backends. */
+/* job->background for the camera's cell. */
+static void background_prepare(RenderJob *job)
+{
+  const FogRows *fog = &job->state->fog;
+  const int light =
+      cell_light(job->map, (int)job->cam->posX, (int)job->cam->posY, 0);
+  for (int r = 0; r < fog->runs; ++r)
+  {
+    const int level = fog->run_levels[r];
+    job->background[r] = shade_texel(
+        job->lighting->shade[light > level ? light - level : 0],
+        r < fog->ceiling_runs ? RENDER_SKY : RENDER_FLOOR);
+  }
+}
+
+static void prepare_camera(RenderJob *job)
+{
+  if (job->lighting)
+    background_prepare(job);
+  if (job->numeric == RENDER_NUMERIC_DOUBLE)
+    return;
+#if RENDER_HAS_FIXED
+  fixed_camera(job->cam, &job->fixed_cam);
+#endif
+#if RENDER_HAS_FLOAT
+  float_camera(job->cam, &job->float_cam);
+#endif
+  job->lod_scale =
+      job->options.mipmaps
+          ? fixed_from_double(2.0 * hypot(job->cam->planeX,
+                                          job->cam->planeY) /
+                              job->ray_width)
+          : 0;
+}
+
+/* Picks the job's lighting and backend from its state and builds the
+   tables of the low-precision ones for its target size. */
+static void select_numeric(RenderJob *job)
+{
+  RenderState *state = job->state;
+  job->lighting = state->lighting;
+  /* Without room for its fog a frame is drawn unlit. */
+  if (job->lighting &&
+      !fog_rows_prepare(&state->fog, job->lighting, job->fb->height))
+    job->lighting = NULL;
+  job->fog_rows = state->fog.levels;
+  job->numeric = render_state_numeric(state, job->map);
+  job->low = &state->low;
+#if RENDER_HAS_LOW
+  if (job->numeric != RENDER_NUMERIC_DOUBLE &&
+      !low_tables_prepare(&state->low, job->ray_width, job->fb->height))
+    job->numeric = RENDER_NUMERIC_DOUBLE;
+#endif
+}
+
+static void prepare_numeric(RenderJob *job)
+{
+  select_numeric(job);
+  prepare_camera(job);
+}
+
+/* Room for `frames` frames of coalesced hits at the job's width, or false
+   when coalescing is off for the job or the hits do not fit in memory, in
+   which case every column casts its own ray. */
+static bool span_hits_prepare(const RenderJob *job, int frames)
+{
+  RenderState *state = job->state;
+  if (!state->coalesce || job->numeric != RENDER_NUMERIC_DOUBLE)
+    return false;
+  size_t needed = (size_t)frames * job->fb->width;
+  if (needed > state->span_capacity)
+  {
+    RayHit *hits = realloc(state->span_hits, needed * sizeof(RayHit));
+    if (!hits)
+      return false;
+    state->span_hits = hits;
+    state->span_capacity = needed;
+  }
+  return true;
+}
+
+static int span_count(const Framebuffer *fb)
+{
+  return (fb->width + RENDER_SPAN_COLUMNS - 1) / RENDER_SPAN_COLUMNS;
+}
+
+/* Coalesced hits of span `span` into job->hits. */
+static void cast_span(const RenderJob *job, int span)
+{
+  int x = span * RENDER_SPAN_COLUMNS;
+  int count = job->fb->width - x;
+  if (count > RENDER_SPAN_COLUMNS)
+    count = RENDER_SPAN_COLUMNS;
+  cast_rays_coherent(job->map, job->cam, ray_column(job, x), job->ray_step,
+                     count, job->ray_width, job->hits + x);
+}
+
+static void cast_span_item(void *arg, int span, int worker)
+{
+  (void)worker;
+  cast_span(arg, span);
+}
+
+RenderHistory *render_history_create(void)
+{
+  RenderHistory *history = calloc(1, sizeof(*history));
+  if (!history)
+    fprintf(stderr, "Out of memory for the frame history\n");
+  return history;
+}
+
+void render_history_destroy(RenderHistory *history)
+{
+  if (!history)
+    return;
+  free(history->hits);
+  free(history->previous);
+  free(history);
+}
+
+void render_history_reset(RenderHistory *history)
+{
+  history->width = 0;
+}
+
+/* Room for the job's frame in the history, or false when the history
+   cannot be used for it and is reset. */
+static bool history_prepare(RenderJob *job)
+{
+  RenderHistory *history = job->history;
+  const int width = job->fb->width;
+  if (job->numeric != RENDER_NUMERIC_DOUBLE || job->map->door_count > 0 ||
+      job->ray_step != 1)
+  {
+    history->width = 0;
+    return false;
+  }
+  if (width > history->capacity)
+  {
+    RayHit *hits = malloc(sizeof(RayHit) * (size_t)width);
+    RayHit *previous = malloc(sizeof(RayHit) * (size_t)width);
+    if (!hits || !previous)
+    {
+      free(hits);
+      free(previous);
+      history->width = 0;
+      return false;
+    }
+    free(history->hits);
+    free(history->previous);
+    history->hits = hits;
+    history->previous = previous;
+    history->capacity = width;
+    history->width = 0;
+  }
+  /* Reprojected rays must leave from where the previous ones did, into
+     the same walls. */
+  if (history->map != job->map || history->revision != job->map->revision ||
+      history->cam.posX != job->cam->posX ||
+      history->cam.posY != job->cam->posY)
+    history->width = 0;
+  history->traced = 0;
+  job->hits = history->hits;
+  return true;
+}
+
+/* Hit of column x from the previous frame's: when the four previous
+   columns around its ray all hit one face, the ray lies in a wedge that
+   face closes, which is what cast_rays_coherent() relies on, and it hits
+   that face too. The margin column on each side absorbs the rounding of
+   locating it. */
+static bool reproject_column(const RenderJob *job, int x)
+{
+  const RenderHistory *history = job->history;
+  const Camera *cam = job->cam;
+  const Camera *prev = &history->cam;
+  double cameraX = 2.0 * x / (double)job->fb->width - 1.0;
+  double rayDirX = cam->dirX + cam->planeX * cameraX;
+  double rayDirY = cam->dirY + cam->planeY * cameraX;
+
+  /* Rays ahead of the previous camera cross its plane on the same side
+     as its own direction does. */
+  double facing = rayDirX * prev->planeY - rayDirY * prev->planeX;
+  double ahead = prev->dirX * prev->planeY - prev->dirY * prev->planeX;
+  if (facing == 0.0 || (facing > 0.0) != (ahead > 0.0))
+    return false;
+  double prevX = (prev->dirX * rayDirY - prev->dirY * rayDirX) / facing;
+  double column = (prevX + 1.0) * history->width / 2.0;
+  if (!(column >= 1.0 && column < history->width - 2.0))
+    return false;
+
+  const RayHit *around = history->previous + (int)column - 1;
+  for (int i = 1; i < 4; ++i)
+  {
+    if (!ray_same_face(&around[0], &around[i]))
+      return false;
+  }
+  cast_ray_face(cam, x, job->fb->width, &around[0], &job->hits[x]);
+  return true;
+}
+
+/* Hits of span `span` reprojected where they can be, the runs of columns
+   between cast coherently. */
+static void reproject_span_item(void *arg, int span, int worker)
+{
+  (void)worker;
+  const RenderJob *job = arg;
+  const int x0 = span * RENDER_SPAN_COLUMNS;
+  int x1 = x0 + RENDER_SPAN_COLUMNS;
+  if (x1 > job->fb->width)
+    x1 = job->fb->width;
+  const bool reproject = job->history->width > 0;
+  int traced = 0;
+  int run = x0;
+  for (int x = x0; x < x1; ++x)
+  {
+    if (!reproject || !reproject_column(job, x))
+      continue;
+    if (run < x)
+      traced += cast_rays_coherent(job->map, job->cam, run, 1, x - run,
+                                   job->fb->width, job->hits + run);
+    run = x + 1;
+  }
+  if (run < x1)
+    traced += cast_rays_coherent(job->map, job->cam, run, 1, x1 - run,
+                                 job->fb->width, job->hits + run);
+  __atomic_add_fetch(&job->history->traced, traced, __ATOMIC_RELAXED);
+}
+
+/* Keeps the frame's hits for the next one. */
+static void history_commit(RenderJob *job)
+{
+  RenderHistory *history = job->history;
+  RayHit *previous = history->previous;
+  history->previous = history->hits;
+  history->hits = previous;
+  history->width = job->fb->width;
+  history->map = job->map;
+  history->revision = job->map->revision;
+  history->cam = *job->cam;
+}
+
+static int render_frame(RenderState *state, const Map *map,
+                        const Framebuffer *fb, const Camera *cam,
+                        bool textured, const Texture *textures,
+                        int texture_count, const RenderOptions *options,
+                        WorkerPool *pool, RenderHistory *history)
+{
+  RenderJob job = {0};
+  job.state = state;
+  job.map = map;
+  job.cam = cam;
+  job.textures = textures;
+  job.texture_count = texture_count;
+  job.options = (RenderOptions){FLOOR_COLUMNS, false, NULL, 1, 0};
+  if (options)
+  {
+    job.options = *options;
+  }
+  job_target(&job, fb);
+  job.history = history;
+  PROFILE_BEGIN(start);
+  prepare_numeric(&job);
+  ray_kernel_current();
+  int traced = job.fb->width;
+  if (history && history_prepare(&job))
+  {
+    PROFILE_BEGIN(rays);
+    worker_pool_run(pool, span_count(job.fb), reproject_span_item, &job);
+    PROFILE_END(rays, PROFILE_RAYS);
+    traced = history->traced;
+  }
+  else if (span_hits_prepare(&job, 1))
+  {
+    PROFILE_BEGIN(rays);
+    job.hits = state->span_hits;
+    worker_pool_run(pool, span_count(job.fb), cast_span_item, &job);
+    PROFILE_END(rays, PROFILE_RAYS);
+  }
+  worker_pool_run(pool, tile_count(job.fb), select_kernel(&job, textured),
+                  &job);
+  if (job.hits && job.history)
+    history_commit(&job);
+  PROFILE_END(start, PROFILE_FRAME);
+  return traced;
+}
+
+void render_frame_flat(const Framebuffer *fb, const Camera *cam,
+                       WorkerPool *pool)
+{
+  render_frame(&g_state, render_map(), fb, cam, false, NULL, 0, NULL, pool,
+               NULL);
+}
+
+void render_frame_textured(const Framebuffer *fb, const Camera *cam,
+                           const Texture *textures, int texture_count,
+                           const RenderOptions *options, WorkerPool *pool)
+{
+  render_frame(&g_state, render_map(), fb, cam, true, textures,
+               texture_count, options, pool, NULL);
+}
+
+void render_frame_map(const Map *map, const Framebuffer *fb,
+                      const Camera *cam, const Texture *textures,
+                      int texture_count, const RenderOptions *options,
+                      WorkerPool *pool)
+{
+  render_frame(&g_state, map, fb, cam, textures != NULL, textures,
+               texture_count, options, pool, NULL);
+}
+
+int render_frame_history(const Map *map, const Framebuffer *fb,
+                         const Camera *cam, const Texture *textures,
+                         int texture_count, const RenderOptions *options,
+                         WorkerPool *pool, RenderHistory *history)
+{
+  return render_frame(&g_state, map, fb, cam, textures != NULL, textures,
+                      texture_count, options, pool, history);
+}
+
+int render_frame_state(RenderState *state, const Map *map,
+                       const Framebuffer *fb, const Camera *cam,
+                       const Texture *textures, int texture_count,
+                       const RenderOptions *options, WorkerPool *pool,
+                       RenderHistory *history)
+{
+  return render_frame(state, map, fb, cam, textures != NULL, textures,
+                      texture_count, options, pool, history);
+}
+
+bool camera_batch_init(CameraBatch *batch, int count)
+{
+  memset(batch, 0, sizeof(*batch));
+  double *block = malloc(sizeof(double) * 6 * (size_t)(count > 0 ? count : 1));
+  if (!block)
+  {
+    fprintf(stderr, "Out of memory for a batch of %d cameras\n", count);
+    return false;
+  }
+  batch->count = count;
+  batch->posX = block;
+  batch->posY = block + (size_t)count;
+  batch->dirX = block + 2 * (size_t)count;
+  batch->dirY = block + 3 * (size_t)count;
+  batch->planeX = block + 4 * (size_t)count;
+  batch->planeY = block + 5 * (size_t)count;
+  return true;
+}
+
+void camera_batch_release(CameraBatch *batch)
+{
+  free(batch->posX);
+  memset(batch, 0, sizeof(*batch));
+}
+
+void camera_batch_set(CameraBatch *batch, int index, const Camera *cam)
+{
+  batch->posX[index] = cam->posX;
+  batch->posY[index] = cam->posY;
+  batch->dirX[index] = cam->dirX;
+  batch->dirY[index] = cam->dirY;
+  batch->planeX[index] = cam->planeX;
+  batch->planeY[index] = cam->planeY;
+}
+
+void camera_batch_get(const CameraBatch *batch, int index, Camera *out)
+{
+  *out = (Camera){batch->posX[index],   batch->posY[index],
+                  batch->dirX[index],   batch->dirY[index],
+                  batch->planeX[index], batch->planeY[index]};
+}
+
+/* `frame` carries what every camera shares: target size, textures,
+   options and the backend, whose tables were built once for the batch.
+   With coalescing, its hits hold a frame width for each worker. */
+typedef struct BatchJob
+{
+  const Framebuffer *targets;
+  const CameraBatch *cams;
+  RenderJob frame;
+  bool textured;
+  WorkerFn tile;
+} BatchJob;
+
+/* One camera's whole frame on the worker that picked it up. */
+static void render_batch_item(void *arg, int index, int worker)
+{
+  const BatchJob *batch = arg;
+  Camera cam;
+  camera_batch_get(batch->cams, index, &cam);
+  RenderJob job = batch->frame;
+  job_target(&job, &batch->targets[index]);
+  job.cam = &cam;
+  if (job.options.depth)
+    job.options.depth += (size_t)index * job.fb->width;
+  PROFILE_BEGIN(start);
+  prepare_camera(&job);
+  if (job.hits)
+  {
+    job.hits += (size_t)worker * job.fb->width;
+    const int spans = span_count(job.fb);
+    for (int span = 0; span < spans; ++span)
+      cast_span(&job, span);
+  }
+  const int tiles = tile_count(job.fb);
+  for (int tile = 0; tile < tiles; ++tile)
+    batch->tile(&job, tile, worker);
+  PROFILE_END(start, PROFILE_FRAME);
+}
+
+static void render_batch(BatchJob *batch, WorkerPool *pool)
+{
+  if (batch->cams->count <= 0)
+    return;
+  batch->frame.state = &g_state;
+  batch->frame.map = render_map();
+  job_target(&batch->frame, &batch->targets[0]);
+  select_numeric(&batch->frame);
+  if (span_hits_prepare(&batch->frame, worker_pool_size(pool)))
+    batch->frame.hits = g_state.span_hits;
+  batch->tile = select_kernel(&batch->frame, batch->textured);
+  ray_kernel_current();
+  worker_pool_run(pool, batch->cams->count, render_batch_item, batch);
+}
+
+void render_batch_flat(const Framebuffer *targets, const CameraBatch *cams,
+                       WorkerPool *pool)
+{
+  BatchJob batch = {targets, cams, {0}, false, NULL};
+  render_batch(&batch, pool);
+}
+
+void render_batch_textured(const Framebuffer *targets,
+                           const CameraBatch *cams, const Texture *textures,
+                           int texture_count, const RenderOptions *options,
+                           WorkerPool *pool)
+{
+  BatchJob batch = {targets, cams, {0}, true, NULL};
+  batch.frame.textures = textures;
+  batch.frame.texture_count = texture_count;
+  batch.frame.options =
+      (RenderOptions){FLOOR_COLUMNS, false, NULL, 1, 0};
+  if (options)
+  {
+    batch.frame.options = *options;
+  }
+  render_batch(&batch, pool);
+}
+
+typedef struct ResolveJob
+{
+  const Framebuffer *dst;
+  const Framebuffer *src;
+} ResolveJob;
+
+/* One tile of source columns becomes a band of destination columns. */
+static void resolve_tile(void *arg, int tile, int worker)
+{
+  (void)worker;
+  const ResolveJob *job = arg;
+  int x0;
+  int x1;
+  tile_bounds(job->dst, tile, &x0, &x1);
+  PROFILE_BEGIN(start);
+  transpose_pixels(job->dst->pixels + x0, job->dst->pitch,
+                   job->src->pixels + (size_t)x0 * job->src->pitch,
+                   job->src->pitch, job->src->height, x1 - x0);
+  PROFILE_END(start, PROFILE_RESOLVE);
+}
+
+void framebuffer_resolve(const Framebuffer *dst, const Framebuffer *src,
+                         WorkerPool *pool)
+{
+  ResolveJob job = {dst, src};
+  worker_pool_run(pool, tile_count(dst), resolve_tile, &job);
+}
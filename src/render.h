@@ -0,0 +1,253 @@
+#ifndef RAYCAST_RENDER_H
+#define RAYCAST_RENDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "light.h"
+#include "map.h"
+#include "texture.h"
+#include "workers.h"
+
+/* Size of the built-in map used until render_set_map() is called. */
+#define MAP_WIDTH 10
+#define MAP_HEIGHT 10
+
+typedef struct Camera
+{
+  double posX;
+  double posY;
+  double dirX;
+  double dirY;
+  double planeX;
+  double planeY;
+} Camera;
+
+/* Render target: `pitch` is the row stride in pixels, not bytes. A
+   column-major target stores pixel (x, y) at pixels[x * pitch + y] instead,
+   so `pitch` is the column stride and vertical spans are sequential. */
+typedef struct Framebuffer
+{
+  uint32_t *pixels;
+  int width;
+  int height;
+  int pitch;
+  bool column_major;
+} Framebuffer;
+
+/* FLOOR_COLUMNS casts floor/ceiling down each column after its wall;
+   FLOOR_SCANLINE walks each row of a tile with incremental steps. The two
+   differ only where rounding lands on a texel edge. With `mipmaps` set,
+   textures that have a pyramid are sampled at the level matching their
+   on-screen texel density. `depth`, when set, receives the perpendicular
+   wall distance of each of the fb->width columns: the depth buffer the
+   sprite pass tests against. With `column_step` above 1 only columns
+   column_first, column_first + column_step, .. of the target are drawn,
+   with the rays they have in the whole frame, and the others keep their
+   pixels; `depth` then receives the drawn columns only, in order. */
+typedef enum FloorEngine
+{
+  FLOOR_COLUMNS,
+  FLOOR_SCANLINE
+} FloorEngine;
+
+typedef struct RenderOptions
+{
+  FloorEngine floor;
+  bool mipmaps;
+  double *depth;
+  int column_step;
+  int column_first;
+} RenderOptions;
+
+/* Number format of the ray casts, wall spans and floor. The float and
+   16.16 fixed-point backends cast with table reciprocals instead of
+   divides, step textures with integer positions and sample the floor
+   from per-row distance tables; they differ from the double reference
+   where rounding lands on a texel or cell edge. A renderer built with
+   RENDER_NUMERIC defined starts on that backend and compiles in only it
+   and the double reference, which stays for lit frames, doors,
+   reprojection and span coalescing; RENDER_HAS_FLOAT and
+   RENDER_HAS_FIXED tell which low-precision backends a build has. */
+typedef enum RenderNumeric
+{
+  RENDER_NUMERIC_DOUBLE,
+  RENDER_NUMERIC_FLOAT,
+  RENDER_NUMERIC_FIXED
+} RenderNumeric;
+
+#define RENDER_BUILD_RENDER_NUMERIC_DOUBLE 1
+#define RENDER_BUILD_RENDER_NUMERIC_FLOAT 2
+#define RENDER_BUILD_RENDER_NUMERIC_FIXED 3
+#define RENDER_BUILD_(numeric) RENDER_BUILD_##numeric
+#define RENDER_BUILD(numeric) RENDER_BUILD_(numeric)
+#ifdef RENDER_NUMERIC
+#define RENDER_HAS_FLOAT (RENDER_BUILD(RENDER_NUMERIC) == 2)
+#define RENDER_HAS_FIXED (RENDER_BUILD(RENDER_NUMERIC) == 3)
+#else
+#define RENDER_HAS_FLOAT 1
+#define RENDER_HAS_FIXED 1
+#endif
+#define RENDER_HAS_LOW (RENDER_HAS_FLOAT || RENDER_HAS_FIXED)
+
+/* Texel reads and the misses they would cause in a per-thread 32 KiB,
+   8-way, 64-byte-line cache. Only gathered when the renderer is built with
+   RENDER_TEXEL_STATS. */
+typedef struct TexelStats
+{
+  uint64_t fetches;
+  uint64_t misses;
+} TexelStats;
+
+/* Map drawn by the render_frame_* calls and tested by is_walkable(); NULL
+   restores the built-in map. The map must outlive its use. */
+void render_set_map(const Map *map);
+const Map *render_map(void);
+const Map *render_builtin_map(void);
+
+bool is_walkable(double x, double y);
+
+/* Lighting of the render_frame_* and render_batch_* calls (see light.h),
+   NULL for unlit frames, which is the default. Lit frames are drawn by the
+   double backend whatever render_numeric_select() picked. It must outlive
+   its use. */
+void render_set_lighting(const Lighting *lighting);
+const Lighting *render_lighting(void);
+
+/* Selects the backend of the next frames. The low-precision backends
+   draw neither lighting nor doors, so lit frames and frames of maps with
+   doors are drawn with double whatever was selected, as are frames on a
+   backend the build left out (render_numeric_available()) and, out of
+   memory, frames whose tables cannot be allocated.
+   render_numeric_current() reports the selection and
+   render_numeric_effective() the backend frames of `map` get under the
+   current lighting. */
+void render_numeric_select(RenderNumeric numeric);
+RenderNumeric render_numeric_current(void);
+bool render_numeric_available(RenderNumeric numeric);
+RenderNumeric render_numeric_effective(const Map *map);
+const char *render_numeric_name(RenderNumeric numeric);
+
+/* Span coalescing: the double backend casts each frame's rays with
+   cast_rays_coherent() over spans of RENDER_SPAN_COLUMNS columns, tracing
+   span ends and only bisecting where the hit face changes, and takes the
+   columns between from the face. Wider spans trace fewer rays, narrower
+   ones spread a frame more evenly over the pool. Frames are identical
+   either way; the low-precision backends ignore it. Off by default. */
+#define RENDER_SPAN_COLUMNS 64
+
+void render_coalesce_select(bool enabled);
+bool render_coalesce_current(void);
+
+/* Columns are rendered in independent tiles spread across `pool`; pass NULL
+   to render on the calling thread. Output does not depend on the pool.
+   NULL options select the defaults (per-column floor). */
+void render_frame_flat(const Framebuffer *fb, const Camera *cam,
+                       WorkerPool *pool);
+void render_frame_textured(const Framebuffer *fb, const Camera *cam,
+                           const Texture *textures, int texture_count,
+                           const RenderOptions *options, WorkerPool *pool);
+
+/* A frame of `map` instead of the render_set_map() one: textured like
+   render_frame_textured(), or flat like render_frame_flat() when
+   `textures` is NULL. */
+void render_frame_map(const Map *map, const Framebuffer *fb,
+                      const Camera *cam, const Texture *textures,
+                      int texture_count, const RenderOptions *options,
+                      WorkerPool *pool);
+
+/* Ray hits of the last frame drawn with it, for reprojecting the next
+   one. Edits through map_set_tile() and door moves are noticed from the
+   map's revision; call render_history_reset() after changing its tiles
+   any other way. */
+typedef struct RenderHistory RenderHistory;
+
+/* Prints why and returns NULL on failure. */
+RenderHistory *render_history_create(void);
+void render_history_destroy(RenderHistory *history);
+void render_history_reset(RenderHistory *history);
+
+/* render_frame_map() with temporal reuse: when the camera has only turned
+   since the last frame `history` saw on the same map, a column whose ray
+   falls between previous columns that all hit one face takes that face
+   without a traversal. Only the rest, such as columns the turn exposed,
+   are cast, coherently as with span coalescing. Frames match
+   render_frame_map() exactly. The double backend keeps the history on
+   maps without doors; otherwise frames draw as usual and reset it.
+   Returns the number of rays traced, the frame width when every column
+   was cast. */
+int render_frame_history(const Map *map, const Framebuffer *fb,
+                         const Camera *cam, const Texture *textures,
+                         int texture_count, const RenderOptions *options,
+                         WorkerPool *pool, RenderHistory *history);
+
+/* The lighting, numeric backend and span coalescing that the functions
+   above set process-wide, plus the scratch tables sized to the last
+   target, held apart. The render_frame_*() and render_batch_*() calls
+   draw with the process-wide state; render_frame_state() draws with its
+   own, so frames on different states may be drawn on different threads
+   at once, while frames on one state must not overlap. A new state is
+   unlit, starts on the RENDER_NUMERIC backend and does not coalesce. */
+typedef struct RenderState RenderState;
+
+/* Prints why and returns NULL on failure. */
+RenderState *render_state_create(void);
+void render_state_destroy(RenderState *state);
+void render_state_set_lighting(RenderState *state, const Lighting *lighting);
+void render_state_set_numeric(RenderState *state, RenderNumeric numeric);
+void render_state_set_coalesce(RenderState *state, bool enabled);
+/* render_numeric_effective() for `state`. */
+RenderNumeric render_state_numeric(const RenderState *state,
+                                   const Map *map);
+
+/* render_frame_history() with `state` instead of the process-wide state;
+   a NULL `history` draws like render_frame_map(). */
+int render_frame_state(RenderState *state, const Map *map,
+                       const Framebuffer *fb, const Camera *cam,
+                       const Texture *textures, int texture_count,
+                       const RenderOptions *options, WorkerPool *pool,
+                       RenderHistory *history);
+
+/* Cameras of a batch as a structure of arrays: camera i is (posX[i],
+   posY[i], dirX[i], dirY[i], planeX[i], planeY[i]), so code updating many
+   cameras streams through each field. One allocation holds all six. */
+typedef struct CameraBatch
+{
+  int count;
+  double *posX;
+  double *posY;
+  double *dirX;
+  double *dirY;
+  double *planeX;
+  double *planeY;
+} CameraBatch;
+
+/* Prints why and returns false on failure. */
+bool camera_batch_init(CameraBatch *batch, int count);
+void camera_batch_release(CameraBatch *batch);
+void camera_batch_set(CameraBatch *batch, int index, const Camera *cam);
+void camera_batch_get(const CameraBatch *batch, int index, Camera *out);
+
+/* Renders camera i of `cams` into targets[i], cams->count frames in one
+   call: each camera is one work item, drawn whole by the worker that takes
+   it, so small frames do not pay a pool round trip each, and the backend
+   and its tables are set up once. Every target must have the size and
+   layout of targets[0]. A set `options->depth` holds count * width
+   entries, camera i's from depth + i * width. Frames match
+   render_frame_*() exactly. */
+void render_batch_flat(const Framebuffer *targets, const CameraBatch *cams,
+                       WorkerPool *pool);
+void render_batch_textured(const Framebuffer *targets,
+                           const CameraBatch *cams, const Texture *textures,
+                           int texture_count, const RenderOptions *options,
+                           WorkerPool *pool);
+
+/* Reads and clears the texel counters; returns false when they are not
+   compiled in. */
+bool render_texel_stats(TexelStats *out);
+
+/* Copies a column-major `src` into the row-major `dst` of the same size. */
+void framebuffer_resolve(const Framebuffer *dst, const Framebuffer *src,
+                         WorkerPool *pool);
+
+#endif
@@ -0,0 +1,392 @@
+#include "sprite.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Nearest depth drawn, and columns per band of the drawing pass. */
+#define SPRITE_NEAR 0.1
+#define SPRITE_BAND_COLUMNS 64
+
+/* A sprite that passed culling, projected: columns [x0, x1) and rows
+   [y0, y1] on screen, `left`/`top` the unclipped corner and `size` the
+   side in pixels. */
+typedef struct VisibleSprite
+{
+  double depth;
+  int left;
+  int top;
+  int size;
+  int x0;
+  int x1;
+  int y0;
+  int y1;
+  const Texture *tex;
+} VisibleSprite;
+
+typedef struct SpriteJob
+{
+  const Framebuffer *fb;
+  const double *depth;
+  const VisibleSprite *visible;
+  int count;
+  int columns;
+} SpriteJob;
+
+static int clamp_int(int v, int lo, int hi)
+{
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+bool sprite_grid_build(SpriteGrid *grid, const Sprite *sprites, int count,
+                       int map_width, int map_height)
+{
+  memset(grid, 0, sizeof(*grid));
+  const int span = 1 << SPRITE_GRID_SHIFT;
+  grid->width = (map_width + span - 1) >> SPRITE_GRID_SHIFT;
+  grid->height = (map_height + span - 1) >> SPRITE_GRID_SHIFT;
+  size_t buckets = (size_t)grid->width * grid->height;
+  grid->start = calloc(buckets + 1, sizeof(int));
+  grid->order = malloc(sizeof(int) * (size_t)(count > 0 ? count : 1));
+  grid->visible =
+      malloc(sizeof(VisibleSprite) * (size_t)(count > 0 ? count : 1));
+  if (!grid->start || !grid->order || !grid->visible)
+  {
+    fprintf(stderr, "Out of memory for a grid of %d sprites\n", count);
+    sprite_grid_release(grid);
+    return false;
+  }
+
+  /* Counting sort by bucket; start[b + 1] counts bucket b first. */
+  for (int i = 0; i < count; ++i)
+  {
+    double x = sprites[i].x;
+    double y = sprites[i].y;
+    if (x >= 0.0 && y >= 0.0 && x < map_width && y < map_height)
+    {
+      int b = ((int)y >> SPRITE_GRID_SHIFT) * grid->width +
+              ((int)x >> SPRITE_GRID_SHIFT);
+      ++grid->start[b + 1];
+    }
+  }
+  for (size_t b = 0; b < buckets; ++b)
+    grid->start[b + 1] += grid->start[b];
+  int *fill = malloc(sizeof(int) * (buckets > 0 ? buckets : 1));
+  if (!fill)
+  {
+    fprintf(stderr, "Out of memory for a grid of %d sprites\n", count);
+    sprite_grid_release(grid);
+    return false;
+  }
+  memcpy(fill, grid->start, sizeof(int) * buckets);
+  for (int i = 0; i < count; ++i)
+  {
+    double x = sprites[i].x;
+    double y = sprites[i].y;
+    if (x >= 0.0 && y >= 0.0 && x < map_width && y < map_height)
+    {
+      int b = ((int)y >> SPRITE_GRID_SHIFT) * grid->width +
+              ((int)x >> SPRITE_GRID_SHIFT);
+      grid->order[fill[b]++] = i;
+    }
+  }
+  free(fill);
+  grid->count = grid->start[buckets];
+  return true;
+}
+
+void sprite_grid_release(SpriteGrid *grid)
+{
+  free(grid->start);
+  free(grid->order);
+  free(grid->visible);
+  memset(grid, 0, sizeof(*grid));
+}
+
+/* Camera space: `tx` is the screen-space x over depth (-1 to 1 across
+   the view) times depth, `ty` the perpendicular depth. */
+static void to_camera(const Camera *cam, double invDet, double x, double y,
+                      double *tx, double *ty)
+{
+  double dx = x - cam->posX;
+  double dy = y - cam->posY;
+  *tx = invDet * (cam->dirY * dx - cam->dirX * dy);
+  *ty = invDet * (-cam->planeY * dx + cam->planeX * dy);
+}
+
+/* A sprite centred at camera-space (tx, ty) reaches the screen when
+   |tx| < ty + margin, where `margin` is its half width in tx units. The
+   four tests are half-planes, so a bucket whose corners all fail one of
+   them holds nothing visible. */
+static bool bucket_visible(const Camera *cam, double invDet, int bx, int by,
+                           double margin, double far)
+{
+  const double span = (double)(1 << SPRITE_GRID_SHIFT);
+  int right = 0;
+  int left = 0;
+  int near = 0;
+  int beyond = 0;
+  for (int corner = 0; corner < 4; ++corner)
+  {
+    double tx;
+    double ty;
+    to_camera(cam, invDet, (bx + (corner & 1)) * span,
+              (by + (corner >> 1)) * span, &tx, &ty);
+    right += tx - margin >= ty;
+    left += tx + margin <= -ty;
+    near += ty <= SPRITE_NEAR;
+    beyond += ty >= far;
+  }
+  return right < 4 && left < 4 && near < 4 && beyond < 4;
+}
+
+static int compare_far_to_near(const void *a, const void *b)
+{
+  double da = ((const VisibleSprite *)a)->depth;
+  double db = ((const VisibleSprite *)b)->depth;
+  return (da < db) - (da > db);
+}
+
+/* Projects sprite `s`; false when it is behind the camera, beyond every
+   wall or off screen. */
+static bool project(const Framebuffer *fb, const Camera *cam, double invDet,
+                    const Sprite *s, const Texture *tex, double far,
+                    VisibleSprite *out)
+{
+  double tx;
+  double ty;
+  to_camera(cam, invDet, s->x, s->y, &tx, &ty);
+  if (ty <= SPRITE_NEAR || ty >= far)
+    return false;
+  const int w = fb->width;
+  const int h = fb->height;
+  int size = (int)(h / ty);
+  if (size <= 0)
+    return false;
+  int screenX = (int)(w / 2.0 * (1.0 + tx / ty));
+  out->left = screenX - size / 2;
+  out->top = h / 2 - size / 2;
+  out->x0 = out->left > 0 ? out->left : 0;
+  out->x1 = out->left + size < w ? out->left + size : w;
+  if (out->x0 >= out->x1)
+    return false;
+  out->y0 = out->top > 0 ? out->top : 0;
+  out->y1 = out->top + size - 1 < h - 1 ? out->top + size - 1 : h - 1;
+  out->depth = ty;
+  out->size = size;
+  out->tex = tex;
+  return true;
+}
+
+static void draw_band(void *arg, int band, int worker)
+{
+  (void)worker;
+  SpriteJob *job = arg;
+  const Framebuffer *fb = job->fb;
+  const int bx0 = band * SPRITE_BAND_COLUMNS;
+  const int bx1 = bx0 + SPRITE_BAND_COLUMNS < fb->width
+                      ? bx0 + SPRITE_BAND_COLUMNS
+                      : fb->width;
+  int columns = 0;
+  for (int i = 0; i < job->count; ++i)
+  {
+    const VisibleSprite *v = &job->visible[i];
+    if (v->x1 <= bx0 || v->x0 >= bx1)
+      continue;
+    const Texture *tex = v->tex;
+    const int x0 = v->x0 > bx0 ? v->x0 : bx0;
+    const int x1 = v->x1 < bx1 ? v->x1 : bx1;
+    /* 16.16 texel rows per screen row. */
+    const uint32_t step = (uint32_t)(((uint64_t)tex->height << 16) / v->size);
+    const uint32_t start = (uint32_t)(v->y0 - v->top) * step;
+    for (int x = x0; x < x1; ++x)
+    {
+      if (v->depth >= job->depth[x])
+        continue;
+      ++columns;
+      int texX = (int)((int64_t)(x - v->left) * tex->width / v->size);
+      const uint32_t *texels;
+      size_t texStride;
+      if (tex->columns)
+      {
+        texels = tex->columns + (size_t)texX * tex->height;
+        texStride = 1;
+      }
+      else
+      {
+        texels = tex->pixels + texX;
+        texStride = (size_t)tex->width;
+      }
+      size_t stride;
+      uint32_t *column;
+      if (fb->column_major)
+      {
+        stride = 1;
+        column = fb->pixels + (size_t)x * fb->pitch;
+      }
+      else
+      {
+        stride = (size_t)fb->pitch;
+        column = fb->pixels + x;
+      }
+      uint32_t texPos = start;
+      for (int y = v->y0; y <= v->y1; ++y, texPos += step)
+      {
+        int texY = clamp_int((int)(texPos >> 16), 0, tex->height - 1);
+        uint32_t color = texels[texY * texStride];
+        if (color >= 0x80000000u)
+          column[y * stride] = color;
+      }
+    }
+  }
+  __atomic_fetch_add(&job->columns, columns, __ATOMIC_RELAXED);
+}
+
+void render_sprites(const Framebuffer *fb, const Camera *cam,
+                    const Sprite *sprites, SpriteGrid *grid,
+                    const Texture *textures, int texture_count,
+                    const double *depth, WorkerPool *pool,
+                    SpriteStats *stats)
+{
+  SpriteStats counts = {0, 0, 0};
+  double far = 0.0;
+  for (int x = 0; x < fb->width; ++x)
+    far = depth[x] > far ? depth[x] : far;
+
+  const double det = cam->planeX * cam->dirY - cam->dirX * cam->planeY;
+  if (fabs(det) < 1e-12 || grid->count == 0)
+  {
+    if (stats)
+      *stats = counts;
+    return;
+  }
+  const double invDet = 1.0 / det;
+  const double margin = (double)fb->height / fb->width;
+
+  /* Bounding box of the frustum, widened by the margin, out to the
+     farthest wall. */
+  double minX = cam->posX;
+  double maxX = cam->posX;
+  double minY = cam->posY;
+  double maxY = cam->posY;
+  for (int corner = 0; corner < 4; ++corner)
+  {
+    double t = (corner & 2) ? far : 0.0;
+    double side = (corner & 1) ? t + margin : -(t + margin);
+    double x = cam->posX + cam->dirX * t + cam->planeX * side;
+    double y = cam->posY + cam->dirY * t + cam->planeY * side;
+    minX = fmin(minX, x);
+    maxX = fmax(maxX, x);
+    minY = fmin(minY, y);
+    maxY = fmax(maxY, y);
+  }
+  const int span = 1 << SPRITE_GRID_SHIFT;
+  int bx0 = clamp_int((int)floor(minX / span), 0, grid->width - 1);
+  int bx1 = clamp_int((int)floor(maxX / span), 0, grid->width - 1);
+  int by0 = clamp_int((int)floor(minY / span), 0, grid->height - 1);
+  int by1 = clamp_int((int)floor(maxY / span), 0, grid->height - 1);
+
+  VisibleSprite *visible = grid->visible;
+  for (int by = by0; by <= by1; ++by)
+  {
+    for (int bx = bx0; bx <= bx1; ++bx)
+    {
+      if (!bucket_visible(cam, invDet, bx, by, margin, far))
+        continue;
+      int b = by * grid->width + bx;
+      for (int k = grid->start[b]; k < grid->start[b + 1]; ++k)
+      {
+        const Sprite *s = &sprites[grid->order[k]];
+        ++counts.candidates;
+        if (s->texture < 0 || s->texture >= texture_count)
+          continue;
+        if (project(fb, cam, invDet, s, &textures[s->texture], far,
+                    &visible[counts.visible]))
+          ++counts.visible;
+      }
+    }
+  }
+
+  qsort(visible, (size_t)counts.visible, sizeof(VisibleSprite),
+        compare_far_to_near);
+  SpriteJob job = {fb, depth, visible, counts.visible, 0};
+  int bands = (fb->width + SPRITE_BAND_COLUMNS - 1) / SPRITE_BAND_COLUMNS;
+  if (counts.visible > 0)
+  {
+    if (pool)
+    {
+      worker_pool_run(pool, bands, draw_band, &job);
+    }
+    else
+    {
+      for (int band = 0; band < bands; ++band)
+        draw_band(&job, band, 0);
+    }
+  }
+  counts.columns = job.columns;
+  if (stats)
+    *stats = counts;
+}
+
+void sprite_scatter(Sprite *sprites, int count, const Map *map,
+                    uint32_t seed, int texture_count)
+{
+  uint32_t state = seed ? seed : 2463534242u;
+  for (int i = 0; i < count; ++i)
+  {
+    int x = map->spawn_x;
+    int y = map->spawn_y;
+    for (int attempt = 0; attempt < 64; ++attempt)
+    {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      int cx = (int)(state % (uint32_t)map->width);
+      int cy = (int)((state >> 16) % (uint32_t)map->height);
+      if (map_tile(map, cx, cy) == 0)
+      {
+        x = cx;
+        y = cy;
+        break;
+      }
+    }
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    sprites[i].x = x + 0.2 + 0.6 * (state & 0xFFFF) / 65536.0;
+    sprites[i].y = y + 0.2 + 0.6 * (state >> 16) / 65536.0;
+    sprites[i].texture = texture_count > 0 ? (int)(state % texture_count)
+                                           : 0;
+  }
+}
+
+bool sprite_make_orb(Texture *tex, int size, uint32_t color)
+{
+  memset(tex, 0, sizeof(*tex));
+  tex->pixels = malloc(sizeof(uint32_t) * (size_t)size * size);
+  if (!tex->pixels)
+  {
+    fprintf(stderr, "Out of memory for a %dx%d sprite\n", size, size);
+    return false;
+  }
+  tex->width = size;
+  tex->height = size;
+  for (int y = 0; y < size; ++y)
+  {
+    for (int x = 0; x < size; ++x)
+    {
+      double dx = (x + 0.5) / size * 2.0 - 1.0;
+      double dy = (y + 0.5) / size * 2.0 - 1.0;
+      double r = dx * dx + dy * dy;
+      uint32_t shaded = 0xFF000000u;
+      for (int shift = 0; shift < 24; shift += 8)
+      {
+        uint32_t c = (color >> shift) & 0xFF;
+        shaded |= (uint32_t)(c * (1.0 - 0.6 * r)) << shift;
+      }
+      tex->pixels[(size_t)y * size + x] = r < 1.0 ? shaded : 0;
+    }
+  }
+  return true;
+}
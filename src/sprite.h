@@ -0,0 +1,74 @@
+#ifndef RAYCAST_SPRITE_H
+#define RAYCAST_SPRITE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "render.h"
+
+/* Billboard one cell wide and tall standing at (x, y) in map units,
+   drawn with textures[texture]. Texels with alpha below 128 are
+   transparent. */
+typedef struct Sprite
+{
+  double x;
+  double y;
+  int texture;
+} Sprite;
+
+/* Uniform grid over the map in square buckets of 1 << SPRITE_GRID_SHIFT
+   cells. `order` lists sprite indices bucket by bucket and bucket b owns
+   order[start[b]] to order[start[b + 1] - 1], so a bucket's sprites are
+   one contiguous run. Sprites off the map are left out and never drawn.
+   Rebuild after moving sprites. */
+#define SPRITE_GRID_SHIFT 3
+
+typedef struct SpriteGrid
+{
+  int width;
+  int height;
+  int count;
+  int *start;
+  int *order;
+  /* Scratch for the visible set of a frame, `count` entries. */
+  void *visible;
+} SpriteGrid;
+
+/* Prints why and returns false on failure. */
+bool sprite_grid_build(SpriteGrid *grid, const Sprite *sprites, int count,
+                       int map_width, int map_height);
+void sprite_grid_release(SpriteGrid *grid);
+
+/* Per-frame counts: sprites read from buckets the frustum touches, those
+   left after the exact frustum and depth test, and sprite columns drawn
+   in front of the walls. */
+typedef struct SpriteStats
+{
+  int candidates;
+  int visible;
+  int columns;
+} SpriteStats;
+
+/* Draws the sprites over a frame rendered with RenderOptions.depth set to
+   `depth`. Only grid buckets inside the view frustum, up to the farthest
+   wall on screen, are read; the visible sprites are sorted far to near
+   and drawn over bands of columns spread across `pool` (NULL draws on the
+   calling thread). A column whose wall is nearer than the sprite is
+   skipped before any texel is read. `stats` may be NULL. */
+void render_sprites(const Framebuffer *fb, const Camera *cam,
+                    const Sprite *sprites, SpriteGrid *grid,
+                    const Texture *textures, int texture_count,
+                    const double *depth, WorkerPool *pool,
+                    SpriteStats *stats);
+
+/* Places `count` sprites at random points of random empty cells of `map`,
+   away from their walls, with textures 0 to texture_count - 1; the same
+   seed gives the same scene. */
+void sprite_scatter(Sprite *sprites, int count, const Map *map,
+                    uint32_t seed, int texture_count);
+
+/* Fills `tex` with a shaded disc of `color` on a transparent square, a
+   stand-in for sprite art. Prints why and returns false on failure. */
+bool sprite_make_orb(Texture *tex, int size, uint32_t color);
+
+#endif
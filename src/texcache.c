@@ -0,0 +1,389 @@
+#include "texcache.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "light.h"
+
+typedef enum EntryState
+{
+  ENTRY_ABSENT,
+  ENTRY_QUEUED,
+  ENTRY_RESIDENT,
+  ENTRY_FAILED
+} EntryState;
+
+/* `low` is the small stand-in, width 0 until the texture first loads. */
+typedef struct CacheEntry
+{
+  EntryState state;
+  Texture full;
+  Texture low;
+  size_t bytes;
+  uint64_t last_used;
+} CacheEntry;
+
+/* A finished load on its way from the loader thread to the next frame. */
+typedef struct LoadResult
+{
+  int id;
+  bool ok;
+  Texture full;
+  Texture low;
+} LoadResult;
+
+struct TextureCache
+{
+  int count;
+  unsigned layouts;
+  size_t budget;
+  size_t resident_bytes;
+  uint64_t frame;
+  TextureLoadFn load;
+  void *arg;
+
+  CacheEntry *entries;
+  Texture *slots;
+  uint8_t *used;
+  Texture placeholder;
+
+  /* An id is queued at most once until its result is installed, so both
+     rings hold `count` items. `loading` counts loads taken off the queue
+     but not yet finished. */
+  pthread_t thread;
+  bool started;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t idle;
+  bool quit;
+  int *queue;
+  int queue_head;
+  int queue_size;
+  LoadResult *results;
+  int result_count;
+  int loading;
+};
+
+/* Walls read an indexed texture's indices, so it gets no column copy. */
+static bool build_layouts(Texture *tex, unsigned layouts)
+{
+  if ((layouts & TEXTURE_CACHE_MIPS) && !texture_build_mips(tex))
+    return false;
+  if (layouts & TEXTURE_CACHE_INDEXED)
+  {
+    if (texture_build_palette(tex) < 0)
+      return false;
+    return !(layouts & TEXTURE_CACHE_LIT) || light_build_palette(tex);
+  }
+  if ((layouts & TEXTURE_CACHE_COLUMNS) && !texture_build_columns(tex))
+    return false;
+  return !(layouts & TEXTURE_CACHE_LIT) || light_build_texels(tex);
+}
+
+static size_t texture_bytes(const Texture *tex)
+{
+  size_t texels = (size_t)tex->width * tex->height;
+  size_t total = tex->columns ? 2 * texels : texels;
+  if (tex->mip_count > 0)
+  {
+    size_t mip_texels;
+    texture_mip_layout(tex->width, tex->height, &mip_texels);
+    total += mip_texels;
+  }
+  if (tex->palette)
+    total += 2 * TEXTURE_PALETTE_SIZE;
+  if (tex->lit)
+    total += MAP_LIGHT_LEVELS * TEXTURE_PALETTE_SIZE;
+  if (tex->shaded)
+    total += MAP_LIGHT_LEVELS * texels;
+  return total * sizeof(uint32_t) + (tex->indices ? texels : 0);
+}
+
+/* Nearest-texel copy of `src` at most TEXTURE_CACHE_LOW_SIZE a side. */
+static bool shrink(Texture *dst, const Texture *src, unsigned layouts)
+{
+  memset(dst, 0, sizeof(*dst));
+  dst->width = src->width < TEXTURE_CACHE_LOW_SIZE ? src->width
+                                                   : TEXTURE_CACHE_LOW_SIZE;
+  dst->height = src->height < TEXTURE_CACHE_LOW_SIZE
+                    ? src->height
+                    : TEXTURE_CACHE_LOW_SIZE;
+  dst->pixels = malloc(sizeof(uint32_t) * (size_t)dst->width * dst->height);
+  if (!dst->pixels)
+    return false;
+  for (int y = 0; y < dst->height; ++y)
+  {
+    const uint32_t *row =
+        src->pixels + (size_t)(y * src->height / dst->height) * src->width;
+    for (int x = 0; x < dst->width; ++x)
+      dst->pixels[y * dst->width + x] = row[x * src->width / dst->width];
+  }
+  if (!build_layouts(dst, layouts))
+  {
+    texture_release(dst);
+    return false;
+  }
+  return true;
+}
+
+static void *loader_thread(void *arg)
+{
+  TextureCache *cache = arg;
+  pthread_mutex_lock(&cache->lock);
+  for (;;)
+  {
+    while (cache->queue_size == 0 && !cache->quit)
+      pthread_cond_wait(&cache->wake, &cache->lock);
+    if (cache->quit)
+      break;
+    int id = cache->queue[cache->queue_head];
+    cache->queue_head = (cache->queue_head + 1) % cache->count;
+    --cache->queue_size;
+    ++cache->loading;
+    pthread_mutex_unlock(&cache->lock);
+
+    LoadResult result;
+    memset(&result, 0, sizeof(result));
+    result.id = id;
+    result.ok = cache->load(cache->arg, id, &result.full);
+    if (result.ok && (!build_layouts(&result.full, cache->layouts) ||
+                      !shrink(&result.low, &result.full, cache->layouts)))
+    {
+      fprintf(stderr, "Out of memory while streaming texture %d\n", id);
+      texture_release(&result.full);
+      result.ok = false;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    cache->results[cache->result_count++] = result;
+    --cache->loading;
+    if (cache->queue_size == 0 && cache->loading == 0)
+      pthread_cond_broadcast(&cache->idle);
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return NULL;
+}
+
+/* Grey checkerboard of 4x4 squares. */
+static bool make_placeholder(Texture *tex, unsigned layouts)
+{
+  memset(tex, 0, sizeof(*tex));
+  tex->width = TEXTURE_CACHE_LOW_SIZE;
+  tex->height = TEXTURE_CACHE_LOW_SIZE;
+  tex->pixels = malloc(sizeof(uint32_t) * TEXTURE_CACHE_LOW_SIZE *
+                       TEXTURE_CACHE_LOW_SIZE);
+  if (!tex->pixels)
+    return false;
+  for (int y = 0; y < TEXTURE_CACHE_LOW_SIZE; ++y)
+  {
+    for (int x = 0; x < TEXTURE_CACHE_LOW_SIZE; ++x)
+    {
+      tex->pixels[y * TEXTURE_CACHE_LOW_SIZE + x] =
+          ((x / 4 + y / 4) % 2) ? 0xFF808080u : 0xFF606060u;
+    }
+  }
+  return build_layouts(tex, layouts);
+}
+
+TextureCache *texture_cache_create(int count, size_t budget_bytes,
+                                   unsigned layouts, TextureLoadFn load,
+                                   void *arg)
+{
+  TextureCache *cache = calloc(1, sizeof(*cache));
+  if (!cache || count <= 0)
+  {
+    fprintf(stderr, "Unable to create a cache of %d textures\n", count);
+    free(cache);
+    return NULL;
+  }
+  cache->count = count;
+  cache->layouts = layouts;
+  cache->budget = budget_bytes;
+  cache->load = load;
+  cache->arg = arg;
+  cache->entries = calloc((size_t)count, sizeof(CacheEntry));
+  cache->slots = calloc((size_t)count, sizeof(Texture));
+  cache->used = calloc((size_t)count, 1);
+  cache->queue = calloc((size_t)count, sizeof(int));
+  cache->results = calloc((size_t)count, sizeof(LoadResult));
+  bool ok = cache->entries && cache->slots && cache->used &&
+            cache->queue && cache->results &&
+            make_placeholder(&cache->placeholder, layouts);
+  if (ok)
+  {
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->wake, NULL);
+    pthread_cond_init(&cache->idle, NULL);
+    cache->started =
+        pthread_create(&cache->thread, NULL, loader_thread, cache) == 0;
+    ok = cache->started;
+  }
+  if (!ok)
+  {
+    fprintf(stderr, "Unable to start texture streaming\n");
+    texture_cache_destroy(cache);
+    return NULL;
+  }
+  return cache;
+}
+
+void texture_cache_destroy(TextureCache *cache)
+{
+  if (!cache)
+    return;
+  if (cache->started)
+  {
+    pthread_mutex_lock(&cache->lock);
+    cache->quit = true;
+    pthread_cond_signal(&cache->wake);
+    pthread_mutex_unlock(&cache->lock);
+    pthread_join(cache->thread, NULL);
+    pthread_mutex_destroy(&cache->lock);
+    pthread_cond_destroy(&cache->wake);
+    pthread_cond_destroy(&cache->idle);
+  }
+  for (int i = 0; i < cache->result_count; ++i)
+  {
+    texture_release(&cache->results[i].full);
+    texture_release(&cache->results[i].low);
+  }
+  for (int i = 0; cache->entries && i < cache->count; ++i)
+  {
+    texture_release(&cache->entries[i].full);
+    texture_release(&cache->entries[i].low);
+  }
+  texture_release(&cache->placeholder);
+  free(cache->entries);
+  free(cache->slots);
+  free(cache->used);
+  free(cache->queue);
+  free(cache->results);
+  free(cache);
+}
+
+/* Caller holds the lock. */
+static void enqueue(TextureCache *cache, int id)
+{
+  CacheEntry *entry = &cache->entries[id];
+  if (entry->state != ENTRY_ABSENT)
+    return;
+  entry->state = ENTRY_QUEUED;
+  cache->queue[(cache->queue_head + cache->queue_size) % cache->count] = id;
+  ++cache->queue_size;
+}
+
+void texture_cache_request(TextureCache *cache, int id)
+{
+  if (id < 0 || id >= cache->count)
+    return;
+  pthread_mutex_lock(&cache->lock);
+  enqueue(cache, id);
+  pthread_cond_signal(&cache->wake);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void texture_cache_flush(TextureCache *cache)
+{
+  pthread_mutex_lock(&cache->lock);
+  while (cache->queue_size > 0 || cache->loading > 0)
+    pthread_cond_wait(&cache->idle, &cache->lock);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+static void install(TextureCache *cache, LoadResult *result)
+{
+  CacheEntry *entry = &cache->entries[result->id];
+  if (!result->ok)
+  {
+    entry->state = ENTRY_FAILED;
+    return;
+  }
+  entry->full = result->full;
+  texture_release(&entry->low);
+  entry->low = result->low;
+  entry->bytes = texture_bytes(&entry->full);
+  entry->state = ENTRY_RESIDENT;
+  cache->resident_bytes += entry->bytes;
+}
+
+/* Least recently sampled resident texture the last frame did not use, or
+   -1. */
+static int eviction_candidate(const TextureCache *cache)
+{
+  int victim = -1;
+  for (int i = 0; i < cache->count; ++i)
+  {
+    const CacheEntry *entry = &cache->entries[i];
+    if (entry->state == ENTRY_RESIDENT && entry->last_used < cache->frame &&
+        (victim < 0 || entry->last_used < cache->entries[victim].last_used))
+      victim = i;
+  }
+  return victim;
+}
+
+const Texture *texture_cache_frame(TextureCache *cache)
+{
+  ++cache->frame;
+  pthread_mutex_lock(&cache->lock);
+  for (int i = 0; i < cache->result_count; ++i)
+    install(cache, &cache->results[i]);
+  cache->result_count = 0;
+
+  /* Flags set while drawing the previous frame. */
+  int queued = cache->queue_size;
+  for (int i = 0; i < cache->count; ++i)
+  {
+    if (cache->used[i])
+    {
+      cache->used[i] = 0;
+      cache->entries[i].last_used = cache->frame;
+      enqueue(cache, i);
+    }
+  }
+  if (cache->queue_size > queued)
+    pthread_cond_signal(&cache->wake);
+  pthread_mutex_unlock(&cache->lock);
+
+  while (cache->resident_bytes > cache->budget)
+  {
+    int victim = eviction_candidate(cache);
+    if (victim < 0)
+      break;
+    CacheEntry *entry = &cache->entries[victim];
+    texture_release(&entry->full);
+    cache->resident_bytes -= entry->bytes;
+    entry->state = ENTRY_ABSENT;
+  }
+
+  for (int i = 0; i < cache->count; ++i)
+  {
+    const CacheEntry *entry = &cache->entries[i];
+    if (entry->state == ENTRY_RESIDENT)
+      cache->slots[i] = entry->full;
+    else if (entry->low.width > 0)
+      cache->slots[i] = entry->low;
+    else
+      cache->slots[i] = cache->placeholder;
+    cache->slots[i].used = &cache->used[i];
+  }
+  return cache->slots;
+}
+
+bool texture_cache_settled(TextureCache *cache)
+{
+  pthread_mutex_lock(&cache->lock);
+  bool settled = cache->queue_size == 0 && cache->loading == 0 &&
+                 cache->result_count == 0;
+  for (int i = 0; i < cache->count && settled; ++i)
+  {
+    const CacheEntry *entry = &cache->entries[i];
+    if (cache->used[i] && entry->state != ENTRY_RESIDENT &&
+        entry->state != ENTRY_FAILED)
+      settled = false;
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return settled;
+}
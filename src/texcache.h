@@ -0,0 +1,64 @@
+#ifndef RAYCAST_TEXCACHE_H
+#define RAYCAST_TEXCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "texture.h"
+
+/* Streams textures in on demand. Texture ids are tile - 1, as in the
+   textures array render_frame_textured() takes, and that array is what
+   texture_cache_frame() hands back: every entry is drawable, either the
+   full texture or a stand-in, so frames never wait for a load.
+
+   The renderer flags each texture a frame samples (Texture.used); at the
+   next frame the cache queues the ones that are not resident for a
+   background thread, which loads them through the caller's function and
+   builds the requested layouts. Until a texture arrives it is drawn as a
+   grey checkerboard, and once it has been resident as a copy of at most
+   TEXTURE_CACHE_LOW_SIZE texels a side that outlives eviction. Whenever
+   resident textures exceed the byte budget, the least recently sampled
+   are evicted, except those the last frame sampled, so the cache only
+   runs over budget while a single frame needs more. */
+#define TEXTURE_CACHE_LOW_SIZE 16
+
+/* Layouts built for each loaded texture. TEXTURE_CACHE_INDEXED quantizes
+   level 0 to a palette (see texture_build_palette()) and replaces the
+   column copy; TEXTURE_CACHE_LIT adds level 0 at every light level, as
+   the palette of an indexed texture (light_build_palette()) and as
+   texels otherwise (light_build_texels()). */
+#define TEXTURE_CACHE_MIPS 1u
+#define TEXTURE_CACHE_COLUMNS 2u
+#define TEXTURE_CACHE_INDEXED 4u
+#define TEXTURE_CACHE_LIT 8u
+
+/* Runs on the loader thread. Fills `out` with texture `id` (owned by the
+   cache from then on); prints why and returns false on failure, and the
+   id is not asked for again. */
+typedef bool (*TextureLoadFn)(void *arg, int id, Texture *out);
+
+typedef struct TextureCache TextureCache;
+
+/* Prints why and returns NULL on failure. */
+TextureCache *texture_cache_create(int count, size_t budget_bytes,
+                                   unsigned layouts, TextureLoadFn load,
+                                   void *arg);
+void texture_cache_destroy(TextureCache *cache);
+
+/* Queues `id` ahead of its first use. */
+void texture_cache_request(TextureCache *cache, int id);
+/* Blocks until every queued load has finished. */
+void texture_cache_flush(TextureCache *cache);
+
+/* Call before each frame, on the thread that renders, while no frame is
+   being drawn: installs finished loads, queues what the last frame
+   missed, evicts over budget and returns the `count` textures to draw
+   with. The array stays valid until the next call. */
+const Texture *texture_cache_frame(TextureCache *cache);
+
+/* Call after drawing a frame, on the thread that renders: true when the
+   frame sampled no stand-in that a load will replace and no load is in
+   flight, so drawing the same view again gives the same picture. */
+bool texture_cache_settled(TextureCache *cache);
+
+#endif
@@ -0,0 +1,128 @@
+#include "texpack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filemap.h"
+
+#define TEXPACK_MAX_SIZE 65536
+
+/* True when `texels` 32-bit texels at `offset` lie inside the file and
+   the block is aligned. */
+static bool block_fits(uint64_t offset, size_t texels, size_t size)
+{
+  return offset % TEXPACK_ALIGN == 0 && offset <= size &&
+         texels <= (size - offset) / sizeof(uint32_t);
+}
+
+static bool entry_valid(const TexPackEntry *entry, size_t size)
+{
+  if (entry->width == 0 || entry->height == 0 ||
+      entry->width > TEXPACK_MAX_SIZE || entry->height > TEXPACK_MAX_SIZE ||
+      memchr(entry->name, '\0', TEXPACK_NAME_SIZE) == NULL)
+    return false;
+  size_t texels = (size_t)entry->width * entry->height;
+  if (entry->pixels == 0 || !block_fits(entry->pixels, texels, size))
+    return false;
+  if (entry->columns != 0 && !block_fits(entry->columns, texels, size))
+    return false;
+  size_t mip_texels;
+  int mip_count =
+      texture_mip_layout((int)entry->width, (int)entry->height, &mip_texels);
+  if (entry->mips == 0)
+    return entry->mip_count == 0;
+  return entry->mip_count == (uint32_t)mip_count &&
+         block_fits(entry->mips, mip_texels, size);
+}
+
+bool texpack_load(TexturePack *pack, const char *path)
+{
+  memset(pack, 0, sizeof(*pack));
+  /* Read-only: the renderer never writes texels, and every page stays
+     shared with the page cache. */
+  size_t size;
+  void *base = file_map(path, FILEMAP_READ, &size);
+  if (!base)
+  {
+    fprintf(stderr, "Unable to map texture pack %s\n", path);
+    return false;
+  }
+  if (size < sizeof(TexPackHeader))
+  {
+    fprintf(stderr, "Texture pack %s is truncated\n", path);
+    file_unmap(base, size);
+    return false;
+  }
+
+  const TexPackHeader *header = base;
+  const TexPackEntry *entries =
+      (const TexPackEntry *)((const char *)base + sizeof(TexPackHeader));
+  bool valid = memcmp(header->magic, TEXPACK_FILE_MAGIC, 4) == 0 &&
+               header->version == TEXPACK_FILE_VERSION &&
+               header->count > 0 &&
+               header->count <= (size - sizeof(TexPackHeader)) /
+                                    sizeof(TexPackEntry);
+  for (uint32_t i = 0; valid && i < header->count; ++i)
+    valid = entry_valid(&entries[i], size);
+  if (!valid)
+  {
+    fprintf(stderr, "%s is not a valid texture pack\n", path);
+    file_unmap(base, size);
+    return false;
+  }
+
+  pack->textures = calloc(header->count, sizeof(Texture));
+  if (!pack->textures)
+  {
+    fprintf(stderr, "Out of memory while opening %s\n", path);
+    file_unmap(base, size);
+    return false;
+  }
+  for (uint32_t i = 0; i < header->count; ++i)
+  {
+    const TexPackEntry *entry = &entries[i];
+    Texture *tex = &pack->textures[i];
+    uint32_t *texels = (uint32_t *)base;
+    tex->width = (int)entry->width;
+    tex->height = (int)entry->height;
+    tex->pixels = texels + entry->pixels / sizeof(uint32_t);
+    tex->borrowed = TEXTURE_BORROWED_PIXELS;
+    if (entry->columns)
+    {
+      tex->columns = texels + entry->columns / sizeof(uint32_t);
+      tex->borrowed |= TEXTURE_BORROWED_COLUMNS;
+    }
+    if (entry->mips)
+    {
+      texture_point_mips(tex, texels + entry->mips / sizeof(uint32_t),
+                         (int)entry->mip_count);
+      tex->borrowed |= TEXTURE_BORROWED_MIPS;
+    }
+  }
+  pack->count = (int)header->count;
+  pack->entries = entries;
+  pack->mapping = base;
+  pack->mapping_size = size;
+  return true;
+}
+
+void texpack_release(TexturePack *pack)
+{
+  for (int i = 0; i < pack->count; ++i)
+    texture_release(&pack->textures[i]);
+  free(pack->textures);
+  if (pack->mapping)
+    file_unmap(pack->mapping, pack->mapping_size);
+  memset(pack, 0, sizeof(*pack));
+}
+
+int texpack_find(const TexturePack *pack, const char *name)
+{
+  for (int i = 0; i < pack->count; ++i)
+  {
+    if (strcmp(pack->entries[i].name, name) == 0)
+      return i;
+  }
+  return -1;
+}
@@ -0,0 +1,61 @@
+#ifndef RAYCAST_TEXPACK_H
+#define RAYCAST_TEXPACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "texture.h"
+
+/* Texture pack: textures already converted to ARGB8888, optionally with
+   their mip pyramid and column-major copy, written by build/texpacker.
+   texpack_load() maps the file and points each Texture straight into it,
+   so opening a pack decodes and copies nothing whatever its size.
+
+   On-disk layout (little-endian): this header, `count` entries, then the
+   texel blocks, each starting on a TEXPACK_ALIGN boundary. Offsets are
+   from the start of the file; 0 means the block is absent. A mip block
+   holds every level back to back, as texture_build_mips() lays them
+   out. */
+#define TEXPACK_FILE_MAGIC "RCTP"
+#define TEXPACK_FILE_VERSION 1u
+#define TEXPACK_ALIGN 64
+#define TEXPACK_NAME_SIZE 40
+
+typedef struct TexPackHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t count;
+  uint32_t reserved;
+} TexPackHeader;
+
+typedef struct TexPackEntry
+{
+  char name[TEXPACK_NAME_SIZE];
+  uint32_t width;
+  uint32_t height;
+  uint32_t mip_count;
+  uint32_t reserved;
+  uint64_t pixels;
+  uint64_t columns;
+  uint64_t mips;
+} TexPackEntry;
+
+typedef struct TexturePack
+{
+  int count;
+  Texture *textures;
+  const TexPackEntry *entries;
+  void *mapping;
+  size_t mapping_size;
+} TexturePack;
+
+bool texpack_load(TexturePack *pack, const char *path);
+/* Also frees mips and column copies built on top of pack textures. */
+void texpack_release(TexturePack *pack);
+/* Index of the texture named `name` (its file name without extension),
+   or -1. */
+int texpack_find(const TexturePack *pack, const char *name);
+
+#endif
@@ -0,0 +1,292 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "texpack.h"
+
+#define TEXPACKER_MAX_TEXTURES 4096
+
+typedef struct PackInput
+{
+  char *paths[TEXPACKER_MAX_TEXTURES];
+  int count;
+} PackInput;
+
+static bool add_path(PackInput *input, const char *path)
+{
+  if (input->count == TEXPACKER_MAX_TEXTURES)
+  {
+    fprintf(stderr, "More than %d textures\n", TEXPACKER_MAX_TEXTURES);
+    return false;
+  }
+  size_t length = strlen(path) + 1;
+  input->paths[input->count] = malloc(length);
+  if (!input->paths[input->count])
+  {
+    fprintf(stderr, "Out of memory\n");
+    return false;
+  }
+  memcpy(input->paths[input->count++], path, length);
+  return true;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static bool has_png_suffix(const char *name)
+{
+  size_t length = strlen(name);
+  return length > 4 && (strcmp(name + length - 4, ".png") == 0 ||
+                        strcmp(name + length - 4, ".PNG") == 0);
+}
+
+/* A directory contributes its PNGs in name order, anything else itself. */
+static bool add_argument(PackInput *input, const char *path)
+{
+  struct stat st;
+  if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+    return add_path(input, path);
+
+  DIR *dir = opendir(path);
+  if (!dir)
+  {
+    fprintf(stderr, "Unable to list %s\n", path);
+    return false;
+  }
+  int first = input->count;
+  bool ok = true;
+  struct dirent *entry;
+  while (ok && (entry = readdir(dir)) != NULL)
+  {
+    if (!has_png_suffix(entry->d_name))
+      continue;
+    char full[4096];
+    int n = snprintf(full, sizeof(full), "%s/%s", path, entry->d_name);
+    ok = n > 0 && (size_t)n < sizeof(full) && add_path(input, full);
+  }
+  closedir(dir);
+  qsort(input->paths + first, (size_t)(input->count - first),
+        sizeof(char *), compare_paths);
+  return ok;
+}
+
+/* File name without directory and extension. */
+static bool texture_name(const char *path, char name[TEXPACK_NAME_SIZE])
+{
+  const char *base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  const char *dot = strrchr(base, '.');
+  size_t length = dot ? (size_t)(dot - base) : strlen(base);
+  if (length == 0 || length >= TEXPACK_NAME_SIZE)
+  {
+    fprintf(stderr, "%s: name must be 1 to %d characters\n", path,
+            TEXPACK_NAME_SIZE - 1);
+    return false;
+  }
+  memset(name, 0, TEXPACK_NAME_SIZE);
+  memcpy(name, base, length);
+  return true;
+}
+
+static bool decode(const char *path, Texture *out)
+{
+  SDL_Surface *surface = IMG_Load(path);
+  if (!surface)
+  {
+    fprintf(stderr, "IMG_Load %s failed: %s\n", path, IMG_GetError());
+    return false;
+  }
+  SDL_Surface *converted =
+      SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+  SDL_FreeSurface(surface);
+  if (!converted)
+  {
+    fprintf(stderr, "SDL_ConvertSurfaceFormat %s failed: %s\n", path,
+            SDL_GetError());
+    return false;
+  }
+
+  memset(out, 0, sizeof(*out));
+  out->width = converted->w;
+  out->height = converted->h;
+  out->pixels = malloc(sizeof(uint32_t) * (size_t)out->width * out->height);
+  if (!out->pixels)
+  {
+    fprintf(stderr, "Out of memory while loading %s\n", path);
+    SDL_FreeSurface(converted);
+    return false;
+  }
+  for (int y = 0; y < out->height; ++y)
+  {
+    memcpy(out->pixels + (size_t)y * out->width,
+           (const uint8_t *)converted->pixels + (size_t)y * converted->pitch,
+           sizeof(uint32_t) * (size_t)out->width);
+  }
+  SDL_FreeSurface(converted);
+  return true;
+}
+
+/* Appends `texels` at the next aligned offset and returns that offset. */
+static uint64_t write_block(FILE *out, const uint32_t *texels, size_t count)
+{
+  static const char zeros[TEXPACK_ALIGN];
+  long position = ftell(out);
+  if (position < 0)
+    return 0;
+  size_t padding = (TEXPACK_ALIGN - (size_t)position % TEXPACK_ALIGN) %
+                   TEXPACK_ALIGN;
+  if (fwrite(zeros, 1, padding, out) != padding ||
+      fwrite(texels, sizeof(uint32_t), count, out) != count)
+    return 0;
+  return (uint64_t)position + padding;
+}
+
+static bool write_pack(const char *out_path, const PackInput *input,
+                       bool mips, bool columns)
+{
+  TexPackEntry *entries = calloc((size_t)input->count, sizeof(TexPackEntry));
+  FILE *out = fopen(out_path, "wb");
+  if (!entries || !out)
+  {
+    fprintf(stderr, "Unable to create %s\n", out_path);
+    free(entries);
+    if (out)
+      fclose(out);
+    return false;
+  }
+
+  /* Texel blocks go out one texture at a time behind room for the header
+     and entries, which are written last. */
+  TexPackHeader header = {{0}, TEXPACK_FILE_VERSION, (uint32_t)input->count,
+                          0};
+  memcpy(header.magic, TEXPACK_FILE_MAGIC, 4);
+  size_t table = sizeof(header) + sizeof(TexPackEntry) * input->count;
+  bool ok = fseek(out, (long)table, SEEK_SET) == 0;
+  size_t texels = 0;
+  for (int i = 0; ok && i < input->count; ++i)
+  {
+    TexPackEntry *entry = &entries[i];
+    Texture tex;
+    ok = texture_name(input->paths[i], entry->name) &&
+         decode(input->paths[i], &tex);
+    for (int j = 0; ok && j < i; ++j)
+    {
+      if (strcmp(entries[j].name, entry->name) == 0)
+      {
+        fprintf(stderr, "%s: a texture named %s is already packed\n",
+                input->paths[i], entry->name);
+        ok = false;
+      }
+    }
+    if (!ok)
+      break;
+
+    size_t count = (size_t)tex.width * tex.height;
+    size_t mip_texels = 0;
+    int mip_count =
+        mips ? texture_mip_layout(tex.width, tex.height, &mip_texels) : 0;
+    entry->width = (uint32_t)tex.width;
+    entry->height = (uint32_t)tex.height;
+    entry->pixels = write_block(out, tex.pixels, count);
+    ok = entry->pixels != 0;
+    if (ok && columns)
+    {
+      ok = texture_build_columns(&tex) &&
+           (entry->columns = write_block(out, tex.columns, count)) != 0;
+    }
+    if (ok && mip_count > 0)
+    {
+      entry->mip_count = (uint32_t)mip_count;
+      ok = texture_build_mips(&tex) &&
+           (entry->mips = write_block(out, tex.mips[0], mip_texels)) != 0;
+    }
+    texels += count + (columns ? count : 0) + (mip_count ? mip_texels : 0);
+    texture_release(&tex);
+  }
+
+  if (ok)
+  {
+    ok = fseek(out, 0, SEEK_SET) == 0 &&
+         fwrite(&header, sizeof(header), 1, out) == 1 &&
+         fwrite(entries, sizeof(TexPackEntry), (size_t)input->count, out) ==
+             (size_t)input->count;
+  }
+  if (fclose(out) != 0)
+    ok = false;
+  free(entries);
+  if (!ok)
+  {
+    fprintf(stderr, "Unable to write %s\n", out_path);
+    remove(out_path);
+    return false;
+  }
+  printf("%s: %d texture(s), %.1f MiB of texels\n", out_path, input->count,
+         texels * sizeof(uint32_t) / (1024.0 * 1024.0));
+  return true;
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [-m] [-c] output.rctp (directory | image)...\n"
+          "  -m  store mipmaps\n"
+          "  -c  store column-major copies\n",
+          argv0);
+}
+
+int main(int argc, char *argv[])
+{
+  bool mips = false;
+  bool columns = false;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; ++arg)
+  {
+    if (strcmp(argv[arg], "-m") == 0)
+      mips = true;
+    else if (strcmp(argv[arg], "-c") == 0)
+      columns = true;
+    else
+      break;
+  }
+  if (arg + 1 >= argc || argv[arg][0] == '-')
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  const char *out_path = argv[arg++];
+
+  PackInput input = {{NULL}, 0};
+  bool ok = true;
+  for (; ok && arg < argc; ++arg)
+    ok = add_argument(&input, argv[arg]);
+  if (ok && input.count == 0)
+  {
+    fprintf(stderr, "No images to pack\n");
+    ok = false;
+  }
+
+  int img_flags = IMG_INIT_PNG;
+  if (ok && (IMG_Init(img_flags) & img_flags) != img_flags)
+  {
+    fprintf(stderr, "IMG_Init Error: %s\n", IMG_GetError());
+    ok = false;
+  }
+  if (ok)
+  {
+    ok = write_pack(out_path, &input, mips, columns);
+    IMG_Quit();
+  }
+  for (int i = 0; i < input.count; ++i)
+    free(input.paths[i]);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,334 @@
+#include "texture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "transpose.h"
+
+bool texture_build_columns(Texture *tex)
+{
+  if (tex->columns)
+    return true;
+
+  size_t pixel_count = (size_t)tex->width * (size_t)tex->height;
+  tex->columns = malloc(pixel_count * sizeof(uint32_t));
+  if (!tex->columns)
+  {
+    fprintf(stderr, "Out of memory while transposing texture\n");
+    return false;
+  }
+  tex->borrowed &= ~TEXTURE_BORROWED_COLUMNS;
+  transpose_pixels(tex->columns, tex->height, tex->pixels, tex->width,
+                   tex->width, tex->height);
+  return true;
+}
+
+static int level_size(int size, int level)
+{
+  size >>= level;
+  return size > 0 ? size : 1;
+}
+
+/* Averages each channel of a 2x2 block; odd edges repeat the last texel. */
+static void downsample(uint32_t *dst, int dw, int dh, const uint32_t *src,
+                       int sw, int sh)
+{
+  for (int y = 0; y < dh; ++y)
+  {
+    const uint32_t *row0 = src + (size_t)(2 * y < sh ? 2 * y : sh - 1) * sw;
+    const uint32_t *row1 =
+        src + (size_t)(2 * y + 1 < sh ? 2 * y + 1 : sh - 1) * sw;
+    for (int x = 0; x < dw; ++x)
+    {
+      int x0 = 2 * x < sw ? 2 * x : sw - 1;
+      int x1 = 2 * x + 1 < sw ? 2 * x + 1 : sw - 1;
+      uint32_t texels[4] = {row0[x0], row0[x1], row1[x0], row1[x1]};
+      uint32_t out = 0;
+      for (int shift = 0; shift < 32; shift += 8)
+      {
+        uint32_t sum = 2;
+        for (int i = 0; i < 4; ++i)
+          sum += (texels[i] >> shift) & 0xFF;
+        out |= (sum >> 2) << shift;
+      }
+      dst[(size_t)y * dw + x] = out;
+    }
+  }
+}
+
+int texture_mip_layout(int width, int height, size_t *texels)
+{
+  int count = 0;
+  size_t total = 0;
+  while (count < TEXTURE_MAX_MIPS &&
+         (level_size(width, count) > 1 || level_size(height, count) > 1))
+  {
+    ++count;
+    total += (size_t)level_size(width, count) *
+             (size_t)level_size(height, count);
+  }
+  *texels = total;
+  return count;
+}
+
+void texture_point_mips(Texture *tex, uint32_t *texels, int count)
+{
+  for (int level = 1; level <= count; ++level)
+  {
+    tex->mips[level - 1] = texels;
+    texels += (size_t)level_size(tex->width, level) *
+              (size_t)level_size(tex->height, level);
+  }
+  tex->mip_count = count;
+}
+
+bool texture_build_mips(Texture *tex)
+{
+  if (tex->mip_count > 0)
+    return true;
+
+  size_t total;
+  int count = texture_mip_layout(tex->width, tex->height, &total);
+  if (count == 0)
+    return true;
+
+  uint32_t *texels = malloc(total * sizeof(uint32_t));
+  if (!texels)
+  {
+    fprintf(stderr, "Out of memory while building texture mipmaps\n");
+    return false;
+  }
+
+  texture_point_mips(tex, texels, count);
+  const uint32_t *src = tex->pixels;
+  for (int level = 1; level <= count; ++level)
+  {
+    downsample(tex->mips[level - 1], level_size(tex->width, level),
+               level_size(tex->height, level), src,
+               level_size(tex->width, level - 1),
+               level_size(tex->height, level - 1));
+    src = tex->mips[level - 1];
+  }
+  tex->borrowed &= ~TEXTURE_BORROWED_MIPS;
+  return true;
+}
+
+/* A distinct colour of the texture, its texel count, the palette entry it
+   went to and the key it is being sorted by. */
+typedef struct ColorCount
+{
+  uint32_t color;
+  uint32_t count;
+  int entry;
+  uint64_t key;
+} ColorCount;
+
+static int compare_key(const void *a, const void *b)
+{
+  uint64_t ka = ((const ColorCount *)a)->key;
+  uint64_t kb = ((const ColorCount *)b)->key;
+  return (ka > kb) - (ka < kb);
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+  uint32_t ca = *(const uint32_t *)a;
+  uint32_t cb = *(const uint32_t *)b;
+  return (ca > cb) - (ca < cb);
+}
+
+/* Shift of the widest channel of colors [begin, end); its range goes to
+   `range`. */
+static int widest_channel(const ColorCount *colors, int begin, int end,
+                          int *range)
+{
+  int best = 0;
+  *range = -1;
+  for (int shift = 0; shift < 32; shift += 8)
+  {
+    int lo = 255;
+    int hi = 0;
+    for (int i = begin; i < end; ++i)
+    {
+      int c = (colors[i].color >> shift) & 0xFF;
+      lo = c < lo ? c : lo;
+      hi = c > hi ? c : hi;
+    }
+    if (hi - lo > *range)
+    {
+      *range = hi - lo;
+      best = shift;
+    }
+  }
+  return best;
+}
+
+/* Sorts colors [begin, end) by one channel, then by colour so the order
+   is total. */
+static void sort_by_channel(ColorCount *colors, int begin, int end,
+                            int shift)
+{
+  for (int i = begin; i < end; ++i)
+    colors[i].key = (uint64_t)((colors[i].color >> shift) & 0xFF) << 32 |
+                    colors[i].color;
+  qsort(colors + begin, (size_t)(end - begin), sizeof(ColorCount),
+        compare_key);
+}
+
+/* Median cut over the distinct colours: box i is colors [boxes[i],
+   boxes[i + 1]). The box with the widest channel is split at the
+   texel-weighted median of that channel until there are `limit` boxes or
+   every box holds one colour. */
+static int median_cut(ColorCount *colors, int distinct, int *boxes,
+                      int limit)
+{
+  int ranges[TEXTURE_PALETTE_SIZE];
+  int shifts[TEXTURE_PALETTE_SIZE];
+  int count = 1;
+  boxes[0] = 0;
+  boxes[1] = distinct;
+  shifts[0] = widest_channel(colors, 0, distinct, &ranges[0]);
+  while (count < limit)
+  {
+    int pick = -1;
+    for (int b = 0; b < count; ++b)
+    {
+      if (ranges[b] > 0 && (pick < 0 || ranges[b] > ranges[pick]))
+        pick = b;
+    }
+    if (pick < 0)
+      break;
+
+    int begin = boxes[pick];
+    int end = boxes[pick + 1];
+    sort_by_channel(colors, begin, end, shifts[pick]);
+    uint64_t total = 0;
+    for (int i = begin; i < end; ++i)
+      total += colors[i].count;
+    uint64_t seen = 0;
+    int split = begin + 1;
+    for (int i = begin; i < end - 1; ++i)
+    {
+      seen += colors[i].count;
+      split = i + 1;
+      if (2 * seen >= total)
+        break;
+    }
+
+    int tail = count - pick - 1;
+    memmove(&boxes[pick + 2], &boxes[pick + 1], sizeof(int) * (tail + 1));
+    memmove(&ranges[pick + 2], &ranges[pick + 1], sizeof(int) * tail);
+    memmove(&shifts[pick + 2], &shifts[pick + 1], sizeof(int) * tail);
+    boxes[pick + 1] = split;
+    shifts[pick] = widest_channel(colors, begin, split, &ranges[pick]);
+    shifts[pick + 1] = widest_channel(colors, split, end, &ranges[pick + 1]);
+    ++count;
+  }
+  return count;
+}
+
+long texture_build_palette(Texture *tex)
+{
+  if (tex->indices)
+    return 0;
+
+  const size_t texels = (size_t)tex->width * tex->height;
+  uint32_t *sorted = malloc(sizeof(uint32_t) * texels);
+  ColorCount *colors = malloc(sizeof(ColorCount) * texels);
+  uint8_t *indices = malloc(texels);
+  uint32_t *palette = malloc(sizeof(uint32_t) * 2 * TEXTURE_PALETTE_SIZE);
+  if (!sorted || !colors || !indices || !palette)
+  {
+    fprintf(stderr, "Out of memory while building a texture palette\n");
+    free(sorted);
+    free(colors);
+    free(indices);
+    free(palette);
+    return -1;
+  }
+
+  memcpy(sorted, tex->pixels, sizeof(uint32_t) * texels);
+  qsort(sorted, texels, sizeof(uint32_t), compare_u32);
+  int distinct = 0;
+  for (size_t i = 0; i < texels; ++i)
+  {
+    if (distinct > 0 && colors[distinct - 1].color == sorted[i])
+      ++colors[distinct - 1].count;
+    else
+      colors[distinct++] = (ColorCount){sorted[i], 1, 0, sorted[i]};
+  }
+  free(sorted);
+
+  /* Each box becomes the texel-weighted mean of its colours. */
+  int boxes[TEXTURE_PALETTE_SIZE + 1];
+  int entries = median_cut(colors, distinct, boxes, TEXTURE_PALETTE_SIZE);
+  memset(palette, 0, sizeof(uint32_t) * 2 * TEXTURE_PALETTE_SIZE);
+  for (int b = 0; b < entries; ++b)
+  {
+    uint64_t sums[4] = {0, 0, 0, 0};
+    uint64_t total = 0;
+    for (int i = boxes[b]; i < boxes[b + 1]; ++i)
+    {
+      for (int c = 0; c < 4; ++c)
+        sums[c] += (uint64_t)((colors[i].color >> (8 * c)) & 0xFF) *
+                   colors[i].count;
+      total += colors[i].count;
+      colors[i].entry = b;
+    }
+    uint32_t mean = 0;
+    for (int c = 0; c < 4; ++c)
+      mean |= (uint32_t)((sums[c] + total / 2) / total) << (8 * c);
+    /* The renderer's y-side shade: every channel halved. */
+    palette[b] = mean;
+    palette[TEXTURE_PALETTE_SIZE + b] =
+        ((mean & 0xFEFEFE) >> 1) | 0xFF000000;
+  }
+
+  /* Texels find their colour, now in box order, by binary search once
+     the colours are sorted again. */
+  for (int i = 0; i < distinct; ++i)
+    colors[i].key = colors[i].color;
+  qsort(colors, (size_t)distinct, sizeof(ColorCount), compare_key);
+  long changed = 0;
+  for (int y = 0; y < tex->height; ++y)
+  {
+    for (int x = 0; x < tex->width; ++x)
+    {
+      uint32_t color = tex->pixels[(size_t)y * tex->width + x];
+      ColorCount key = {color, 0, 0, color};
+      const ColorCount *found = bsearch(&key, colors, (size_t)distinct,
+                                        sizeof(ColorCount), compare_key);
+      indices[(size_t)x * tex->height + y] = (uint8_t)found->entry;
+      changed += palette[found->entry] != color;
+    }
+  }
+  free(colors);
+  tex->indices = indices;
+  tex->palette = palette;
+  return changed;
+}
+
+void texture_release(Texture *tex)
+{
+  if (!(tex->borrowed & TEXTURE_BORROWED_PIXELS))
+    free(tex->pixels);
+  if (!(tex->borrowed & TEXTURE_BORROWED_COLUMNS))
+    free(tex->columns);
+  if (tex->mip_count > 0 && !(tex->borrowed & TEXTURE_BORROWED_MIPS))
+    free(tex->mips[0]);
+  free(tex->indices);
+  free(tex->palette);
+  free(tex->lit);
+  free(tex->shaded);
+  tex->pixels = NULL;
+  tex->columns = NULL;
+  tex->indices = NULL;
+  tex->palette = NULL;
+  tex->lit = NULL;
+  tex->shaded = NULL;
+  tex->mip_count = 0;
+  tex->width = 0;
+  tex->height = 0;
+  tex->borrowed = 0;
+}
@@ -0,0 +1,66 @@
+#ifndef RAYCAST_TEXTURE_H
+#define RAYCAST_TEXTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Enough levels for a 65536-texel edge. */
+#define TEXTURE_MAX_MIPS 16
+
+/* Entries of an indexed texture's palette; the palette holds them twice,
+   plain and then shaded for y sides. */
+#define TEXTURE_PALETTE_SIZE 256
+
+/* Bits of Texture.borrowed. */
+#define TEXTURE_BORROWED_PIXELS 1u
+#define TEXTURE_BORROWED_COLUMNS 2u
+#define TEXTURE_BORROWED_MIPS 4u
+
+/* ARGB8888 texels in row-major `pixels`. `columns`, when built, holds the
+   same texels column-major so vertical wall spans read sequentially.
+   `mips[i]` is level i + 1 of the box-filtered pyramid, each level half
+   the size of the previous one (at least 1); all levels share a single
+   allocation starting at mips[0]. `indices`, when built, is level 0 again
+   as one byte per texel into `palette`, column-major like `columns`: a
+   quarter of the memory, and the renderer samples it instead of
+   `pixels`. `lit`, when light_build_palette() has built it, holds the
+   palette again at every light level, TEXTURE_PALETTE_SIZE entries per
+   level, for lit frames to read instead of shading each texel. `shaded`
+   does the same for a texture without a palette: light_build_texels()
+   stores level 0 at every light level, column-major, width * height
+   texels per level.
+   `borrowed` marks storage the texture does not own, such as texels
+   inside a texture pack mapping, which texture_release() leaves alone.
+   When `used` is set the renderer stores 1 there whenever a frame samples
+   the texture (see texcache.h). */
+typedef struct Texture
+{
+  int width;
+  int height;
+  uint32_t *pixels;
+  uint32_t *columns;
+  int mip_count;
+  uint32_t *mips[TEXTURE_MAX_MIPS];
+  uint8_t *indices;
+  uint32_t *palette;
+  uint32_t *lit;
+  uint32_t *shaded;
+  unsigned borrowed;
+  uint8_t *used;
+} Texture;
+
+bool texture_build_columns(Texture *tex);
+bool texture_build_mips(Texture *tex);
+/* Number of mip levels below a width x height texture and their total
+   texel count. */
+int texture_mip_layout(int width, int height, size_t *texels);
+/* Points mips[] at `count` levels stored back to back from `texels`. */
+void texture_point_mips(Texture *tex, uint32_t *texels, int count);
+/* Quantizes level 0 to `indices` and `palette`: exactly when it has at
+   most TEXTURE_PALETTE_SIZE colours, by median cut otherwise. Returns the
+   number of texels whose colour changed, or -1 out of memory. */
+long texture_build_palette(Texture *tex);
+void texture_release(Texture *tex);
+
+#endif
@@ -1,61 +1,109 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
-#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "agents.h"
+#include "interlace.h"
+#include "present.h"
+#include "profile.h"
+#include "render.h"
+#include "sprite.h"
+#include "texcache.h"
+#include "texpack.h"
+
 #define SCREEN_WIDTH 800
 #define SCREEN_HEIGHT 600
 
-#define MAP_WIDTH 10
-#define MAP_HEIGHT 10
+#define NUM_TEXTURES 4
+#define TEXTURE_BUDGET_MB 64
+#define SPRITE_SIZE 64
 
-#define NUM_TEXTURES 3
+/* Cells of this tile in a --map map are doors, sliding this fraction of
+   their travel per second. */
+#define DOOR_TILE 4
+#define DOOR_SPEED 1.5
 
-typedef struct Texture
-{
-  int width;
-  int height;
-  Uint32 *pixels;
-} Texture;
-
-static const int g_map[MAP_HEIGHT][MAP_WIDTH] = {
-    {1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
-    {1, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-    {1, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-    {1, 0, 0, 2, 2, 2, 0, 0, 0, 1},
-    {1, 0, 0, 2, 0, 2, 0, 0, 0, 1},
-    {1, 0, 0, 2, 2, 2, 0, 0, 0, 1},
-    {1, 0, 0, 0, 0, 0, 0, 3, 0, 1},
-    {1, 0, 0, 0, 0, 0, 0, 3, 0, 1},
-    {1, 0, 0, 0, 0, 0, 0, 3, 0, 1},
-    {1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
-};
+/* Ambient level of cells no --lights light reaches, and the levels a
+   y-side wall loses under lighting. */
+#define LIGHT_AMBIENT 4
+#define LIGHT_SIDE_DROP 4
 
-static bool is_walkable(double x, double y)
+/* Sprites scattered with --sprites, drawn over the wall depth that
+   options->depth collects. */
+typedef struct SpriteScene
+{
+  Sprite *sprites;
+  int count;
+  SpriteGrid grid;
+  Texture texture;
+} SpriteScene;
+
+/* `settled` is cleared while streamed textures or an interlaced frame
+   filled from neighbours would still change the picture; the draw may run
+   on the presenter's render thread. */
+typedef struct DrawArgs
 {
-  int mx = (int)x;
-  int my = (int)y;
-  if (mx < 0 || mx >= MAP_WIDTH || my < 0 || my >= MAP_HEIGHT)
+  TextureCache *cache;
+  const RenderOptions *options;
+  WorkerPool *pool;
+  SpriteScene *scene;
+  RenderHistory *history;
+  Interlace *interlace;
+  SDL_atomic_t settled;
+} DrawArgs;
+
+static void draw(const Framebuffer *fb, const Camera *cam, void *arg)
+{
+  DrawArgs *args = arg;
+  const Texture *textures = texture_cache_frame(args->cache);
+  int filled = 0;
+  if (args->interlace)
+    filled = interlace_frame(args->interlace, render_map(), fb, cam,
+                             textures, NUM_TEXTURES, args->options,
+                             args->pool);
+  else if (args->history)
+    render_frame_history(render_map(), fb, cam, textures, NUM_TEXTURES,
+                         args->options, args->pool, args->history);
+  else
+    render_frame_textured(fb, cam, textures, NUM_TEXTURES, args->options,
+                          args->pool);
+  SpriteScene *scene = args->scene;
+  if (scene->count > 0)
   {
-    return false;
+    render_sprites(fb, cam, scene->sprites, &scene->grid, &scene->texture, 1,
+                   args->options->depth, args->pool, NULL);
   }
-  return g_map[my][mx] == 0;
+  SDL_AtomicSet(&args->settled,
+                filled == 0 && texture_cache_settled(args->cache));
 }
 
-static void fill_background(Uint32 *pixels, Uint32 sky, Uint32 floor)
+static bool make_scene(SpriteScene *scene, int count)
 {
-  for (int y = 0; y < SCREEN_HEIGHT; ++y)
+  memset(scene, 0, sizeof(*scene));
+  if (count <= 0)
+    return true;
+  const Map *map = render_map();
+  scene->sprites = malloc(sizeof(Sprite) * (size_t)count);
+  if (!scene->sprites)
   {
-    Uint32 color = (y < SCREEN_HEIGHT / 2) ? sky : floor;
-    int row_start = y * SCREEN_WIDTH;
-    for (int x = 0; x < SCREEN_WIDTH; ++x)
-    {
-      pixels[row_start + x] = color;
-    }
+    fprintf(stderr, "Out of memory for %d sprites\n", count);
+    return false;
   }
+  scene->count = count;
+  sprite_scatter(scene->sprites, count, map, 1, 1);
+  return sprite_grid_build(&scene->grid, scene->sprites, count, map->width,
+                           map->height) &&
+         sprite_make_orb(&scene->texture, SPRITE_SIZE, 0xFFE08020u);
+}
+
+static void release_scene(SpriteScene *scene)
+{
+  sprite_grid_release(&scene->grid);
+  texture_release(&scene->texture);
+  free(scene->sprites);
 }
 
 static bool load_texture(const char *path, Texture *out)
@@ -93,232 +141,211 @@ static bool load_texture(const char *path, Texture *out)
   return true;
 }
 
-static void unload_texture(Texture *tex)
-{
-  free(tex->pixels);
-  tex->pixels = NULL;
-  tex->width = 0;
-  tex->height = 0;
-}
+/* Wall, floor, ceiling and door, as PNG files and as texture pack
+   names. */
+static const char *const g_texture_files[NUM_TEXTURES] = {
+    "assets/sides/brick.png",
+    "assets/sides/wood.png",
+    "assets/sides/eagle.png",
+    "assets/sides/irondoor.png",
+};
+static const char *const g_texture_names[NUM_TEXTURES] = {
+    "brick", "wood", "eagle", "irondoor"};
 
-static void render_frame(Uint32 *pixels, double posX, double posY, double dirX,
-                         double dirY, double planeX, double planeY,
-                         const Texture *textures, int texture_count)
+/* Where the streaming thread finds textures: the pack when one is open,
+   the PNG files otherwise. */
+typedef struct TextureSource
 {
-  fill_background(pixels, 0xFF1C1F2B, 0xFF252D2A);
-
-  const Texture *floorTex = (texture_count > 1) ? &textures[1] : NULL;
-  const Texture *ceilTex = (texture_count > 2) ? &textures[2] : floorTex;
+  TexturePack pack;
+  const char *pack_path;
+} TextureSource;
 
-  for (int x = 0; x < SCREEN_WIDTH; ++x)
+static bool load_streamed(void *arg, int id, Texture *out)
+{
+  const TextureSource *source = arg;
+  if (!source->pack.mapping)
+  {
+    if (load_texture(g_texture_files[id], out))
+      return true;
+    fprintf(stderr, "Failed to load texture %s\n", g_texture_files[id]);
+    return false;
+  }
+  int index = texpack_find(&source->pack, g_texture_names[id]);
+  if (index < 0)
   {
-    double cameraX = 2.0 * x / (double)SCREEN_WIDTH - 1.0;
-    double rayDirX = dirX + planeX * cameraX;
-    double rayDirY = dirY + planeY * cameraX;
+    fprintf(stderr, "%s has no texture named %s\n", source->pack_path,
+            g_texture_names[id]);
+    return false;
+  }
+  /* Points into the mapping; layouts the cache adds are its own. */
+  *out = source->pack.textures[index];
+  return true;
+}
 
-    int mapX = (int)posX;
-    int mapY = (int)posY;
+static bool open_pack(TextureSource *source, const char *path)
+{
+  Uint64 start = SDL_GetPerformanceCounter();
+  source->pack_path = path;
+  if (!texpack_load(&source->pack, path))
+    return false;
+  printf("%s: %d textures opened in %.3f ms\n", path, source->pack.count,
+         (SDL_GetPerformanceCounter() - start) * 1000.0 /
+             SDL_GetPerformanceFrequency());
+  return true;
+}
 
-    double deltaDistX = (rayDirX == 0) ? 1e30 : fabs(1.0 / rayDirX);
-    double deltaDistY = (rayDirY == 0) ? 1e30 : fabs(1.0 / rayDirY);
-    double sideDistX;
-    double sideDistY;
+/* The cache first: its textures may point into the pack. */
+static void release_textures(TextureCache *cache, TexturePack *pack)
+{
+  texture_cache_destroy(cache);
+  texpack_release(pack);
+}
 
-    int stepX;
-    int stepY;
-    if (rayDirX < 0)
-    {
-      stepX = -1;
-      sideDistX = (posX - mapX) * deltaDistX;
-    }
-    else
-    {
-      stepX = 1;
-      sideDistX = (mapX + 1.0 - posX) * deltaDistX;
-    }
-    if (rayDirY < 0)
-    {
-      stepY = -1;
-      sideDistY = (posY - mapY) * deltaDistY;
-    }
-    else
-    {
-      stepY = 1;
-      sideDistY = (mapY + 1.0 - posY) * deltaDistY;
-    }
+/* Opens the door just ahead of `cam`, or closes it unless the player is
+   standing in it. */
+static void use_door(Map *map, const Camera *cam)
+{
+  int x = (int)(cam->posX + cam->dirX);
+  int y = (int)(cam->posY + cam->dirY);
+  const MapDoor *door = map_door(map, x, y);
+  if (!door)
+    return;
+  if (door->target < 0.5)
+    map_move_door(map, x, y, 1.0);
+  else if ((int)cam->posX != x || (int)cam->posY != y)
+    map_move_door(map, x, y, 0.0);
+}
 
-    int side = 0;
-    int hit = 0;
-    while (!hit)
+int main(int argc, char *argv[])
+{
+  bool column_major = false;
+  bool pipelined = false;
+  bool reproject = false;
+  bool interlace = false;
+  bool indexed = false;
+  const char *map_path = NULL;
+  const char *trace_path = NULL;
+  const char *pack_path = NULL;
+  size_t texture_budget = (size_t)TEXTURE_BUDGET_MB << 20;
+  double budget_ms = 0.0;
+  int sprite_count = 0;
+  int light_count = 0;
+  double fog_distance = 0.0;
+  int width = SCREEN_WIDTH;
+  int height = SCREEN_HEIGHT;
+  RenderOptions options = {FLOOR_COLUMNS, false, NULL, 1, 0};
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "--column-major") == 0)
+      column_major = true;
+    else if (strcmp(argv[i], "--pipelined") == 0)
+      pipelined = true;
+    else if (strcmp(argv[i], "--reproject") == 0)
+      reproject = true;
+    else if (strcmp(argv[i], "--interlace") == 0)
+      interlace = true;
+    else if (strcmp(argv[i], "--indexed") == 0)
+      indexed = true;
+    else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc)
+      map_path = argv[++i];
+    else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+      trace_path = argv[++i];
+    else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc)
+      pack_path = argv[++i];
+    else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+      texture_budget = (size_t)(atof(argv[++i]) * (1 << 20));
+    else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+      budget_ms = atof(argv[++i]);
+    else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
     {
-      if (sideDistX < sideDistY)
-      {
-        sideDistX += deltaDistX;
-        mapX += stepX;
-        side = 0;
-      }
-      else
-      {
-        sideDistY += deltaDistY;
-        mapY += stepY;
-        side = 1;
-      }
-      if (mapX < 0 || mapX >= MAP_WIDTH || mapY < 0 || mapY >= MAP_HEIGHT)
-      {
-        hit = 1;
-      }
-      else if (g_map[mapY][mapX] > 0)
+      if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 ||
+          height <= 0)
       {
-        hit = 1;
+        fprintf(stderr, "Bad --size %s, expected WIDTHxHEIGHT\n", argv[i]);
+        return 1;
       }
     }
+    else if (strcmp(argv[i], "--scanline-floor") == 0)
+      options.floor = FLOOR_SCANLINE;
+    else if (strcmp(argv[i], "--mipmaps") == 0)
+      options.mipmaps = true;
+    else if (strcmp(argv[i], "--sprites") == 0 && i + 1 < argc)
+      sprite_count = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+      light_count = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--fog") == 0 && i + 1 < argc)
+      fog_distance = atof(argv[++i]);
+  }
 
-    double perpWallDist;
-    if (side == 0)
-    {
-      perpWallDist = (mapX - posX + (1 - stepX) / 2.0) / rayDirX;
-    }
-    else
-    {
-      perpWallDist = (mapY - posY + (1 - stepY) / 2.0) / rayDirY;
-    }
-
-    int lineHeight = (int)(SCREEN_HEIGHT / fmax(perpWallDist, 1e-6));
-    int drawStart = -lineHeight / 2 + SCREEN_HEIGHT / 2;
-    if (drawStart < 0)
-    {
-      drawStart = 0;
-    }
-    int drawEnd = lineHeight / 2 + SCREEN_HEIGHT / 2;
-    if (drawEnd >= SCREEN_HEIGHT)
-    {
-      drawEnd = SCREEN_HEIGHT - 1;
-    }
-
-    int tile = (mapY >= 0 && mapY < MAP_HEIGHT && mapX >= 0 && mapX < MAP_WIDTH)
-                   ? g_map[mapY][mapX]
-                   : 0;
-    const Texture *tex =
-        (tile > 0 && tile <= texture_count) ? &textures[tile - 1] : NULL;
-
-    Uint32 fallback = 0xFFFFFFFF;
-    double wallX;
-    if (side == 0)
-    {
-      wallX = posY + perpWallDist * rayDirY;
-    }
-    else
-    {
-      wallX = posX + perpWallDist * rayDirX;
-    }
-    wallX -= floor(wallX);
-
-    int texX = tex ? (int)(wallX * tex->width) : 0;
-    if (tex)
-    {
-      if (side == 0 && rayDirX > 0)
-        texX = tex->width - texX - 1;
-      if (side == 1 && rayDirY < 0)
-        texX = tex->width - texX - 1;
-    }
-
-    double step = tex ? ((double)tex->height / lineHeight) : 0.0;
-    double texPos = (drawStart - SCREEN_HEIGHT / 2.0 + lineHeight / 2.0) * step;
-
-    for (int y = drawStart; y <= drawEnd; ++y)
+  Map map;
+  int door_count = 0;
+  if (map_path)
+  {
+    if (!map_load(&map, map_path))
+      return 1;
+    door_count = map_add_doors(&map, DOOR_TILE);
+    if (door_count < 0)
     {
-      Uint32 color = fallback;
-      if (tex)
-      {
-        int texY = (int)texPos;
-        if (texY < 0)
-          texY = 0;
-        if (texY >= tex->height)
-          texY = tex->height - 1;
-        texPos += step;
-        color = tex->pixels[texY * tex->width + texX];
-      }
-      if (side == 1)
-      {
-        color = ((color & 0xFEFEFE) >> 1) | 0xFF000000;
-      }
-      pixels[y * SCREEN_WIDTH + x] = color;
+      map_release(&map);
+      return 1;
     }
+    render_set_map(&map);
+  }
 
-    /* Floor & ceiling casting using the hit position for perspective correct
-       interpolation. */
-    double floorXWall;
-    double floorYWall;
-    if (side == 0 && rayDirX > 0)
-    {
-      floorXWall = mapX;
-      floorYWall = mapY + wallX;
-    }
-    else if (side == 0 && rayDirX < 0)
-    {
-      floorXWall = mapX + 1.0;
-      floorYWall = mapY + wallX;
-    }
-    else if (side == 1 && rayDirY > 0)
+  /* --lights bakes that many lights scattered over the drawn map, which
+     without --map is a copy of the built-in one, and --fog takes a level
+     off every that many cells of depth. */
+  const bool own_light = !map_path && light_count > 0;
+  if (own_light)
+  {
+    map = *render_map();
+    map.light = NULL;
+    render_set_map(&map);
+  }
+  if (light_count > 0)
+  {
+    MapLight *lights = malloc(sizeof(MapLight) * (size_t)light_count);
+    bool baked = false;
+    if (lights)
     {
-      floorXWall = mapX + wallX;
-      floorYWall = mapY;
+      light_scatter(lights, light_count, &map, 1);
+      baked = map_bake_light(&map, LIGHT_AMBIENT, lights, light_count);
+      free(lights);
     }
     else
     {
-      floorXWall = mapX + wallX;
-      floorYWall = mapY + 1.0;
+      fprintf(stderr, "Out of memory for %d lights\n", light_count);
     }
-
-    double distWall = perpWallDist;
-    double distPlayer = 0.0;
-    int floorStart = drawEnd + 1;
-    if (floorStart < 0)
-      floorStart = 0;
-
-    for (int y = floorStart; y < SCREEN_HEIGHT; ++y)
+    if (!baked)
     {
-      double denom = 2.0 * y - SCREEN_HEIGHT;
-      double currentDist = SCREEN_HEIGHT / fmax(denom, 1e-6);
-      double weight = (currentDist - distPlayer) / (distWall - distPlayer);
-      double currentFloorX = weight * floorXWall + (1.0 - weight) * posX;
-      double currentFloorY = weight * floorYWall + (1.0 - weight) * posY;
-
-      Uint32 floorColor = 0xFF444444;
-      Uint32 ceilColor = 0xFF222222;
-      if (floorTex)
-      {
-        int texX = (int)(currentFloorX * floorTex->width) % floorTex->width;
-        int texY = (int)(currentFloorY * floorTex->height) % floorTex->height;
-        if (texX < 0)
-          texX += floorTex->width;
-        if (texY < 0)
-          texY += floorTex->height;
-        floorColor = floorTex->pixels[texY * floorTex->width + texX];
-      }
-      if (ceilTex)
-      {
-        int texX = (int)(currentFloorX * ceilTex->width) % ceilTex->width;
-        int texY = (int)(currentFloorY * ceilTex->height) % ceilTex->height;
-        if (texX < 0)
-          texX += ceilTex->width;
-        if (texY < 0)
-          texY += ceilTex->height;
-        ceilColor = ceilTex->pixels[texY * ceilTex->width + texX];
-      }
-
-      pixels[y * SCREEN_WIDTH + x] = floorColor;
-      int ceilY = SCREEN_HEIGHT - y - 1;
-      if (ceilY >= 0)
-        pixels[ceilY * SCREEN_WIDTH + x] = ceilColor;
+      render_set_map(NULL);
+      if (map_path)
+        map_release(&map);
+      return 1;
     }
   }
-}
+  Lighting lighting;
+  lighting_init(&lighting, fog_distance, LIGHT_SIDE_DROP);
+  if (light_count > 0 || fog_distance > 0.0)
+    render_set_lighting(&lighting);
+
+  /* The governor only shrinks the frame, so the window width bounds the
+     depth buffer. */
+  SpriteScene scene;
+  if (sprite_count > 0)
+    options.depth = malloc(sizeof(double) * (size_t)width);
+  if (!make_scene(&scene, sprite_count) ||
+      (sprite_count > 0 && !options.depth))
+  {
+    release_scene(&scene);
+    free(options.depth);
+    if (map_path)
+      map_release(&map);
+    else if (own_light)
+      free(map.light);
+    return 1;
+  }
 
-int main(int argc, char *argv[])
-{
-  (void)argc;
-  (void)argv;
   if (SDL_Init(SDL_INIT_VIDEO) != 0)
   {
     fprintf(stderr, "SDL_Init Error: %s\n", SDL_GetError());
@@ -333,35 +360,38 @@ int main(int argc, char *argv[])
     return 1;
   }
 
-  Texture textures[NUM_TEXTURES] = {0};
-  const char *texture_files[NUM_TEXTURES] = {
-      "assets/sides/brick.png",
-      "assets/sides/wood.png",
-      "assets/sides/eagle.png",
-  };
-  for (int i = 0; i < NUM_TEXTURES; ++i)
+  /* Textures stream in on a background thread while the first frames
+     draw stand-ins; a column-major target has walls sample the
+     column-major copies, and --indexed has them all sample palettes.
+     Under lighting they also get level 0 at every light level. */
+  TextureSource source = {0};
+  unsigned layouts = (options.mipmaps ? TEXTURE_CACHE_MIPS : 0) |
+                     (column_major ? TEXTURE_CACHE_COLUMNS : 0) |
+                     (indexed ? TEXTURE_CACHE_INDEXED : 0) |
+                     (render_lighting() ? TEXTURE_CACHE_LIT : 0);
+  TextureCache *cache = NULL;
+  if (!pack_path || open_pack(&source, pack_path))
   {
-    if (!load_texture(texture_files[i], &textures[i]))
-    {
-      fprintf(stderr, "Failed to load texture %s\n", texture_files[i]);
-      for (int j = 0; j <= i; ++j)
-      {
-        unload_texture(&textures[j]);
-      }
-      IMG_Quit();
-      SDL_Quit();
-      return 1;
-    }
+    cache = texture_cache_create(NUM_TEXTURES, texture_budget, layouts,
+                                 load_streamed, &source);
+  }
+  if (!cache)
+  {
+    texpack_release(&source.pack);
+    IMG_Quit();
+    SDL_Quit();
+    return 1;
   }
+  for (int i = 0; i < NUM_TEXTURES; ++i)
+    texture_cache_request(cache, i);
 
   SDL_Window *window = SDL_CreateWindow(
       "Raycaster (Textured)", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-      SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN | SDL_WINDOW_ALWAYS_ON_TOP);
+      width, height, SDL_WINDOW_SHOWN | SDL_WINDOW_ALWAYS_ON_TOP);
   if (!window)
   {
     fprintf(stderr, "SDL_CreateWindow Error: %s\n", SDL_GetError());
-    for (int i = 0; i < NUM_TEXTURES; ++i)
-      unload_texture(&textures[i]);
+    release_textures(cache, &source.pack);
     IMG_Quit();
     SDL_Quit();
     return 1;
@@ -373,42 +403,45 @@ int main(int argc, char *argv[])
   {
     fprintf(stderr, "SDL_CreateRenderer Error: %s\n", SDL_GetError());
     SDL_DestroyWindow(window);
-    for (int i = 0; i < NUM_TEXTURES; ++i)
-      unload_texture(&textures[i]);
+    release_textures(cache, &source.pack);
     IMG_Quit();
     SDL_Quit();
     return 1;
   }
 
-  SDL_Texture *framebuffer =
-      SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
-                        SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH,
-                        SCREEN_HEIGHT);
-  if (!framebuffer)
+  WorkerPool *pool = worker_pool_create(SDL_GetCPUCount());
+  DrawArgs draw_args = {cache, &options, pool, &scene, NULL, NULL, {0}};
+  if (reproject)
+    draw_args.history = render_history_create();
+  if (interlace)
+    draw_args.interlace = interlace_create();
+  Presenter *presenter = NULL;
+  if ((!reproject || draw_args.history) &&
+      (!interlace || draw_args.interlace))
+    presenter = presenter_create(renderer, width, height, column_major,
+                                 pipelined, pool, draw, &draw_args);
+  if (!presenter)
   {
-    fprintf(stderr, "SDL_CreateTexture Error: %s\n", SDL_GetError());
+    render_history_destroy(draw_args.history);
+    interlace_destroy(draw_args.interlace);
+    worker_pool_destroy(pool);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
-    for (int i = 0; i < NUM_TEXTURES; ++i)
-      unload_texture(&textures[i]);
+    release_textures(cache, &source.pack);
     IMG_Quit();
     SDL_Quit();
     return 1;
   }
+  presenter_set_budget(presenter, budget_ms);
 
-  Uint32 pixels[SCREEN_WIDTH * SCREEN_HEIGHT];
-
-  double posX = 2.5;
-  double posY = 2.5;
-  double dirX = 1.0;
-  double dirY = 0.0;
-  double planeX = 0.0;
-  double planeY = 0.66;
+  Camera cam = {render_map()->spawn_x + 0.5, render_map()->spawn_y + 0.5,
+                1.0, 0.0, 0.0, 0.66};
 
   Uint32 last_ticks = SDL_GetTicks();
   bool running = true;
   while (running)
   {
+    bool use = false;
     SDL_Event event;
     while (SDL_PollEvent(&event))
     {
@@ -421,6 +454,16 @@ int main(int argc, char *argv[])
       {
         running = false;
       }
+      else if (event.type == SDL_KEYDOWN &&
+               event.key.keysym.sym == SDLK_SPACE)
+      {
+        use = door_count > 0;
+      }
+      else if (event.type == SDL_WINDOWEVENT &&
+               event.window.event == SDL_WINDOWEVENT_EXPOSED)
+      {
+        presenter_invalidate(presenter);
+      }
     }
 
     Uint32 now = SDL_GetTicks();
@@ -431,59 +474,50 @@ int main(int argc, char *argv[])
     double moveSpeed = 2.5 * frameTime;
     double rotSpeed = 1.5 * frameTime;
 
-    if (state[SDL_SCANCODE_UP])
-    {
-      double newX = posX + dirX * moveSpeed;
-      double newY = posY + dirY * moveSpeed;
-      if (is_walkable(newX, posY))
-        posX = newX;
-      if (is_walkable(posX, newY))
-        posY = newY;
-    }
-    if (state[SDL_SCANCODE_DOWN])
-    {
-      double newX = posX - dirX * moveSpeed;
-      double newY = posY - dirY * moveSpeed;
-      if (is_walkable(newX, posY))
-        posX = newX;
-      if (is_walkable(posX, newY))
-        posY = newY;
-    }
-    if (state[SDL_SCANCODE_RIGHT])
+    unsigned actions = (state[SDL_SCANCODE_UP] ? AGENT_FORWARD : 0) |
+                       (state[SDL_SCANCODE_DOWN] ? AGENT_BACK : 0) |
+                       (state[SDL_SCANCODE_RIGHT] ? AGENT_RIGHT : 0) |
+                       (state[SDL_SCANCODE_LEFT] ? AGENT_LEFT : 0);
+    agent_step(&cam, actions, moveSpeed, rotSpeed, render_map());
+    /* The map must not change under a frame still being drawn. */
+    if (use || (door_count > 0 && map.moving_count > 0))
     {
-      double oldDirX = dirX;
-      dirX = dirX * cos(rotSpeed) - dirY * sin(rotSpeed);
-      dirY = oldDirX * sin(rotSpeed) + dirY * cos(rotSpeed);
-      double oldPlaneX = planeX;
-      planeX = planeX * cos(rotSpeed) - planeY * sin(rotSpeed);
-      planeY = oldPlaneX * sin(rotSpeed) + planeY * cos(rotSpeed);
+      presenter_sync(presenter);
+      if (use)
+        use_door(&map, &cam);
+      map_update_doors(&map, DOOR_SPEED * frameTime);
+      presenter_invalidate(presenter);
     }
-    if (state[SDL_SCANCODE_LEFT])
+    if (!SDL_AtomicGet(&draw_args.settled))
+      presenter_invalidate(presenter);
+    if (!presenter_frame(presenter, &cam))
     {
-      double oldDirX = dirX;
-      dirX = dirX * cos(-rotSpeed) - dirY * sin(-rotSpeed);
-      dirY = oldDirX * sin(-rotSpeed) + dirY * cos(-rotSpeed);
-      double oldPlaneX = planeX;
-      planeX = planeX * cos(-rotSpeed) - planeY * sin(-rotSpeed);
-      planeY = oldPlaneX * sin(-rotSpeed) + planeY * cos(-rotSpeed);
+      /* Nothing moved and nothing is streaming in: sleep until there is
+         input. */
+      SDL_WaitEvent(NULL);
+      last_ticks = SDL_GetTicks();
     }
-
-    render_frame(pixels, posX, posY, dirX, dirY, planeX, planeY, textures,
-                 NUM_TEXTURES);
-
-    SDL_UpdateTexture(framebuffer, NULL, pixels,
-                      SCREEN_WIDTH * (int)sizeof(Uint32));
-    SDL_RenderClear(renderer);
-    SDL_RenderCopy(renderer, framebuffer, NULL, NULL);
-    SDL_RenderPresent(renderer);
   }
 
-  SDL_DestroyTexture(framebuffer);
+  presenter_destroy(presenter);
+  render_history_destroy(draw_args.history);
+  interlace_destroy(draw_args.interlace);
+  worker_pool_destroy(pool);
+  if (trace_path)
+    profile_write_trace(trace_path);
   SDL_DestroyRenderer(renderer);
   SDL_DestroyWindow(window);
-  for (int i = 0; i < NUM_TEXTURES; ++i)
-    unload_texture(&textures[i]);
+  release_textures(cache, &source.pack);
   IMG_Quit();
   SDL_Quit();
+  release_scene(&scene);
+  free(options.depth);
+  render_set_lighting(NULL);
+  if (map_path || own_light)
+    render_set_map(NULL);
+  if (map_path)
+    map_release(&map);
+  else if (own_light)
+    free(map.light);
   return 0;
 }
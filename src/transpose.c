@@ -0,0 +1,88 @@
+#include "transpose.h"
+
+#include <stddef.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* 32x32 pixels is 4 KB per side, so source and destination tiles both
+   stay in L1 while the block is shuffled. */
+#define TRANSPOSE_TILE 32
+
+static void transpose_scalar(uint32_t *dst, size_t dst_pitch,
+                             const uint32_t *src, size_t src_pitch, int width,
+                             int height)
+{
+  for (int y = 0; y < height; ++y)
+  {
+    for (int x = 0; x < width; ++x)
+    {
+      dst[x * dst_pitch + y] = src[y * src_pitch + x];
+    }
+  }
+}
+
+#if defined(__SSE2__)
+static void transpose_4x4(uint32_t *dst, size_t dst_pitch,
+                          const uint32_t *src, size_t src_pitch)
+{
+  __m128i r0 = _mm_loadu_si128((const __m128i *)(src + 0 * src_pitch));
+  __m128i r1 = _mm_loadu_si128((const __m128i *)(src + 1 * src_pitch));
+  __m128i r2 = _mm_loadu_si128((const __m128i *)(src + 2 * src_pitch));
+  __m128i r3 = _mm_loadu_si128((const __m128i *)(src + 3 * src_pitch));
+  __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+  __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+  __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+  __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+  _mm_storeu_si128((__m128i *)(dst + 0 * dst_pitch),
+                   _mm_unpacklo_epi64(t0, t1));
+  _mm_storeu_si128((__m128i *)(dst + 1 * dst_pitch),
+                   _mm_unpackhi_epi64(t0, t1));
+  _mm_storeu_si128((__m128i *)(dst + 2 * dst_pitch),
+                   _mm_unpacklo_epi64(t2, t3));
+  _mm_storeu_si128((__m128i *)(dst + 3 * dst_pitch),
+                   _mm_unpackhi_epi64(t2, t3));
+}
+#endif
+
+static void transpose_tile(uint32_t *dst, size_t dst_pitch,
+                           const uint32_t *src, size_t src_pitch, int width,
+                           int height)
+{
+#if defined(__SSE2__)
+  int w4 = width & ~3;
+  int h4 = height & ~3;
+  for (int y = 0; y < h4; y += 4)
+  {
+    for (int x = 0; x < w4; x += 4)
+    {
+      transpose_4x4(dst + x * dst_pitch + y, dst_pitch,
+                    src + y * src_pitch + x, src_pitch);
+    }
+  }
+  /* Ragged right and bottom edges. */
+  transpose_scalar(dst + w4 * dst_pitch, dst_pitch, src + w4, src_pitch,
+                   width - w4, h4);
+  transpose_scalar(dst + h4, dst_pitch, src + h4 * src_pitch, src_pitch,
+                   width, height - h4);
+#else
+  transpose_scalar(dst, dst_pitch, src, src_pitch, width, height);
+#endif
+}
+
+void transpose_pixels(uint32_t *dst, int dst_pitch, const uint32_t *src,
+                      int src_pitch, int width, int height)
+{
+  const size_t dp = (size_t)dst_pitch;
+  const size_t sp = (size_t)src_pitch;
+  for (int y = 0; y < height; y += TRANSPOSE_TILE)
+  {
+    int th = height - y < TRANSPOSE_TILE ? height - y : TRANSPOSE_TILE;
+    for (int x = 0; x < width; x += TRANSPOSE_TILE)
+    {
+      int tw = width - x < TRANSPOSE_TILE ? width - x : TRANSPOSE_TILE;
+      transpose_tile(dst + x * dp + y, dp, src + y * sp + x, sp, tw, th);
+    }
+  }
+}
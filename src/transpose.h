@@ -0,0 +1,12 @@
+#ifndef RAYCAST_TRANSPOSE_H
+#define RAYCAST_TRANSPOSE_H
+
+#include <stdint.h>
+
+/* dst[x * dst_pitch + y] = src[y * src_pitch + x] for a width x height
+   block of 32-bit pixels; pitches are in pixels. Works in cache-sized
+   tiles of 4x4 SSE2 register transposes where available. */
+void transpose_pixels(uint32_t *dst, int dst_pitch, const uint32_t *src,
+                      int src_pitch, int width, int height);
+
+#endif
@@ -0,0 +1,177 @@
+#include "video.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Slots are filled at `head` and written at `tail`; `queued` counts the
+   submitted ones the thread has not finished. The slot at `head` belongs
+   to the caller between video_writer_frame() and the submit. */
+struct VideoWriter
+{
+  FILE *out;
+  const char *path;
+  bool raw;
+  int width;
+  int height;
+  size_t frame_bytes;
+  uint8_t *slots;
+  int count;
+
+  pthread_t thread;
+  bool started;
+  pthread_mutex_t lock;
+  pthread_cond_t queued_cond;
+  pthread_cond_t free_cond;
+  bool quit;
+  int head;
+  int tail;
+  int queued;
+  bool failed;
+};
+
+static bool write_frame(VideoWriter *w, const uint8_t *data)
+{
+  static const char header[] = "FRAME\n";
+  if (!w->raw && fwrite(header, 1, sizeof(header) - 1, w->out) !=
+                     sizeof(header) - 1)
+    return false;
+  return fwrite(data, 1, w->frame_bytes, w->out) == w->frame_bytes;
+}
+
+/* After a failed write the remaining frames are dropped, so the render
+   loop keeps going and reports the failure at the end. */
+static void *writer_thread(void *arg)
+{
+  VideoWriter *w = arg;
+  pthread_mutex_lock(&w->lock);
+  for (;;)
+  {
+    while (w->queued == 0 && !w->quit)
+      pthread_cond_wait(&w->queued_cond, &w->lock);
+    if (w->queued == 0)
+      break;
+    const uint8_t *data = w->slots + (size_t)w->tail * w->frame_bytes;
+    bool failed = w->failed;
+    pthread_mutex_unlock(&w->lock);
+
+    if (!failed && !write_frame(w, data))
+    {
+      fprintf(stderr, "Writing video to %s failed\n", w->path);
+      failed = true;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    w->failed = failed;
+    w->tail = (w->tail + 1) % w->count;
+    --w->queued;
+    pthread_cond_signal(&w->free_cond);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+VideoWriter *video_writer_open(const char *path, int width, int height,
+                               int fps, bool raw, int buffers)
+{
+  if (width <= 0 || height <= 0 || fps <= 0 || buffers < 2)
+  {
+    fprintf(stderr, "Bad video format %dx%d at %d fps with %d buffers\n",
+            width, height, fps, buffers);
+    return NULL;
+  }
+  VideoWriter *w = calloc(1, sizeof(*w));
+  if (!w)
+  {
+    fprintf(stderr, "Out of memory for the video writer\n");
+    return NULL;
+  }
+  w->path = strcmp(path, "-") == 0 ? "standard output" : path;
+  w->raw = raw;
+  w->width = width;
+  w->height = height;
+  w->frame_bytes = yuv_frame_size(width, height);
+  w->count = buffers;
+  w->slots = malloc(w->frame_bytes * (size_t)buffers);
+  w->out = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+  if (!w->slots || !w->out)
+  {
+    if (!w->slots)
+      fprintf(stderr, "Out of memory for %d frames of video\n", buffers);
+    else
+      fprintf(stderr, "Unable to open %s\n", w->path);
+    if (w->out && w->out != stdout)
+      fclose(w->out);
+    free(w->slots);
+    free(w);
+    return NULL;
+  }
+  if (!raw && fprintf(w->out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg "
+                              "XCOLORRANGE=LIMITED\n",
+                      width, height, fps) < 0)
+  {
+    fprintf(stderr, "Writing video to %s failed\n", w->path);
+    w->failed = true;
+  }
+
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->queued_cond, NULL);
+  pthread_cond_init(&w->free_cond, NULL);
+  w->started = pthread_create(&w->thread, NULL, writer_thread, w) == 0;
+  if (!w->started)
+  {
+    fprintf(stderr, "Unable to start the video writer\n");
+    video_writer_close(w);
+    return NULL;
+  }
+  return w;
+}
+
+void video_writer_frame(VideoWriter *w, YuvFrame *frame)
+{
+  pthread_mutex_lock(&w->lock);
+  while (w->queued == w->count)
+    pthread_cond_wait(&w->free_cond, &w->lock);
+  uint8_t *data = w->slots + (size_t)w->head * w->frame_bytes;
+  pthread_mutex_unlock(&w->lock);
+  yuv_frame_wrap(frame, data, w->width, w->height);
+}
+
+void video_writer_submit(VideoWriter *w)
+{
+  pthread_mutex_lock(&w->lock);
+  w->head = (w->head + 1) % w->count;
+  ++w->queued;
+  pthread_cond_signal(&w->queued_cond);
+  pthread_mutex_unlock(&w->lock);
+}
+
+bool video_writer_close(VideoWriter *w)
+{
+  if (!w)
+    return true;
+  if (w->started)
+  {
+    pthread_mutex_lock(&w->lock);
+    w->quit = true;
+    pthread_cond_signal(&w->queued_cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+  }
+  pthread_mutex_destroy(&w->lock);
+  pthread_cond_destroy(&w->queued_cond);
+  pthread_cond_destroy(&w->free_cond);
+
+  bool ok = !w->failed;
+  if (fflush(w->out) != 0)
+    ok = false;
+  if (w->out != stdout && fclose(w->out) != 0)
+    ok = false;
+  if (!ok && !w->failed)
+    fprintf(stderr, "Writing video to %s failed\n", w->path);
+  free(w->slots);
+  free(w);
+  return ok;
+}
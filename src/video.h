@@ -0,0 +1,30 @@
+#ifndef RAYCAST_VIDEO_H
+#define RAYCAST_VIDEO_H
+
+#include <stdbool.h>
+
+#include "yuv.h"
+
+/* Streams I420 frames to a file or pipe from a background thread, so the
+   render loop never waits on I/O while a slot of the ring is free. The
+   stream is YUV4MPEG2, which encoders such as ffmpeg read from a pipe,
+   or with `raw` set bare planes frame after frame. */
+typedef struct VideoWriter VideoWriter;
+
+/* Writes to `path`, or standard output for "-", through a ring of
+   `buffers` frames (at least 2) of width x height at `fps` frames a
+   second; `path` must outlive the writer. Prints why and returns NULL on
+   failure. */
+VideoWriter *video_writer_open(const char *path, int width, int height,
+                               int fps, bool raw, int buffers);
+
+/* Points `frame` at the next free slot of the ring, waiting for the
+   writer when every slot is queued. Fill it, then submit it. */
+void video_writer_frame(VideoWriter *writer, YuvFrame *frame);
+void video_writer_submit(VideoWriter *writer);
+
+/* Writes the frames still queued and closes the output; returns false,
+   having printed why, when any write failed. */
+bool video_writer_close(VideoWriter *writer);
+
+#endif
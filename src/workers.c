@@ -0,0 +1,258 @@
+#include "workers.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WORKER_MAX_THREADS 256
+
+/* Remaining items of one worker packed as head | tail << 32 so owner pops
+   and thief splits are a single CAS. Padded to keep slots on their own
+   cache lines. */
+typedef struct WorkerSlot
+{
+  uint64_t range;
+  char pad[64 - sizeof(uint64_t)];
+} WorkerSlot;
+
+typedef struct WorkerThread
+{
+  WorkerPool *pool;
+  int index;
+  pthread_t thread;
+} WorkerThread;
+
+struct WorkerPool
+{
+  int thread_count;
+  WorkerSlot *slots;
+  WorkerThread *threads;
+
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  unsigned generation;
+  int active;
+  bool quit;
+
+  WorkerFn fn;
+  void *arg;
+};
+
+static uint64_t pack_range(uint32_t head, uint32_t tail)
+{
+  return (uint64_t)head | ((uint64_t)tail << 32);
+}
+
+static bool take_item(WorkerSlot *slot, int *item)
+{
+  uint64_t range = __atomic_load_n(&slot->range, __ATOMIC_ACQUIRE);
+  for (;;)
+  {
+    uint32_t head = (uint32_t)range;
+    uint32_t tail = (uint32_t)(range >> 32);
+    if (head >= tail)
+    {
+      return false;
+    }
+    if (__atomic_compare_exchange_n(&slot->range, &range,
+                                    pack_range(head + 1, tail), false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      *item = (int)head;
+      return true;
+    }
+  }
+}
+
+/* Moves the upper half of the victim's range into the thief's (empty)
+   slot. */
+static bool steal_items(WorkerSlot *victim, WorkerSlot *own)
+{
+  uint64_t range = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+  for (;;)
+  {
+    uint32_t head = (uint32_t)range;
+    uint32_t tail = (uint32_t)(range >> 32);
+    if (head >= tail)
+    {
+      return false;
+    }
+    uint32_t split = tail - (tail - head + 1) / 2;
+    if (__atomic_compare_exchange_n(&victim->range, &range,
+                                    pack_range(head, split), false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      __atomic_store_n(&own->range, pack_range(split, tail),
+                       __ATOMIC_RELEASE);
+      return true;
+    }
+  }
+}
+
+static void drain(WorkerPool *pool, int index)
+{
+  WorkerSlot *own = &pool->slots[index];
+  for (;;)
+  {
+    int item;
+    while (take_item(own, &item))
+    {
+      pool->fn(pool->arg, item, index);
+    }
+
+    bool stolen = false;
+    for (int i = 1; i < pool->thread_count && !stolen; ++i)
+    {
+      int victim = (index + i) % pool->thread_count;
+      stolen = steal_items(&pool->slots[victim], own);
+    }
+    if (!stolen)
+    {
+      return;
+    }
+  }
+}
+
+static void *worker_main(void *arg)
+{
+  WorkerThread *self = arg;
+  WorkerPool *pool = self->pool;
+  unsigned seen = 0;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->generation == seen && !pool->quit)
+    {
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    if (pool->quit)
+    {
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    drain(pool, self->index);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->active == 0)
+    {
+      pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+WorkerPool *worker_pool_create(int thread_count)
+{
+  if (thread_count < 1)
+    thread_count = 1;
+  if (thread_count > WORKER_MAX_THREADS)
+    thread_count = WORKER_MAX_THREADS;
+
+  WorkerPool *pool = calloc(1, sizeof(*pool));
+  if (!pool)
+  {
+    fprintf(stderr, "Out of memory while creating worker pool\n");
+    return NULL;
+  }
+  pool->thread_count = thread_count;
+  pool->slots = calloc((size_t)thread_count, sizeof(WorkerSlot));
+  pool->threads = calloc((size_t)thread_count, sizeof(WorkerThread));
+  if (!pool->slots || !pool->threads)
+  {
+    fprintf(stderr, "Out of memory while creating worker pool\n");
+    free(pool->slots);
+    free(pool->threads);
+    free(pool);
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  /* Worker 0 is whichever thread calls worker_pool_run(). */
+  for (int i = 1; i < thread_count; ++i)
+  {
+    WorkerThread *t = &pool->threads[i];
+    t->pool = pool;
+    t->index = i;
+    if (pthread_create(&t->thread, NULL, worker_main, t) != 0)
+    {
+      fprintf(stderr, "pthread_create failed, using %d worker(s)\n", i);
+      pool->thread_count = i;
+      break;
+    }
+  }
+  return pool;
+}
+
+void worker_pool_destroy(WorkerPool *pool)
+{
+  if (!pool)
+    return;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = true;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 1; i < pool->thread_count; ++i)
+  {
+    pthread_join(pool->threads[i].thread, NULL);
+  }
+
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->wake);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->threads);
+  free(pool->slots);
+  free(pool);
+}
+
+int worker_pool_size(const WorkerPool *pool)
+{
+  return pool ? pool->thread_count : 1;
+}
+
+void worker_pool_run(WorkerPool *pool, int count, WorkerFn fn, void *arg)
+{
+  if (count <= 0)
+    return;
+  if (!pool || pool->thread_count == 1)
+  {
+    for (int i = 0; i < count; ++i)
+      fn(arg, i, 0);
+    return;
+  }
+
+  const int n = pool->thread_count;
+  for (int i = 0; i < n; ++i)
+  {
+    uint32_t head = (uint32_t)((int64_t)count * i / n);
+    uint32_t tail = (uint32_t)((int64_t)count * (i + 1) / n);
+    __atomic_store_n(&pool->slots[i].range, pack_range(head, tail),
+                     __ATOMIC_RELAXED);
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->fn = fn;
+  pool->arg = arg;
+  pool->active = n - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  drain(pool, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->active > 0)
+  {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,18 @@
+#ifndef RAYCAST_WORKERS_H
+#define RAYCAST_WORKERS_H
+
+/* Persistent thread pool. worker_pool_run() splits [0, count) into items,
+   hands each worker an even share and lets idle workers steal half of a
+   busy worker's remaining range, so uneven items still balance out. The
+   calling thread takes part as worker 0 and the call returns once every
+   item has run. */
+typedef struct WorkerPool WorkerPool;
+
+typedef void (*WorkerFn)(void *arg, int item, int worker);
+
+WorkerPool *worker_pool_create(int thread_count);
+void worker_pool_destroy(WorkerPool *pool);
+int worker_pool_size(const WorkerPool *pool);
+void worker_pool_run(WorkerPool *pool, int count, WorkerFn fn, void *arg);
+
+#endif
@@ -0,0 +1,224 @@
+#include "yuv.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Row pairs converted by one work item. */
+#define YUV_BAND_PAIRS 8
+
+size_t yuv_frame_size(int width, int height)
+{
+  size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+  return (size_t)width * height + 2 * chroma;
+}
+
+void yuv_frame_wrap(YuvFrame *frame, uint8_t *data, int width, int height)
+{
+  size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+  frame->y = data;
+  frame->u = data + (size_t)width * height;
+  frame->v = frame->u + chroma;
+  frame->width = width;
+  frame->height = height;
+}
+
+/* The chroma sums are offset by 128 << 8 so they never go negative and
+   the shift needs no sign: (x + 32896) >> 8 is (x + 128) / 256 + 128,
+   rounded down. Every intermediate fits 16 unsigned bits. */
+static uint8_t luma(int r, int g, int b)
+{
+  return (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static uint8_t chroma_u(int r, int g, int b)
+{
+  return (uint8_t)((-38 * r - 74 * g + 112 * b + 32896) >> 8);
+}
+
+static uint8_t chroma_v(int r, int g, int b)
+{
+  return (uint8_t)((112 * r - 94 * g - 18 * b + 32896) >> 8);
+}
+
+/* Luma of the rows of chroma row `cy` and its chroma samples, for columns
+   x0 (even) onward. */
+static void convert_pair_scalar(const YuvFrame *dst, const Framebuffer *src,
+                                int cy, int x0)
+{
+  const int width = src->width;
+  const int y0 = 2 * cy;
+  const int y1 = y0 + 1 < src->height ? y0 + 1 : y0;
+  const uint32_t *rows[2] = {src->pixels + (size_t)y0 * src->pitch,
+                             src->pixels + (size_t)y1 * src->pitch};
+  for (int i = 0; i < 2 && (i == 0 || y1 != y0); ++i)
+  {
+    uint8_t *out = dst->y + (size_t)(y0 + i) * width;
+    for (int x = x0; x < width; ++x)
+    {
+      uint32_t p = rows[i][x];
+      out[x] = luma((p >> 16) & 0xFF, (p >> 8) & 0xFF, p & 0xFF);
+    }
+  }
+
+  const int chromaWidth = (width + 1) / 2;
+  uint8_t *u = dst->u + (size_t)cy * chromaWidth;
+  uint8_t *v = dst->v + (size_t)cy * chromaWidth;
+  for (int cx = x0 / 2; cx < chromaWidth; ++cx)
+  {
+    const int xa = 2 * cx;
+    const int xb = xa + 1 < width ? xa + 1 : xa;
+    const uint32_t block[4] = {rows[0][xa], rows[0][xb], rows[1][xa],
+                               rows[1][xb]};
+    int r = 2;
+    int g = 2;
+    int b = 2;
+    for (int k = 0; k < 4; ++k)
+    {
+      r += (block[k] >> 16) & 0xFF;
+      g += (block[k] >> 8) & 0xFF;
+      b += block[k] & 0xFF;
+    }
+    u[cx] = chroma_u(r >> 2, g >> 2, b >> 2);
+    v[cx] = chroma_v(r >> 2, g >> 2, b >> 2);
+  }
+}
+
+#if defined(__SSE2__)
+/* Red, green and blue of eight pixels as 16-bit lanes. */
+static void split_channels(const uint32_t *p, __m128i *r, __m128i *g,
+                           __m128i *b)
+{
+  const __m128i mask = _mm_set1_epi32(0xFF);
+  __m128i lo = _mm_loadu_si128((const __m128i *)p);
+  __m128i hi = _mm_loadu_si128((const __m128i *)(p + 4));
+  *b = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+  *g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask),
+                       _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+  *r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask),
+                       _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+}
+
+/* (ar * r + ag * g + ab * b + bias) >> 8 in 16-bit lanes, wrapping
+   products and sums landing back in range before the logical shift. */
+static __m128i weigh(__m128i r, __m128i g, __m128i b, short ar, short ag,
+                     short ab, short bias)
+{
+  __m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(ar)),
+                              _mm_mullo_epi16(g, _mm_set1_epi16(ag)));
+  sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(ab)));
+  return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(bias)), 8);
+}
+
+/* Sums of adjacent lanes of the two rows' eight pixels: four 32-bit
+   lanes. */
+static __m128i pair_sums(__m128i top, __m128i bottom)
+{
+  __m128i s = _mm_add_epi16(top, bottom);
+  s = _mm_add_epi16(s, _mm_srli_epi32(s, 16));
+  return _mm_and_si128(s, _mm_set1_epi32(0xFFFF));
+}
+
+/* Sixteen columns from x of both rows, eight chroma samples. */
+static void convert_16(const uint32_t *row0, const uint32_t *row1,
+                       uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                       int x)
+{
+  __m128i r[2][2];
+  __m128i g[2][2];
+  __m128i b[2][2];
+  const uint32_t *rows[2] = {row0, row1};
+  uint8_t *outs[2] = {y0, y1};
+  for (int i = 0; i < 2; ++i)
+  {
+    split_channels(rows[i] + x, &r[i][0], &g[i][0], &b[i][0]);
+    split_channels(rows[i] + x + 8, &r[i][1], &g[i][1], &b[i][1]);
+    if (!outs[i])
+      continue;
+    __m128i lo = weigh(r[i][0], g[i][0], b[i][0], 66, 129, 25, 128);
+    __m128i hi = weigh(r[i][1], g[i][1], b[i][1], 66, 129, 25, 128);
+    const __m128i bias = _mm_set1_epi16(16);
+    _mm_storeu_si128((__m128i *)(outs[i] + x),
+                     _mm_packus_epi16(_mm_add_epi16(lo, bias),
+                                      _mm_add_epi16(hi, bias)));
+  }
+
+  const __m128i two = _mm_set1_epi16(2);
+  __m128i mr = _mm_packs_epi32(pair_sums(r[0][0], r[1][0]),
+                               pair_sums(r[0][1], r[1][1]));
+  __m128i mg = _mm_packs_epi32(pair_sums(g[0][0], g[1][0]),
+                               pair_sums(g[0][1], g[1][1]));
+  __m128i mb = _mm_packs_epi32(pair_sums(b[0][0], b[1][0]),
+                               pair_sums(b[0][1], b[1][1]));
+  mr = _mm_srli_epi16(_mm_add_epi16(mr, two), 2);
+  mg = _mm_srli_epi16(_mm_add_epi16(mg, two), 2);
+  mb = _mm_srli_epi16(_mm_add_epi16(mb, two), 2);
+  const __m128i zero = _mm_setzero_si128();
+  const short bias = (short)32896;
+  _mm_storel_epi64((__m128i *)(u + x / 2),
+                   _mm_packus_epi16(weigh(mr, mg, mb, -38, -74, 112, bias),
+                                    zero));
+  _mm_storel_epi64((__m128i *)(v + x / 2),
+                   _mm_packus_epi16(weigh(mr, mg, mb, 112, -94, -18, bias),
+                                    zero));
+}
+
+static void convert_pair(const YuvFrame *dst, const Framebuffer *src, int cy)
+{
+  const int width = src->width;
+  const int y0 = 2 * cy;
+  const int y1 = y0 + 1 < src->height ? y0 + 1 : y0;
+  const int chromaWidth = (width + 1) / 2;
+  const uint32_t *row0 = src->pixels + (size_t)y0 * src->pitch;
+  const uint32_t *row1 = src->pixels + (size_t)y1 * src->pitch;
+  uint8_t *out0 = dst->y + (size_t)y0 * width;
+  uint8_t *out1 = y1 != y0 ? dst->y + (size_t)y1 * width : NULL;
+  uint8_t *u = dst->u + (size_t)cy * chromaWidth;
+  uint8_t *v = dst->v + (size_t)cy * chromaWidth;
+  int x = 0;
+  for (; x + 16 <= width; x += 16)
+    convert_16(row0, row1, out0, out1, u, v, x);
+  if (x < width)
+    convert_pair_scalar(dst, src, cy, x);
+}
+#else
+static void convert_pair(const YuvFrame *dst, const Framebuffer *src, int cy)
+{
+  convert_pair_scalar(dst, src, cy, 0);
+}
+#endif
+
+typedef struct YuvJob
+{
+  const YuvFrame *dst;
+  const Framebuffer *src;
+} YuvJob;
+
+static int chroma_rows(const Framebuffer *src)
+{
+  return (src->height + 1) / 2;
+}
+
+static void convert_band(void *arg, int item, int worker)
+{
+  (void)worker;
+  const YuvJob *job = arg;
+  const int rows = chroma_rows(job->src);
+  const int end = (item + 1) * YUV_BAND_PAIRS;
+  for (int cy = item * YUV_BAND_PAIRS; cy < end && cy < rows; ++cy)
+    convert_pair(job->dst, job->src, cy);
+}
+
+void yuv_from_argb(const YuvFrame *dst, const Framebuffer *src,
+                   WorkerPool *pool)
+{
+  YuvJob job = {dst, src};
+  const int bands = (chroma_rows(src) + YUV_BAND_PAIRS - 1) / YUV_BAND_PAIRS;
+  worker_pool_run(pool, bands, convert_band, &job);
+}
+
+void yuv_from_argb_scalar(const YuvFrame *dst, const Framebuffer *src)
+{
+  for (int cy = 0; cy < chroma_rows(src); ++cy)
+    convert_pair_scalar(dst, src, cy, 0);
+}
@@ -0,0 +1,35 @@
+#ifndef RAYCAST_YUV_H
+#define RAYCAST_YUV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "render.h"
+
+/* An I420 frame: full-size luma, then the two chroma planes at half the
+   size in each direction, rounded up. Rows are packed. */
+typedef struct YuvFrame
+{
+  uint8_t *y;
+  uint8_t *u;
+  uint8_t *v;
+  int width;
+  int height;
+} YuvFrame;
+
+/* Bytes of the three planes of a width x height frame. */
+size_t yuv_frame_size(int width, int height);
+/* Points `frame` at the planes laid out back to back from `data`. */
+void yuv_frame_wrap(YuvFrame *frame, uint8_t *data, int width, int height);
+
+/* Converts the row-major ARGB8888 `src` to `dst` of the same size with
+   the integer BT.601 studio-swing coefficients, each chroma sample taken
+   from the rounded mean of its 2x2 block (edge pixels repeat on odd
+   sizes). Bands of rows are spread across `pool`, or NULL for the
+   calling thread; with SSE2 sixteen pixels go per step, matching
+   yuv_from_argb_scalar() byte for byte. */
+void yuv_from_argb(const YuvFrame *dst, const Framebuffer *src,
+                   WorkerPool *pool);
+void yuv_from_argb_scalar(const YuvFrame *dst, const Framebuffer *src);
+
+#endif